@@ -0,0 +1,295 @@
+#include <string.h>
+
+#include "array.h"
+#include "memory.h"
+#include "vm.h"
+
+/**
+ * 尾追加，容量按几何级数增长，均摊 O(1)
+ * 调用方须保证 array 可被 GC 找到（例如位于 vm 栈上）；value 在扩容期间由本函数保活
+ */
+void arrayPush(ObjArray *array, Value value)
+{
+    push(value);
+    writeValueArray(&array->values, value);
+    pop();
+}
+
+//
+// natives，方法的 args[0] 为接收者
+//
+
+/** push(...values)：返回追加后的长度 */
+static Value pushNative(int argCount, Value *args)
+{
+    ObjArray *array = AS_ARRAY(args[0]);
+    for (int i = 1; i < argCount; i++)
+        writeValueArray(&array->values, args[i]); // 参数仍在栈上
+    return NUMBER_VAL(array->values.count);
+}
+
+/** pop()：移除并返回最后一个元素，空数组返回 nil */
+static Value popNative(int argCount, Value *args)
+{
+    ObjArray *array = AS_ARRAY(args[0]);
+    if (array->values.count == 0)
+        return NIL_VAL;
+    return array->values.values[--array->values.count];
+}
+
+/**
+ * forEach(fn)：依次调用 fn(element)
+ * 每次调用前重新读取长度，fn 中增删元素不会越界
+ */
+static Value forEachNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+
+    ObjArray *array = AS_ARRAY(args[0]);
+    NativeCall call;
+    if (!beginCall(&call, args[1], 1))
+        return NIL_VAL;
+    for (int i = 0; i < array->values.count; i++)
+    {
+        Value result;
+        call.args[0] = array->values.values[i];
+        if (!repeatCall(&call, &result))
+            return NIL_VAL;
+    }
+    endCall(&call);
+    return NIL_VAL;
+}
+
+/** map(fn)：fn(element) 的结果组成的新数组 */
+static Value mapNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+
+    ObjArray *array = AS_ARRAY(args[0]);
+    ObjArray *mapped = newArray();
+    push(OBJ_VAL(mapped));
+    NativeCall call;
+    if (!beginCall(&call, args[1], 1))
+        return NIL_VAL;
+    for (int i = 0; i < array->values.count; i++)
+    {
+        Value result;
+        call.args[0] = array->values.values[i];
+        if (!repeatCall(&call, &result))
+            return NIL_VAL;
+        arrayPush(mapped, result);
+    }
+    endCall(&call);
+    pop();
+    return OBJ_VAL(mapped);
+}
+
+/** filter(fn)：fn(element) 为真的元素组成的新数组 */
+static Value filterNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+
+    ObjArray *array = AS_ARRAY(args[0]);
+    ObjArray *filtered = newArray();
+    push(OBJ_VAL(filtered));
+    NativeCall call;
+    if (!beginCall(&call, args[1], 1))
+        return NIL_VAL;
+    for (int i = 0; i < array->values.count; i++)
+    {
+        Value result;
+        Value element = array->values.values[i];
+        call.args[0] = element;
+        if (!repeatCall(&call, &result))
+            return NIL_VAL;
+        if (!isFalsey(result))
+            arrayPush(filtered, element);
+    }
+    endCall(&call);
+    pop();
+    return OBJ_VAL(filtered);
+}
+
+/**
+ * reduce(fn, initial)：依次计算 accumulator = fn(accumulator, element)
+ * 省略 initial 时以第一个元素为初值，此时空数组返回 nil
+ */
+static Value reduceNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+
+    ObjArray *array = AS_ARRAY(args[0]);
+    int start = 0;
+    Value accumulator;
+    if (argCount >= 3)
+        accumulator = args[2];
+    else if (array->values.count > 0)
+        accumulator = array->values.values[start++];
+    else
+        return NIL_VAL;
+
+    NativeCall call;
+    if (!beginCall(&call, args[1], 2))
+        return NIL_VAL;
+    for (int i = start; i < array->values.count; i++)
+    {
+        call.args[0] = accumulator; // 上一次的结果位于槽 0，写入参数槽前仍可达
+        call.args[1] = array->values.values[i];
+        if (!repeatCall(&call, &accumulator))
+            return NIL_VAL;
+    }
+    endCall(&call);
+    return accumulator;
+}
+
+//
+// sort：自底向上的归并排序（稳定），比较函数可能回调 Lox
+//
+
+typedef struct
+{
+    /** 为 false 时按数字或字符串的自然顺序比较 */
+    bool custom;
+    NativeCall call;
+} Comparator;
+
+/**
+ * @param order 小于 0 表示 a 应排在 b 之前，比较函数返回非数字时视为 0
+ * @return 比较函数发生运行时错误时返回 false
+ */
+static bool compareElements(Comparator *comparator, Value a, Value b, double *order)
+{
+    if (comparator->custom)
+    {
+        Value result;
+        comparator->call.args[0] = a;
+        comparator->call.args[1] = b;
+        if (!repeatCall(&comparator->call, &result))
+            return false;
+        *order = IS_NUMBER(result) ? AS_NUMBER(result) : 0;
+        return true;
+    }
+
+    if (IS_NUMBER(a))
+    {
+        *order = AS_NUMBER(a) < AS_NUMBER(b) ? -1 : AS_NUMBER(a) > AS_NUMBER(b) ? 1 : 0;
+        return true;
+    }
+
+    char bufferA[SMALL_STRING_BUFFER], bufferB[SMALL_STRING_BUFFER];
+    int lengthA, lengthB;
+    const char *charsA = stringChars(a, bufferA, &lengthA);
+    const char *charsB = stringChars(b, bufferB, &lengthB);
+    int result = memcmp(charsA, charsB, lengthA < lengthB ? lengthA : lengthB);
+    *order = result != 0 ? result : lengthA - lengthB;
+    return true;
+}
+
+/** 将 from 中相邻的有序段 [low, middle) 与 [middle, high) 归并到 to */
+static bool mergeRuns(Comparator *comparator, Value *from, Value *to, int low, int middle, int high)
+{
+    double order;
+    if (!compareElements(comparator, from[middle - 1], from[middle], &order))
+        return false;
+    if (order <= 0)
+    { // 两段已经有序
+        memcpy(to + low, from + low, sizeof(Value) * (high - low));
+        return true;
+    }
+
+    int i = low, j = middle, k = low;
+    while (i < middle && j < high)
+    {
+        if (!compareElements(comparator, from[j], from[i], &order))
+            return false;
+        to[k++] = order < 0 ? from[j++] : from[i++]; // 相等时取左段，保持稳定
+    }
+    while (i < middle)
+        to[k++] = from[i++];
+    while (j < high)
+        to[k++] = from[j++];
+    return true;
+}
+
+/** 复制数组元素，用于排序的工作区 */
+static ObjArray *copyElements(ObjArray *array)
+{
+    ObjArray *copy = newArray();
+    push(OBJ_VAL(copy));
+    for (int i = 0; i < array->values.count; i++)
+        writeValueArray(&copy->values, array->values.values[i]);
+    pop();
+    return copy;
+}
+
+/**
+ * sort(compare)：原地稳定排序并返回数组，compare(a, b) 小于 0 表示 a 在前
+ * 省略 compare 时元素须全为数字或全为字符串（按字节序），否则返回 nil
+ * 排序在副本上进行，compare 修改数组不影响本次排序，结束后以排序结果覆盖数组
+ */
+static Value sortNative(int argCount, Value *args)
+{
+    ObjArray *array = AS_ARRAY(args[0]);
+    int length = array->values.count;
+    Comparator comparator;
+    comparator.custom = argCount >= 2 && !IS_NIL(args[1]);
+    if (!comparator.custom && length > 0)
+    {
+        bool numbers = IS_NUMBER(array->values.values[0]);
+        for (int i = 0; i < length; i++)
+        {
+            Value element = array->values.values[i];
+            if (numbers ? !IS_NUMBER(element) : !IS_STRING(element))
+                return NIL_VAL;
+        }
+    }
+
+    ObjArray *work = copyElements(array);
+    push(OBJ_VAL(work));
+    ObjArray *buffer = copyElements(array);
+    push(OBJ_VAL(buffer));
+    if (comparator.custom && !beginCall(&comparator.call, args[1], 2))
+        return NIL_VAL;
+
+    Value *from = work->values.values, *to = buffer->values.values;
+    for (int width = 1; width < length; width *= 2)
+    {
+        for (int low = 0; low < length; low += 2 * width)
+        {
+            int middle = low + width < length ? low + width : length;
+            int high = middle + width < length ? middle + width : length;
+            if (middle == high)
+                memcpy(to + low, from + low, sizeof(Value) * (high - low));
+            else if (!mergeRuns(&comparator, from, to, low, middle, high))
+                return NIL_VAL;
+        }
+        Value *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (comparator.custom)
+        endCall(&comparator.call);
+    array->values.count = 0;
+    for (int i = 0; i < length; i++)
+        writeValueArray(&array->values, from[i]); // 副本仍在栈上
+    pop();
+    pop();
+    return args[0];
+}
+
+void loadArrayNatives()
+{
+    vm.arrayClass = newBuiltinClass("Array");
+    defineNativeMethod(vm.arrayClass, "push", pushNative);
+    defineNativeMethod(vm.arrayClass, "pop", popNative);
+    defineNativeMethod(vm.arrayClass, "forEach", forEachNative);
+    defineNativeMethod(vm.arrayClass, "map", mapNative);
+    defineNativeMethod(vm.arrayClass, "filter", filterNative);
+    defineNativeMethod(vm.arrayClass, "reduce", reduceNative);
+    defineNativeMethod(vm.arrayClass, "sort", sortNative);
+}
@@ -0,0 +1,11 @@
+#ifndef loxj_array_h
+#define loxj_array_h
+
+#include "common.h"
+#include "object.h"
+
+void arrayPush(ObjArray *array, Value value);
+
+void loadArrayNatives();
+
+#endif
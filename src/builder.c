@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "builder.h"
+#include "memory.h"
+#include "vm.h"
+
+/**
+ * 确保还能追加 length 个字符
+ * 容量按 CAPACITY_GROW_RATE 几何增长，追加的均摊代价为 O(1)
+ */
+static void reserve(ObjStringBuilder *builder, int length)
+{
+    int required = builder->length + length;
+    if (required <= builder->capacity)
+        return;
+
+    int oldCapacity = builder->capacity;
+    int capacity = GROW_CAPACITY(oldCapacity);
+    while (capacity < required)
+        capacity *= CAPACITY_GROW_RATE;
+
+    builder->chars = GROW_ARRAY(char, builder->chars, oldCapacity, capacity);
+    builder->capacity = capacity;
+}
+
+/**
+ * 调用方须保证 builder 可被 GC 找到（例如位于 vm 栈上），因为扩容可能触发 GC
+ */
+void builderAppend(ObjStringBuilder *builder, const char *chars, int length)
+{
+    if (length == 0)
+        return;
+
+    reserve(builder, length);
+    memcpy(builder->chars + builder->length, chars, length);
+    builder->length += length;
+    builder->string = NIL_VAL; // 缓存失效
+}
+
+void builderAppendValue(ObjStringBuilder *builder, Value value)
+{
+    char buffer[FORMAT_BUFFER];
+    int length;
+    const char *chars = formatValue(value, buffer, &length);
+    builderAppend(builder, chars, length);
+}
+
+/**
+ * 生成（并驻留）当前内容的字符串，内容不变时重复调用不会再次分配
+ */
+Value builderToString(ObjStringBuilder *builder)
+{
+    if (IS_NIL(builder->string))
+        builder->string = copyStringValue(builder->length > 0 ? builder->chars : "", builder->length);
+    return builder->string;
+}
+
+//
+// natives，方法的 args[0] 为接收者
+//
+
+static Value stringBuilderNative(int argCount, Value *args)
+{
+    ObjStringBuilder *builder = newStringBuilder();
+    push(OBJ_VAL(builder));
+    for (int i = 0; i < argCount; i++)
+        builderAppendValue(builder, args[i]);
+    pop();
+    return OBJ_VAL(builder);
+}
+
+static Value appendNative(int argCount, Value *args)
+{
+    ObjStringBuilder *builder = AS_STRING_BUILDER(args[0]);
+    for (int i = 1; i < argCount; i++)
+        builderAppendValue(builder, args[i]);
+    return args[0];
+}
+
+static Value appendNumberNative(int argCount, Value *args)
+{
+    ObjStringBuilder *builder = AS_STRING_BUILDER(args[0]);
+    for (int i = 1; i < argCount; i++)
+    {
+        if (!IS_NUMBER(args[i]))
+            return NIL_VAL;
+
+        char buffer[NUMBER_BUFFER];
+        builderAppend(builder, buffer, formatNumber(AS_NUMBER(args[i]), buffer));
+    }
+    return args[0];
+}
+
+static Value toStringNative(int argCount, Value *args)
+{
+    return builderToString(AS_STRING_BUILDER(args[0]));
+}
+
+void loadStringBuilderNatives()
+{
+    defineNative("StringBuilder", stringBuilderNative);
+
+    vm.stringBuilderClass = newBuiltinClass("StringBuilder");
+    defineNativeMethod(vm.stringBuilderClass, "append", appendNative);
+    defineNativeMethod(vm.stringBuilderClass, "appendNumber", appendNumberNative);
+    defineNativeMethod(vm.stringBuilderClass, "toString", toStringNative);
+}
@@ -0,0 +1,13 @@
+#ifndef loxj_builder_h
+#define loxj_builder_h
+
+#include "common.h"
+#include "object.h"
+
+void builderAppend(ObjStringBuilder *builder, const char *chars, int length);
+void builderAppendValue(ObjStringBuilder *builder, Value value);
+Value builderToString(ObjStringBuilder *builder);
+
+void loadStringBuilderNatives();
+
+#endif
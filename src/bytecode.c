@@ -0,0 +1,553 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "chunk.h"
+#include "compiler.h"
+#include "file.h"
+#include "memory.h"
+#include "vm.h"
+
+// 字节码文件（.loxc）的布局，整数均为小端：
+//   文件头  "LOXC" | u32 版本 | u32 操作码个数 | u64 键（编译缓存项的键，--compile 写出的文件为 0）
+//   函数    u32 arity | u32 upvalueCount | u32 slotCount | 名称 | u32 常量个数 | 常量...
+//           | u32 字节码长度 | 字节码 | u32 行号表项数 | (u32 offset, u32 line)...
+//   名称    u32 长度（NO_NAME 表示没有名称）| 字节
+//   常量    u8 标记 | 数值为 u64 位模式，字符串同名称，函数常量递归为函数
+// 常量先于字节码，载入字节码时即可据常量校验操作数
+// 名称常量（全局变量、属性、方法、类名）载入时驻留；其余字符串常量是引用映射的视图，
+// 不复制也不驻留，到用作键等场合才按需驻留
+
+#define BYTECODE_MAGIC "LOXC"
+/** 名称长度的特殊值：没有名称的函数（顶层脚本） */
+#define NO_NAME UINT32_MAX
+/** 函数嵌套的最大深度，防止损坏的文件耗尽 C 栈 */
+#define FUNCTION_DEPTH_MAX 256
+
+typedef enum
+{
+    CONSTANT_NIL,
+    CONSTANT_FALSE,
+    CONSTANT_TRUE,
+    CONSTANT_NUMBER,
+    CONSTANT_STRING,
+    /** 须驻留的字符串 */
+    CONSTANT_NAME,
+    CONSTANT_FUNCTION,
+} ConstantTag;
+
+/** 指令的操作数种类：写出时据此找出名称常量，载入时据此校验 */
+typedef enum
+{
+    OPERAND_NONE,
+    /** 单字节计数，任意值均有效 */
+    OPERAND_BYTE,
+    OPERAND_CONSTANT,
+    /** 字符串常量 */
+    OPERAND_NAME,
+    OPERAND_LOCAL,
+    OPERAND_UPVALUE,
+    OPERAND_JUMP,
+    OPERAND_LOOP,
+    /** 函数常量，其后是各上值的 (isLocal, index) */
+    OPERAND_CLOSURE,
+    /** 方法名常量，其后是单字节的参数个数 */
+    OPERAND_INVOKE,
+} OperandKind;
+
+typedef struct
+{
+    uint8_t op;
+    bool wide;
+    OperandKind kind;
+    int operand;
+    /** 连同前缀与全部操作数的字节数 */
+    int length;
+} Instruction;
+
+static OperandKind operandKind(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_POPN:
+    case OP_BUILD_STRING:
+    case OP_ARRAY:
+    case OP_CALL:
+        return OPERAND_BYTE;
+    case OP_CONSTANT:
+        return OPERAND_CONSTANT;
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_CLASS:
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_METHOD:
+    case OP_GET_SUPER:
+        return OPERAND_NAME;
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+        return OPERAND_LOCAL;
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+        return OPERAND_UPVALUE;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_POP_JUMP_IF_FALSE:
+        return OPERAND_JUMP;
+    case OP_LOOP:
+        return OPERAND_LOOP;
+    case OP_CLOSURE:
+        return OPERAND_CLOSURE;
+    case OP_INVOKE:
+    case OP_SUPER_INVOKE:
+        return OPERAND_INVOKE;
+    default:
+        return OPERAND_NONE;
+    }
+}
+
+/**
+ * 解码位于 offset 的指令
+ * 与 instructionLength 不同，不信任字节码：越界、未知操作码、不接受 OP_WIDE 前缀的指令，
+ * 以及 OP_CLOSURE 引用的常量不是函数时返回 false
+ */
+static bool decodeInstruction(Chunk *chunk, int offset, Instruction *instruction)
+{
+    uint8_t op = chunk->code[offset];
+    bool wide = op == OP_WIDE;
+    if (wide)
+    {
+        if (offset + 1 >= chunk->count)
+            return false;
+        op = chunk->code[offset + 1];
+    }
+    if (op >= OP_WIDE)
+        return false;
+
+    OperandKind kind = operandKind(op);
+    if (wide && (kind == OPERAND_NONE || kind == OPERAND_BYTE))
+        return false;
+
+    int start = offset + (wide ? 2 : 1);
+    int size = 0;
+    if (kind != OPERAND_NONE)
+        size = wide ? 3 : (kind == OPERAND_JUMP || kind == OPERAND_LOOP ? 2 : 1);
+    int length = start - offset + size + (kind == OPERAND_INVOKE ? 1 : 0);
+    if (length > chunk->count - offset)
+        return false;
+
+    int operand = 0;
+    for (int i = 0; i < size; i++)
+        operand = (operand << 8) | chunk->code[start + i];
+
+    if (kind == OPERAND_CLOSURE)
+    {
+        if (operand >= chunk->constants.count || !IS_FUNCTION(chunk->constants.values[operand]))
+            return false;
+        length += AS_FUNCTION(chunk->constants.values[operand])->upvalueCount * (wide ? 4 : 2);
+        if (length > chunk->count - offset)
+            return false;
+    }
+
+    instruction->op = op;
+    instruction->wide = wide;
+    instruction->kind = kind;
+    instruction->operand = operand;
+    instruction->length = length;
+    return true;
+}
+
+//
+// 写出
+//
+
+/** 字节码与行号表 */
+void writeChunkCode(Writer *writer, Chunk *chunk)
+{
+    writeU32(writer, (uint32_t)chunk->count);
+    writeBytes(writer, chunk->code, (size_t)chunk->count);
+    writeU32(writer, (uint32_t)chunk->lineCount);
+    for (int i = 0; i < chunk->lineCount; i++)
+    {
+        writeU32(writer, (uint32_t)chunk->lines[i].offset);
+        writeU32(writer, (uint32_t)chunk->lines[i].line);
+    }
+}
+
+static void writeFunction(Writer *writer, ObjFunction *function);
+
+static void writeConstant(Writer *writer, Value value, bool name)
+{
+    if (IS_NIL(value))
+        writeByte(writer, CONSTANT_NIL);
+    else if (IS_BOOL(value))
+        writeByte(writer, AS_BOOL(value) ? CONSTANT_TRUE : CONSTANT_FALSE);
+    else if (IS_NUMBER(value))
+    {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        writeByte(writer, CONSTANT_NUMBER);
+        writeU64(writer, bits);
+    }
+    else if (IS_STRING(value))
+    {
+        writeByte(writer, name ? CONSTANT_NAME : CONSTANT_STRING);
+        writeString(writer, value);
+    }
+    else if (IS_FUNCTION(value))
+    {
+        writeByte(writer, CONSTANT_FUNCTION);
+        writeFunction(writer, AS_FUNCTION(value));
+    }
+    else
+        writer->failed = true; // 编译器不会产生其他常量
+}
+
+static void writeFunction(Writer *writer, ObjFunction *function)
+{
+    if (function->lazy != NULL && !compileLazyFunction(function))
+    { // 延迟编译的函数体须先编译
+        writer->failed = true;
+        return;
+    }
+
+    Chunk *chunk = &function->chunk;
+    writeU32(writer, (uint32_t)function->arity);
+    writeU32(writer, (uint32_t)function->upvalueCount);
+    writeU32(writer, (uint32_t)function->slotCount);
+    if (function->name == NULL)
+        writeU32(writer, NO_NAME);
+    else
+        writeString(writer, OBJ_VAL(function->name));
+
+    // 按引用常量的指令找出名称常量，载入时只驻留这些
+    bool *names = (bool *)calloc((size_t)chunk->constants.count + 1, sizeof(bool));
+    if (names == NULL)
+    {
+        writer->failed = true;
+        return;
+    }
+    Instruction instruction;
+    for (int offset = 0; offset < chunk->count; offset += instruction.length)
+    {
+        if (!decodeInstruction(chunk, offset, &instruction))
+        {
+            writer->failed = true;
+            break;
+        }
+        if (instruction.kind == OPERAND_NAME || instruction.kind == OPERAND_INVOKE)
+            names[instruction.operand] = true;
+    }
+
+    writeU32(writer, (uint32_t)chunk->constants.count);
+    for (int i = 0; i < chunk->constants.count; i++)
+        writeConstant(writer, chunk->constants.values[i], names[i]);
+    free(names);
+
+    writeChunkCode(writer, chunk);
+}
+
+/**
+ * 将编译得到的顶层函数连同嵌套函数写为字节码文件
+ * @param key 编译缓存项的键，其他文件为 NULL（各项写为 0）
+ * @return 写入失败返回 false
+ */
+bool writeBytecode(ObjFunction *function, const CacheKey *key, const char *path)
+{
+    Writer writer = {NULL, 0, 0, false};
+    writeBytes(&writer, BYTECODE_MAGIC, 4);
+    writeU32(&writer, BYTECODE_VERSION);
+    writeU32(&writer, OP_WIDE + 1);
+    writeU64(&writer, key != NULL ? key->hash : 0);
+    writeU64(&writer, key != NULL ? key->digest : 0);
+    writeU64(&writer, key != NULL ? key->length : 0);
+    push(OBJ_VAL(function)); // 编译延迟的函数体时会分配对象
+    writeFunction(&writer, function);
+    pop();
+    return saveWriter(&writer, path);
+}
+
+//
+// 载入
+//
+
+static ObjFunction *readFunction(Reader *reader, int depth);
+
+/** 读取一个常量并加入 function 的常量表 */
+static bool readConstant(Reader *reader, ObjFunction *function, int depth)
+{
+    const uint8_t *tag = readSpan(reader, 1);
+    if (tag == NULL)
+        return false;
+
+    Value value;
+    switch (*tag)
+    {
+    case CONSTANT_NIL:
+        value = NIL_VAL;
+        break;
+    case CONSTANT_FALSE:
+        value = BOOL_VAL(false);
+        break;
+    case CONSTANT_TRUE:
+        value = BOOL_VAL(true);
+        break;
+    case CONSTANT_NUMBER:
+    {
+        uint64_t bits;
+        if (!readU64(reader, &bits))
+            return false;
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        value = NUMBER_VAL(isnan(number) ? NAN : number); // 任意的 NaN 位模式在 NaN-boxing 下可能被当作对象
+        break;
+    }
+    case CONSTANT_STRING:
+    case CONSTANT_NAME:
+    {
+        const char *chars;
+        int length;
+        if (!readString(reader, &chars, &length))
+            return false;
+        if (*tag == CONSTANT_NAME)
+            value = OBJ_VAL(copyString(chars, length)); // 名称须是驻留的 ObjString
+        else if (length <= SMALL_STRING_MAX)
+            value = copyStringValue(chars, length);
+        else
+            value = OBJ_VAL(newStringView((Obj *)reader->file, chars, length));
+        break;
+    }
+    case CONSTANT_FUNCTION:
+    {
+        ObjFunction *nested = readFunction(reader, depth + 1);
+        if (nested == NULL)
+            return false;
+        addConstant(&function->chunk, OBJ_VAL(nested));
+        pop();
+        return true;
+    }
+    default:
+        return false;
+    }
+
+    addConstant(&function->chunk, value);
+    return true;
+}
+
+/** 读取 writeChunkCode 写出的内容，行号表须从 0 开始且 offset 递增 */
+bool readChunkCode(Reader *reader, Chunk *chunk)
+{
+    uint32_t count;
+    if (!readU32(reader, &count) || count == 0 || count > INT32_MAX)
+        return false;
+    const uint8_t *code = readSpan(reader, count);
+    if (code == NULL)
+        return false;
+
+    chunk->code = GROW_ARRAY(uint8_t, NULL, 0, count);
+    memcpy(chunk->code, code, count);
+    chunk->capacity = (int)count;
+    chunk->count = (int)count;
+
+    if (!readU32(reader, &count) || count == 0 || count > (uint32_t)chunk->count)
+        return false;
+
+    chunk->lines = GROW_ARRAY(LineStart, NULL, 0, count);
+    chunk->lineCapacity = (int)count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t offset, line;
+        if (!readU32(reader, &offset) || !readU32(reader, &line) || line > INT32_MAX)
+            return false;
+        if (offset >= (uint32_t)chunk->count || (i == 0 ? offset != 0 : (int)offset <= chunk->lines[i - 1].offset))
+            return false;
+        chunk->lines[i].offset = (int)offset;
+        chunk->lines[i].line = (int)line;
+        chunk->lineCount = (int)i + 1;
+    }
+    return true;
+}
+
+/** 校验除跳转目标外的操作数 */
+static bool verifyOperand(ObjFunction *function, int offset, Instruction *instruction)
+{
+    Chunk *chunk = &function->chunk;
+    int operand = instruction->operand;
+    switch (instruction->kind)
+    {
+    case OPERAND_CONSTANT:
+        return operand < chunk->constants.count;
+    case OPERAND_NAME:
+    case OPERAND_INVOKE:
+        return operand < chunk->constants.count && IS_OBJ_STRING(chunk->constants.values[operand]);
+    case OPERAND_LOCAL:
+        return operand < function->slotCount;
+    case OPERAND_UPVALUE:
+        return operand < function->upvalueCount;
+    case OPERAND_CLOSURE:
+    {
+        ObjFunction *nested = AS_FUNCTION(chunk->constants.values[operand]);
+        int indexSize = instruction->wide ? 3 : 1;
+        uint8_t *upvalue = chunk->code + offset + instruction->length - nested->upvalueCount * (1 + indexSize);
+        for (int i = 0; i < nested->upvalueCount; i++, upvalue += 1 + indexSize)
+        {
+            int index = 0;
+            for (int j = 1; j <= indexSize; j++)
+                index = (index << 8) | upvalue[j];
+            if (upvalue[0] > 1 || index >= (upvalue[0] ? function->slotCount : function->upvalueCount))
+                return false;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+/**
+ * 校验载入的字节码：指令完整且操作码有效，操作数引用的常量、局部变量槽与上值存在且类型正确，
+ * 跳转落在指令边界上，最后一条指令是 OP_RETURN
+ * 不检查值栈的使用是否平衡，那只能来自手工构造的文件
+ */
+bool verifyFunction(ObjFunction *function)
+{
+    Chunk *chunk = &function->chunk;
+    uint8_t *starts = (uint8_t *)calloc((size_t)chunk->count, 1);
+    if (starts == NULL)
+        return false;
+
+    bool valid = true;
+    int last = 0;
+    Instruction instruction;
+    for (int offset = 0; valid && offset < chunk->count; offset += instruction.length)
+    {
+        valid = decodeInstruction(chunk, offset, &instruction) && verifyOperand(function, offset, &instruction);
+        starts[offset] = 1;
+        last = offset;
+    }
+
+    for (int offset = 0; valid && offset < chunk->count; offset += instruction.length)
+    {
+        decodeInstruction(chunk, offset, &instruction);
+        int next = offset + instruction.length;
+        if (instruction.kind == OPERAND_JUMP)
+            valid = instruction.operand < chunk->count - next && starts[next + instruction.operand];
+        else if (instruction.kind == OPERAND_LOOP)
+            valid = instruction.operand <= next && starts[next - instruction.operand];
+    }
+
+    free(starts);
+    return valid && chunk->code[last] == OP_RETURN;
+}
+
+/** 载入的参数、上值与局部变量槽个数是否在编译器的限制之内，须在据此分配之前检查 */
+bool isValidFunctionShape(uint32_t arity, uint32_t upvalueCount, uint32_t slotCount)
+{
+    return arity <= UINT8_MAX && upvalueCount <= WIDE_OPERAND_MAX + 1 && slotCount > arity &&
+           slotCount <= WIDE_OPERAND_MAX + 1;
+}
+
+/**
+ * 读取一个函数，结果已压入 vm 栈
+ * @return 文件损坏时返回 NULL，栈不变
+ */
+static ObjFunction *readFunction(Reader *reader, int depth)
+{
+    uint32_t arity, upvalueCount, slotCount, nameLength;
+    if (depth > FUNCTION_DEPTH_MAX || !readU32(reader, &arity) || !readU32(reader, &upvalueCount) ||
+        !readU32(reader, &slotCount) || !readU32(reader, &nameLength))
+        return NULL;
+    if (!isValidFunctionShape(arity, upvalueCount, slotCount))
+        return NULL;
+
+    ObjFunction *function = newFunction();
+    push(OBJ_VAL(function));
+    function->arity = (int)arity;
+    function->upvalueCount = (int)upvalueCount;
+    function->slotCount = (int)slotCount;
+
+    bool valid = true;
+    if (nameLength != NO_NAME)
+    {
+        const char *name = nameLength <= INT32_MAX ? (const char *)readSpan(reader, nameLength) : NULL;
+        valid = name != NULL;
+        if (valid)
+            function->name = copyString(name, (int)nameLength);
+    }
+
+    uint32_t constantCount;
+    valid = valid && readU32(reader, &constantCount) && constantCount <= WIDE_OPERAND_MAX + 1;
+    for (uint32_t i = 0; valid && i < constantCount; i++)
+        valid = readConstant(reader, function, depth);
+
+    if (!valid || !readChunkCode(reader, &function->chunk) || !verifyFunction(function))
+    {
+        pop();
+        return NULL;
+    }
+    return function;
+}
+
+/** 文件是否以字节码文件的魔数开头 */
+bool isBytecodeFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    char magic[4];
+    bool matched = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, BYTECODE_MAGIC, 4) == 0;
+    fclose(file);
+    return matched;
+}
+
+/**
+ * 映射字节码文件并重建顶层函数，文件在全部校验通过后才会被执行
+ * 返回的函数未被任何根引用，须在下一次分配之前压栈
+ * @param key 非 NULL 时文件头中的键须与之相同
+ * @param error 失败时置为原因
+ * @return 失败返回 NULL
+ */
+ObjFunction *loadBytecode(const char *path, const CacheKey *key, const char **error)
+{
+    ObjFileData *file = loadPathData(path, false, false);
+    if (file == NULL)
+    {
+        *error = "cannot read file";
+        return NULL;
+    }
+
+    Reader reader = {(const uint8_t *)file->data, file->length, 0, file};
+    const uint8_t *magic = readSpan(&reader, 4);
+    uint32_t version, opcodeCount;
+    CacheKey fileKey;
+    ObjFunction *function = NULL;
+    if (magic == NULL || memcmp(magic, BYTECODE_MAGIC, 4) != 0 || !readU32(&reader, &version) ||
+        !readU32(&reader, &opcodeCount))
+        *error = "not a bytecode file";
+    else if (version != BYTECODE_VERSION || opcodeCount != OP_WIDE + 1)
+        *error = "bytecode version mismatch";
+    else if (!readU64(&reader, &fileKey.hash) || !readU64(&reader, &fileKey.digest) ||
+             !readU64(&reader, &fileKey.length))
+        *error = "corrupt bytecode";
+    else if (key != NULL &&
+             (fileKey.hash != key->hash || fileKey.digest != key->digest || fileKey.length != key->length))
+        *error = "cache key mismatch";
+    else if ((function = readFunction(&reader, 0)) == NULL)
+        *error = "corrupt bytecode";
+    else
+    {
+        pop();
+        if (reader.position != reader.size || function->arity != 0 || function->upvalueCount != 0)
+        { // 顶层函数没有参数与上值，文件末尾不应有多余内容
+            function = NULL;
+            *error = "corrupt bytecode";
+        }
+    }
+
+    pop(); // file，字符串常量视图使其保持存活
+    return function;
+}
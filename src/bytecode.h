@@ -0,0 +1,32 @@
+#ifndef loxj_bytecode_h
+#define loxj_bytecode_h
+
+#include "common.h"
+#include "chunk.h"
+#include "object.h"
+#include "serialize.h"
+
+/** 字节码文件的格式版本，指令集或文件布局变化时递增 */
+#define BYTECODE_VERSION 3
+
+/** 编译缓存项的键，写在文件头中，载入时三项须全部相同 */
+typedef struct
+{
+    /** 文件名中的哈希 */
+    uint64_t hash;
+    /** 与 hash 算法不同的第二个哈希，防止碰撞时执行另一个程序的字节码 */
+    uint64_t digest;
+    /** 源码长度 */
+    uint64_t length;
+} CacheKey;
+
+bool isBytecodeFile(const char *path);
+bool writeBytecode(ObjFunction *function, const CacheKey *key, const char *path);
+ObjFunction *loadBytecode(const char *path, const CacheKey *key, const char **error);
+
+void writeChunkCode(Writer *writer, Chunk *chunk);
+bool readChunkCode(Reader *reader, Chunk *chunk);
+bool isValidFunctionShape(uint32_t arity, uint32_t upvalueCount, uint32_t slotCount);
+bool verifyFunction(ObjFunction *function);
+
+#endif
@@ -0,0 +1,272 @@
+#define _POSIX_C_SOURCE 200809L // mkdir, utimensat
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "optimizer.h"
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+// 编译缓存：源码内容、解释器构建标识与优化级别的哈希作为键，
+// 缓存项是以键命名的字节码文件，文件头中带有键、第二个独立的哈希与源码长度，三者都相符才算命中，
+// 命中时映射载入而不再编译；缓存项损坏、版本或键不符时载入失败，照常编译并覆盖
+// 缓存项最多 CACHE_ENTRIES_MAX 个，命中时更新修改时间，超出时淘汰最久未使用的项
+
+/**
+ * 解释器的构建标识，参与缓存键，重新构建后不再命中旧的缓存项
+ * Makefile 在任何目标文件重新编译时都会重新编译本文件；可用 -DLOXJ_BUILD_ID=... 指定以便复现构建
+ */
+#ifndef LOXJ_BUILD_ID
+#define LOXJ_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+/** 缓存项路径的最大长度 */
+#define PATH_BUFFER 4096
+
+/** 缓存项文件名（16 位十六进制键 + ".loxc"）的长度 */
+#define CACHE_NAME_LENGTH 21
+
+/** 缓存项个数上限 */
+#define CACHE_ENTRIES_MAX 256
+
+/** FNV-1a (64-bit) */
+static uint64_t hashBytes(uint64_t hash, const void *bytes, size_t length)
+{
+    const uint8_t *data = (const uint8_t *)bytes;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+/** 第二个哈希：按 8 字节分组乘法混合，与 FNV-1a 相互独立 */
+static uint64_t digestBytes(uint64_t hash, const void *bytes, size_t length)
+{
+    const uint8_t *data = (const uint8_t *)bytes;
+    for (size_t i = 0; i < length; i += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + i, length - i < 8 ? length - i : 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15u;
+        hash ^= hash >> 29;
+    }
+    hash ^= length; // 末尾不足 8 字节时补的 0 不与真实的 0 混淆
+    hash *= 0xff51afd7ed558ccdu;
+    return hash ^ (hash >> 33);
+}
+
+static CacheKey cacheKey(const char *sourceCode)
+{
+    CacheKey key;
+    uint8_t level = (uint8_t)optimizeLevel;
+    key.length = strlen(sourceCode);
+
+    key.hash = 14695981039346656037u;
+    key.hash = hashBytes(key.hash, LOXJ_BUILD_ID, sizeof(LOXJ_BUILD_ID)); // 连同结尾的 NUL，与源码隔开
+    key.hash = hashBytes(key.hash, &level, 1);
+    key.hash = hashBytes(key.hash, sourceCode, (size_t)key.length);
+
+    key.digest = digestBytes(level, LOXJ_BUILD_ID, sizeof(LOXJ_BUILD_ID));
+    key.digest = digestBytes(key.digest, sourceCode, (size_t)key.length);
+    return key;
+}
+
+/**
+ * 缓存目录：directory，未指定时为 $XDG_CACHE_HOME/loxj，
+ * XDG_CACHE_HOME 未设置（或不是绝对路径）时为 $HOME/.cache/loxj
+ * @return 无法确定时返回 false
+ */
+static bool cacheDirectory(const char *directory, char path[PATH_BUFFER])
+{
+    int length;
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (directory != NULL)
+        length = snprintf(path, PATH_BUFFER, "%s", directory);
+    else if (cacheHome != NULL && cacheHome[0] == '/')
+        length = snprintf(path, PATH_BUFFER, "%s/loxj", cacheHome);
+    else if (home != NULL && home[0] != '\0')
+        length = snprintf(path, PATH_BUFFER, "%s/.cache/loxj", home);
+    else
+        return false;
+    return length > 0 && length < PATH_BUFFER;
+}
+
+/** 逐级创建目录，已存在不算失败 */
+static bool makeDirectories(char *path)
+{
+    for (char *separator = strchr(path + 1, '/'); separator != NULL; separator = strchr(separator + 1, '/'))
+    {
+        *separator = '\0';
+        mkdir(path, 0700); // 中间各级的失败由最后一级体现
+        *separator = '/';
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+/** 是否为缓存项的文件名 */
+static bool isCacheName(const char *name)
+{
+    if (strlen(name) != CACHE_NAME_LENGTH || strcmp(name + 16, ".loxc") != 0)
+        return false;
+    for (int i = 0; i < 16; i++)
+        if (strchr("0123456789abcdef", name[i]) == NULL)
+            return false;
+    return true;
+}
+
+/** 更新缓存项的修改时间，作为最近使用时间 */
+static void touchEntry(const char *path)
+{
+#if defined(_WIN32)
+    _utime(path, NULL);
+#else
+    utimensat(AT_FDCWD, path, NULL, 0);
+#endif
+}
+
+typedef struct
+{
+    char name[CACHE_NAME_LENGTH + 1];
+    time_t used;
+} CacheEntry;
+
+/** 按最近使用时间从早到晚排序 */
+static int compareEntries(const void *a, const void *b)
+{
+    time_t x = ((const CacheEntry *)a)->used;
+    time_t y = ((const CacheEntry *)b)->used;
+    return x < y ? -1 : x > y;
+}
+
+/** 追加一个缓存项，数组已满时扩容，失败时返回 false */
+static bool appendEntry(CacheEntry **entries, int *count, int *capacity, const char *name, time_t used)
+{
+    if (*count == *capacity)
+    {
+        int grown = *capacity < 8 ? 8 : *capacity * 2;
+        CacheEntry *resized = realloc(*entries, sizeof(CacheEntry) * (size_t)grown);
+        if (resized == NULL)
+            return false;
+        *entries = resized;
+        *capacity = grown;
+    }
+    memcpy((*entries)[*count].name, name, CACHE_NAME_LENGTH + 1);
+    (*entries)[(*count)++].used = used;
+    return true;
+}
+
+/**
+ * 缓存项多于 CACHE_ENTRIES_MAX 个时，删除最久未使用（修改时间最早）的项
+ * @param path 缓存目录，末尾留有放文件名的空间；返回时内容不变
+ */
+static void pruneCache(char *path)
+{
+    size_t length = strlen(path);
+    CacheEntry *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+
+#if defined(_WIN32)
+    struct _finddata_t info;
+    snprintf(path + length, PATH_BUFFER - length, "/*.loxc");
+    intptr_t handle = _findfirst(path, &info);
+    if (handle != -1)
+    {
+        do
+        {
+            if (isCacheName(info.name) && !appendEntry(&entries, &count, &capacity, info.name, info.time_write))
+                break;
+        } while (_findnext(handle, &info) == 0);
+        _findclose(handle);
+    }
+#else
+    DIR *directory = opendir(path);
+    if (directory != NULL)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(directory)) != NULL)
+        {
+            if (!isCacheName(entry->d_name))
+                continue;
+            struct stat info;
+            snprintf(path + length, PATH_BUFFER - length, "/%s", entry->d_name);
+            if (stat(path, &info) == 0 && !appendEntry(&entries, &count, &capacity, entry->d_name, info.st_mtime))
+                break;
+        }
+        closedir(directory);
+    }
+#endif
+
+    if (count > CACHE_ENTRIES_MAX)
+    {
+        qsort(entries, (size_t)count, sizeof(CacheEntry), compareEntries);
+        for (int i = 0; i < count - CACHE_ENTRIES_MAX; i++)
+        {
+            snprintf(path + length, PATH_BUFFER - length, "/%s", entries[i].name);
+            remove(path);
+        }
+    }
+    free(entries);
+    path[length] = '\0';
+}
+
+/**
+ * 同 compile，但先查找编译缓存，未命中时编译并写入缓存
+ * 缓存不可用（无法确定或创建目录、写入失败）时只是退化为每次编译
+ * 返回的函数未被任何根引用，须在下一次分配之前压栈
+ * @param directory 缓存目录，NULL 时使用默认目录
+ */
+ObjFunction *compileCached(const char *sourceCode, const char *directory)
+{
+    char path[PATH_BUFFER];
+    if (!cacheDirectory(directory, path))
+        return compile(sourceCode);
+
+    CacheKey key = cacheKey(sourceCode);
+    size_t length = strlen(path);
+    if (length + CACHE_NAME_LENGTH + 2 >= PATH_BUFFER)
+        return compile(sourceCode);
+
+    snprintf(path + length, PATH_BUFFER - length, "/%016llx.loxc", (unsigned long long)key.hash);
+    const char *error;
+    ObjFunction *function = loadBytecode(path, &key, &error);
+    if (function != NULL)
+    {
+        touchEntry(path);
+        return function;
+    }
+
+    function = compile(sourceCode);
+    if (function == NULL)
+        return NULL;
+
+    path[length] = '\0';
+    if (makeDirectories(path))
+    {
+        path[length] = '/';
+        bool written = writeBytecode(function, &key, path); // 写出期间 function 由 writeBytecode 压栈，不会被回收
+        path[length] = '\0';
+        if (written)
+            pruneCache(path); // 只删除文件，不分配对象，function 无需压栈
+    }
+    return function;
+}
@@ -0,0 +1,9 @@
+#ifndef loxj_cache_h
+#define loxj_cache_h
+
+#include "common.h"
+#include "object.h"
+
+ObjFunction *compileCached(const char *sourceCode, const char *directory);
+
+#endif
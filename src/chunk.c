@@ -18,13 +18,15 @@ void initChunk(Chunk *chunk)
     chunk->capacity = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->lineCount = 0;
+    chunk->lineCapacity = 0;
     initValueArray(&chunk->constants);
 }
 
 void freeChunk(Chunk *chunk)
 {
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
     freeValueArray(&chunk->constants);
     initChunk(chunk);
 }
@@ -40,15 +42,54 @@ void writeChunk(Chunk *chunk, uint8_t byte, int line)
         int oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
         chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
     }
     // count = last_index + 1 = current_index
     chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
+    markLine(chunk, chunk->count, line);
 
     chunk->count++;
 }
 
+/** 从 offset 起的字节属于 line，调用方保证 offset 不小于行号表中已有的位置 */
+void markLine(Chunk *chunk, int offset, int line)
+{
+    if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == line)
+        return; // 同一行的字节共用一项
+
+    if (chunk->lineCapacity < chunk->lineCount + 1)
+    {
+        int oldCapacity = chunk->lineCapacity;
+        chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->lines = GROW_ARRAY(LineStart, chunk->lines, oldCapacity, chunk->lineCapacity);
+    }
+    chunk->lines[chunk->lineCount].offset = offset;
+    chunk->lines[chunk->lineCount].line = line;
+    chunk->lineCount++;
+}
+
+/** 位于 offset 的字节所在的行号，二分查找最后一个起点不大于 offset 的项 */
+int getLine(Chunk *chunk, int offset)
+{
+    int low = 0, high = chunk->lineCount - 1;
+    while (low < high)
+    {
+        int middle = low + (high - low + 1) / 2;
+        if (chunk->lines[middle].offset <= offset)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return chunk->lineCount > 0 ? chunk->lines[low].line : 0;
+}
+
+/** 回退字节码到 count 字节，一并丢弃其后的行号 */
+void truncateChunk(Chunk *chunk, int count)
+{
+    chunk->count = count;
+    while (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].offset >= count)
+        chunk->lineCount--;
+}
+
 /**
  * add contant value to chunk
  * @return index of `value` within all constants in chunk
@@ -69,4 +110,69 @@ int addConstant(Chunk *chunk, Value value)
 #endif
 
     return index; // last count is the same as current index
-}
\ No newline at end of file
+}
+/** OP_WIDE 的 3 字节操作数（大端） */
+int readWideOperand(Chunk *chunk, int offset)
+{
+    return (chunk->code[offset] << 16) | (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+}
+
+/**
+ * 位于 offset 的指令连同操作数的字节数
+ * OP_CLOSURE 之后是每个上值的 (isLocal, index)，个数由函数常量决定
+ */
+int instructionLength(Chunk *chunk, int offset)
+{
+    if (chunk->code[offset] == OP_WIDE)
+    { // 前缀、操作码与 3 字节操作数
+        switch (chunk->code[offset + 1])
+        {
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE:
+            return 6;
+        case OP_CLOSURE:
+        {
+            ObjFunction *function = AS_FUNCTION(chunk->constants.values[readWideOperand(chunk, offset + 2)]);
+            return 5 + 4 * function->upvalueCount;
+        }
+        default:
+            return 5;
+        }
+    }
+
+    switch (chunk->code[offset])
+    {
+    case OP_CONSTANT:
+    case OP_POPN:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_BUILD_STRING:
+    case OP_ARRAY:
+    case OP_CALL:
+    case OP_CLASS:
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_METHOD:
+    case OP_GET_SUPER:
+        return 2;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_POP_JUMP_IF_FALSE:
+    case OP_LOOP:
+    case OP_INVOKE:
+    case OP_SUPER_INVOKE:
+        return 3;
+    case OP_CLOSURE:
+    {
+        ObjFunction *function = AS_FUNCTION(chunk->constants.values[chunk->code[offset + 1]]);
+        return 2 + 2 * function->upvalueCount;
+    }
+    default:
+        return 1;
+    }
+}
@@ -4,6 +4,9 @@
 #include "common.h"
 #include "value.h"
 
+/** OP_WIDE 前缀下 3 字节操作数的最大值 */
+#define WIDE_OPERAND_MAX 0xffffff
+
 /**
  * 字节码（大端）
  * 低地址存放高字节，高地址（堆顶）存放低字节
@@ -17,6 +20,7 @@ typedef enum
     OP_FALSE,
     // stack
     OP_POP,
+    OP_POPN,
     OP_GET_LOCAL,
     OP_SET_LOCAL,
     OP_GET_GLOBAL,
@@ -29,6 +33,7 @@ typedef enum
     // jump
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_POP_JUMP_IF_FALSE,
     OP_LOOP,
     // math
     OP_ADD,
@@ -47,6 +52,12 @@ typedef enum
     OP_RIGHT_SHIFT,
     OP_UNSIGNED_LEFT_SHIFT,
     OP_UNSIGNED_RIGHT_SHIFT,
+    // string
+    OP_BUILD_STRING,
+    // array
+    OP_ARRAY,
+    OP_GET_INDEX,
+    OP_SET_INDEX,
     // func
     OP_PRINT,
     OP_CALL,
@@ -65,8 +76,21 @@ typedef enum
     OP_INHERIT,
     OP_GET_SUPER,
     OP_SUPER_INVOKE,
+    // prefix
+    /**
+     * 下一条指令的索引操作数（常量、局部变量、上值）改为 3 字节，跳转偏移也改为 3 字节
+     * 只在单字节放不下时使用，OP_INVOKE 等的参数个数与 OP_CLOSURE 的 isLocal 仍为单字节
+     */
+    OP_WIDE,
 } OpCode;
 
+/** 行号表的一项：从 offset 起（到下一项之前）的字节都属于 line */
+typedef struct
+{
+    int offset;
+    int line;
+} LineStart;
+
 // 指令动态数组
 typedef struct
 {
@@ -75,17 +99,24 @@ typedef struct
     /** 字节码数组 */
     uint8_t *code;
     /**
-     * 整数数组。数组中的每个数字都是字节码中对应字节所在的行号
-     * （优化？）https://craftinginterpreters.488848.xyz/chunks-of-bytecode.html#challenges
+     * 行号表，按 offset 递增，相邻项的行号不同（游程编码）
+     * https://craftinginterpreters.488848.xyz/chunks-of-bytecode.html#challenges
      */
-    int *lines;
+    LineStart *lines;
+    int lineCount;
+    int lineCapacity;
     ValueArray constants;
 } Chunk;
 
 void initChunk(Chunk *chunk);
 void freeChunk(Chunk *chunk);
 void writeChunk(Chunk *chunk, uint8_t byte, int line);
+void markLine(Chunk *chunk, int offset, int line);
+int getLine(Chunk *chunk, int offset);
+void truncateChunk(Chunk *chunk, int count);
 
 int addConstant(Chunk *chunk, Value value);
+int readWideOperand(Chunk *chunk, int offset);
+int instructionLength(Chunk *chunk, int offset);
 
 #endif
\ No newline at end of file
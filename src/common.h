@@ -11,6 +11,7 @@
 #define DEBUG_PRINT_CODE
 #define DEBUG_STRESS_GC
 #define DEBUG_LOG_GC
+#define DEBUG_CONSTANT_BUDGET // 每个函数编译结束时报告常量池用量
 
 #define NAN_BOXING // 需要确保 CPU 支持
 
@@ -25,5 +26,6 @@
 #undef DEBUG_PRINT_CODE
 #undef DEBUG_STRESS_GC
 #undef DEBUG_LOG_GC
+#undef DEBUG_CONSTANT_BUDGET
 
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include "scanner.h"
 #include "object.h"
 #include "memory.h"
+#include "optimizer.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -14,6 +16,10 @@
 
 // 单遍编译：同时解析AST和执行AST
 
+/** 每个函数的局部变量与上值个数上限，索引超过 UINT8_MAX 时使用 OP_WIDE 前缀 */
+#define LOCALS_MAX (UINT16_MAX + 1)
+#define UPVALUES_MAX (UINT16_MAX + 1)
+
 typedef struct
 {
     Token current;  // 当前标记
@@ -59,12 +65,15 @@ static void grouping(bool canAssign);
 static void number(bool canAssign);
 static void literal(bool canAssign);
 static void string(bool canAssign);
+static void templateString(bool canAssign);
 static void variable(bool canAssign);
 static void and_(bool canAssign);
 static void or_(bool canAssign);
 static void call(bool canAssign);
 static void this_(bool canAssign);
 static void dot(bool canAssign);
+static void array(bool canAssign);
+static void index_(bool canAssign);
 static void super_(bool canAssign);
 static void parsePrecedence(Precedence precedence);
 
@@ -76,6 +85,8 @@ ParseRule const rules[] = {
     [TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
     [TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
     [TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_LEFT_BRACKET] = {array, index_, PREC_CALL},
+    [TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
     [TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
     [TOKEN_DOT] = {NULL, dot, PREC_CALL},
     [TOKEN_MINUS] = {unary, binary, PREC_TERM},
@@ -105,6 +116,8 @@ ParseRule const rules[] = {
     [TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
     [TOKEN_STRING] = {string, NULL, PREC_NONE},
     [TOKEN_NUMBER] = {number, NULL, PREC_NONE},
+    [TOKEN_TEMPLATE_PART] = {templateString, NULL, PREC_NONE},
+    [TOKEN_TEMPLATE] = {templateString, NULL, PREC_NONE},
     [TOKEN_AND] = {NULL, and_, PREC_LOGICAL_AND},
     [TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
     [TOKEN_EXTENDS] = {NULL, binary, PREC_COMPARISON}, // same as TOKEN_LESS
@@ -143,14 +156,84 @@ typedef struct
      */
     int depth;
     bool isCaptured;
+    /** 被本变量遮蔽的同名局部变量索引，-1 表示没有，见 NameEntry */
+    int shadowed;
 } Local;
 
 typedef struct
 {
-    uint8_t index;
+    int index;
     bool isLocal;
 } Upvalue;
 
+/** 一条常量指令（OP_CONSTANT / OP_NIL / OP_TRUE / OP_FALSE），供常量折叠回退字节码 */
+typedef struct
+{
+    /** 指令的起止位置 */
+    int start;
+    int end;
+    /** 常量池索引，OP_NIL 等为 -1 */
+    int index;
+    /** 常量池条目由这条指令新增，而非复用已有的相同常量 */
+    bool added;
+    Value value;
+} ConstantRecord;
+
+/** 首尾相接的常量指令最多记录的条数，超出时丢弃最早的一条（它只是不再参与折叠） */
+#define CONSTANT_RUN_MAX 16
+
+/**
+ * 首尾相接的一串常量指令，栈顶是最近的一条
+ * 子表达式折叠后结果仍与其前的常量相接，外层运算可以继续折叠，如 1 + 2 * 3
+ */
+typedef struct
+{
+    ConstantRecord records[CONSTANT_RUN_MAX];
+    int count;
+} ConstantRun;
+
+/**
+ * 常量池的编译期索引，使相同的常量只占一个条目
+ * 开放寻址，槽中存常量下标，按常量值的位模式比较（-0 与 0 不同）；
+ * 常量被折叠回退后，指向池外的槽即失效，查找时跳过，扩容时丢弃
+ */
+typedef struct
+{
+    int32_t *slots;
+    int capacity;
+    /** 已占用的槽数（含失效的） */
+    int used;
+} ConstantIndex;
+
+/** 名字在本函数中是否为上值尚未解析 */
+#define UNRESOLVED (-2)
+
+/**
+ * 名字表的一项。同名的局部变量构成一个栈：local 指向最内层的一个，每个局部变量的 shadowed 指向它遮蔽的上一个，
+ * 离开作用域时出栈；栈空的项仍留在表中
+ */
+typedef struct
+{
+    /** name.start 为 NULL 表示空槽 */
+    Token name;
+    uint32_t hash;
+    /** 同名的最内层局部变量索引，-1 表示没有 */
+    int local;
+    /**
+     * 名字解析为上值的结果，-1 表示不是上值（全局变量），UNRESOLVED 表示尚未解析
+     * 编译本函数期间外层函数的作用域不变，因此结果可以缓存
+     */
+    int upvalue;
+} NameEntry;
+
+/** 函数内名字到局部变量与上值的索引，开放寻址，只增不删 */
+typedef struct
+{
+    NameEntry *entries;
+    int capacity;
+    int count;
+} NameIndex;
+
 typedef enum
 {
     TYPE_FUNCTION,
@@ -159,6 +242,30 @@ typedef enum
     TYPE_SCRIPT
 } FunctionType;
 
+/** 延迟编译（--lazy）：函数体只做预解析，首次调用时才编译 */
+bool lazyFunctions = false;
+
+/**
+ * 预解析的函数体，首次调用时由 compileLazyFunction 从参数列表开始重新编译
+ * 变量名指向源码副本，副本由 source 持有
+ */
+struct LazyBody
+{
+    ObjFileData *source;
+    /** 参数列表的 '(' 及其行号 */
+    const char *start;
+    int line;
+    FunctionType type;
+    /** 声明处是否在类中、该类是否有父类，决定 this 与 super 是否可用 */
+    bool inClass;
+    bool hasSuperclass;
+    /** 各上值对应的变量名，个数为 function->upvalueCount */
+    Token *names;
+};
+
+/** 正在编译的源码副本，非 NULL 时函数体只做预解析 */
+static ObjFileData *compilingSource = NULL;
+
 // 在这个实现中，编译器是针对函数的
 typedef struct Compiler
 {
@@ -168,13 +275,31 @@ typedef struct Compiler
     FunctionType type; // 区分是顶层函数还是普通函数，顶层函数使用全局变量分配在堆上
 
     /** 编译器追踪的局部变量信息，非运行时值，运行时只需根据堆栈效应即可 */
-    Local locals[UINT8_MAX + 1]; // TODO：增加最大局部变量槽数，需要改字节码
+    Local *locals;
+    int localCapacity;
     /** 局部变量数量，-1 得到顶部索引 */
     int localCount;
+    /** 按名字查找局部变量与上值，避免逐个比较 locals */
+    NameIndex names;
     /** 作用域深度 */
     int scopeDepth;
-    /** 上值数组 */
-    Upvalue upvalues[UINT8_MAX + 1];
+    /** 上值数组，个数为 function->upvalueCount */
+    Upvalue *upvalues;
+    int upvalueCapacity;
+    /** 编译预解析的函数体时没有上层编译器，上值按预解析记录的变量名解析 */
+    LazyBody *captured;
+
+    /** 最近生成的一串相接的常量指令，见 recordConstant */
+    ConstantRun constantRun;
+    /** 字节码末尾连续 OP_NOT 的结束位置与条数 */
+    int notEnd;
+    int notCount;
+    /** 字节码末尾结果必为数值的指令（算术、位运算）的结束位置，见 emitBinary */
+    int numericEnd;
+
+    ConstantIndex constantIndex;
+    /** 复用已有常量的次数，见 DEBUG_CONSTANT_BUDGET */
+    int reusedConstants;
 } Compiler;
 
 // 当前编译字节块
@@ -188,22 +313,131 @@ typedef struct ClassCompiler
 } ClassCompiler;
 ClassCompiler *currentClass = NULL;
 
-static void initCompiler(Compiler *compiler, FunctionType type)
+/** 编译器自用的数组（不在 GC 堆上），已满时扩容 */
+static void *reserveSlot(void *array, int *capacity, int count, size_t size)
+{
+    if (count < *capacity)
+        return array;
+    int newCapacity = GROW_CAPACITY(*capacity);
+    array = realloc(array, size * newCapacity);
+    if (array == NULL)
+        exit(1);
+    *capacity = newCapacity;
+    return array;
+}
+
+static inline bool identifiersEqual(Token *a, Token *b)
+{
+    return a->length == b->length ? memcmp(a->start, b->start, a->length) == 0 : false;
+}
+
+static void growNameIndex(NameIndex *index)
+{
+    int capacity = GROW_CAPACITY(index->capacity);
+    NameEntry *entries = (NameEntry *)calloc((size_t)capacity, sizeof(NameEntry));
+    if (entries == NULL)
+        exit(1);
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (int i = 0; i < index->capacity; i++)
+    {
+        NameEntry *entry = &index->entries[i];
+        if (entry->name.start == NULL)
+            continue;
+        uint32_t slot = entry->hash & mask;
+        while (entries[slot].name.start != NULL)
+            slot = (slot + 1) & mask;
+        entries[slot] = *entry;
+    }
+    free(index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+}
+
+/**
+ * 查找名字
+ * @param insert 未找到时新增一项（没有局部变量、上值尚未解析）
+ * @return 未找到且不新增时返回 NULL
+ */
+static NameEntry *findName(NameIndex *index, Token *name, bool insert)
+{
+    if (insert && (index->count + 1) * 4 > index->capacity * 3)
+        growNameIndex(index);
+    else if (index->capacity == 0)
+        return NULL;
+
+    uint32_t hash = hashString(name->start, name->length);
+    uint32_t mask = (uint32_t)index->capacity - 1;
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        NameEntry *entry = &index->entries[slot];
+        if (entry->name.start == NULL)
+        {
+            if (!insert)
+                return NULL;
+            entry->name = *name;
+            entry->hash = hash;
+            entry->local = -1;
+            entry->upvalue = UNRESOLVED;
+            index->count++;
+            return entry;
+        }
+        if (entry->hash == hash && identifiersEqual(&entry->name, name))
+            return entry;
+    }
+}
+
+/** 局部变量 index 入栈，成为同名变量中最内层的一个 */
+static void pushLocalName(Compiler *compiler, int index)
+{
+    Local *local = &compiler->locals[index];
+    NameEntry *entry = findName(&compiler->names, &local->name, true);
+    local->shadowed = entry->local;
+    entry->local = index;
+}
+
+/** 局部变量离开作用域，被它遮蔽的同名变量重新可见 */
+static void popLocalName(Compiler *compiler, int index)
+{
+    Local *local = &compiler->locals[index];
+    findName(&compiler->names, &local->name, false)->local = local->shadowed;
+}
+
+/**
+ * @param function 继续编译预解析过的函数，NULL 时新建函数
+ */
+static void initCompiler(Compiler *compiler, FunctionType type, ObjFunction *function)
 {
     compiler->enclosing = currentCompiler;
     compiler->function = NULL;
     compiler->type = type;
 
+    compiler->locals = NULL;
+    compiler->localCapacity = 0;
+    compiler->upvalues = NULL;
+    compiler->upvalueCapacity = 0;
+    compiler->captured = NULL;
     compiler->localCount = 0;
+    compiler->names.entries = NULL;
+    compiler->names.capacity = 0;
+    compiler->names.count = 0;
     compiler->scopeDepth = 0;
-
-    compiler->function = newFunction();
+    compiler->constantRun.count = 0;
+    compiler->notEnd = -1;
+    compiler->notCount = 0;
+    compiler->numericEnd = -1;
+    compiler->constantIndex.slots = NULL;
+    compiler->constantIndex.capacity = 0;
+    compiler->constantIndex.used = 0;
+    compiler->reusedConstants = 0;
+
+    compiler->function = function != NULL ? function : newFunction();
     currentCompiler = compiler;
 
-    if (type != TYPE_SCRIPT)
+    if (type != TYPE_SCRIPT && function == NULL)
         currentCompiler->function->name = copyString(parser.previous.start, parser.previous.length);
 
     // 隐式槽，this
+    compiler->locals = reserveSlot(compiler->locals, &compiler->localCapacity, 0, sizeof(Local));
     Local *local = &currentCompiler->locals[currentCompiler->localCount++];
     local->depth = 0;
     local->isCaptured = false;
@@ -217,6 +451,7 @@ static void initCompiler(Compiler *compiler, FunctionType type)
         local->name.start = "";
         local->name.length = 0;
     }
+    pushLocalName(compiler, 0);
 }
 
 // 错误处理函数（打印错误消息而已）
@@ -281,71 +516,580 @@ static ObjFunction *endCompiler()
     emitReturn(); // 隐式 return
     // 函数编译完后把这个函数返回，使之成为**运行时值**
     ObjFunction *function = currentCompiler->function;
+    if (!parser.hadError)
+        optimizeChunk(compilingChunk()); // 有错误时跳转可能尚未回填
 
 #ifdef DEBUG_PRINT_CODE
     // if (!parser.hadError)
     disassembleChunk(compilingChunk(), function->name != NULL ? function->name->chars : "<script>");
 #endif
 
+#ifdef DEBUG_CONSTANT_BUDGET
+    // 单字节索引可用的常量数为 UINT8_MAX + 1，超出部分的指令需要 OP_WIDE 前缀
+    int constantCount = compilingChunk()->constants.count;
+    fprintf(stderr, "[constants] %s: %d entries, %d reused, ",
+            function->name != NULL ? function->name->chars : "<script>", constantCount, currentCompiler->reusedConstants);
+    if (constantCount <= UINT8_MAX + 1)
+        fprintf(stderr, "%d single-byte slots left\n", UINT8_MAX + 1 - constantCount);
+    else
+        fprintf(stderr, "%d need OP_WIDE\n", constantCount - (UINT8_MAX + 1));
+#endif
+
     currentCompiler = currentCompiler->enclosing;
     return function;
 }
 
-/** emitJump MUST pair with patchJump to work */
+/** 释放编译器自用的数组，在生成闭包指令之后调用 */
+static void freeCompiler(Compiler *compiler)
+{
+    free(compiler->locals);
+    free(compiler->upvalues);
+    free(compiler->names.entries);
+    free(compiler->constantIndex.slots);
+}
+
+/** 3 字节操作数，大端 */
+static void emitWideOperand(int operand)
+{
+    emitByte((operand >> 16) & 0xff);
+    emitByte((operand >> 8) & 0xff);
+    emitByte(operand & 0xff);
+}
+
+/** 索引操作数，wide 时为 3 字节 */
+static void emitOperand(int operand, bool wide)
+{
+    if (wide)
+        emitWideOperand(operand);
+    else
+        emitByte((uint8_t)operand);
+}
+
+/** 带一个索引操作数的指令，索引超过 UINT8_MAX 时加 OP_WIDE 前缀 */
+static void emitIndexed(uint8_t instruction, int index)
+{
+    bool wide = index > UINT8_MAX;
+    if (wide)
+        emitByte(OP_WIDE);
+    emitByte(instruction);
+    emitOperand(index, wide);
+}
+
+/**
+ * emitJump MUST pair with patchJump to work
+ * 向前跳转的距离此时未知，一律生成 3 字节偏移，能用 2 字节时由 optimizeChunk 缩短
+ */
 static int emitJump(uint8_t instruction)
 {
+    emitByte(OP_WIDE);
     emitByte(instruction);
-    // 跳转地址占2字节，大端
-    emitByte(0xff); // <- return this offset
-    emitByte(0xff);
-    return compilingChunk()->count - 2;
+    // 跳转地址占3字节，大端
+    emitWideOperand(0xffffff); // <- return this offset
+    return compilingChunk()->count - 3;
+}
+
+/**
+ * 当前位置将成为跳转目标：此前生成的指令不再参与折叠，
+ * 否则回退字节码会使跳转落到错误的位置
+ */
+static void markJumpTarget()
+{
+    currentCompiler->constantRun.count = 0;
+    currentCompiler->notEnd = -1;
+    currentCompiler->numericEnd = -1;
 }
 
 static void patchJump(int offset)
 {
-    // -2 to adjust for the bytecode for the jump offset itself.
-    // offset 字节码占 2 字节
+    markJumpTarget();
+
+    // -3 to adjust for the bytecode for the jump offset itself.
+    // offset 字节码占 3 字节
     // jump 为向后跳转的指令（字节）数
-    int jump = compilingChunk()->count - offset - 2;
+    int jump = compilingChunk()->count - offset - 3;
 
-    if (jump > UINT16_MAX)
+    if (jump > WIDE_OPERAND_MAX)
         error("Too much code to jump over.");
 
     // big endian
-    compilingChunk()->code[offset] = (jump >> 8) & 0xff;
-    compilingChunk()->code[offset + 1] = jump & 0xff;
+    compilingChunk()->code[offset] = (jump >> 16) & 0xff;
+    compilingChunk()->code[offset + 1] = (jump >> 8) & 0xff;
+    compilingChunk()->code[offset + 2] = jump & 0xff;
 }
 
 static void emitLoop(int loopStart)
 {
-    emitByte(OP_LOOP);
-    // 往回跳转的字节数
-    int offset = compilingChunk()->count - loopStart + 2;
-    if (offset > UINT16_MAX)
+    // 往回跳转的字节数，距离已知，2 字节放不下时才加 OP_WIDE 前缀
+    int offset = compilingChunk()->count - loopStart + 3;
+    if (offset <= UINT16_MAX)
+    {
+        emitByte(OP_LOOP);
+        emitByte((offset >> 8) & 0xff);
+        emitByte(offset & 0xff);
+        return;
+    }
+
+    offset += 2;
+    if (offset > WIDE_OPERAND_MAX)
         error("Loop body too large.");
+    emitByte(OP_WIDE);
+    emitByte(OP_LOOP);
+    emitWideOperand(offset);
+}
 
-    emitByte((offset >> 8) & 0xff);
-    emitByte(offset & 0xff);
+/** 常量的位模式，作为常量索引的键 */
+static uint64_t constantBits(Value value)
+{
+#ifdef NAN_BOXING
+    return value;
+#else
+    if (IS_NUMBER(value))
+    {
+        uint64_t bits;
+        double number = AS_NUMBER(value);
+        memcpy(&bits, &number, sizeof(bits));
+        return bits;
+    }
+    if (IS_OBJ(value))
+        return (uint64_t)(uintptr_t)AS_OBJ(value);
+    return IS_BOOL(value) ? (AS_BOOL(value) ? 1 : 2) : 0;
+#endif
 }
 
-/** 将value加入常量数组，返回单字节，表示索引 */
-static uint8_t makeConstant(Value value)
+static inline bool isSameConstant(Value a, Value b)
 {
+#ifdef NAN_BOXING
+    return a == b;
+#else
+    return a.type == b.type && constantBits(a) == constantBits(b);
+#endif
+}
+
+/** 与 valuetable.c 相同的 64 位混合函数 */
+static inline uint32_t hashConstant(Value value)
+{
+    uint64_t bits = constantBits(value);
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+/** 以新容量重建常量索引，只收录池中现有的常量 */
+static void rebuildConstantIndex(ConstantIndex *index, ValueArray *constants, int capacity)
+{
+    free(index->slots);
+    index->slots = (int32_t *)malloc(sizeof(int32_t) * capacity);
+    if (index->slots == NULL)
+        exit(1);
+    memset(index->slots, 0xff, sizeof(int32_t) * capacity); // -1 表示空槽
+    index->capacity = capacity;
+    index->used = constants->count;
+
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (int i = 0; i < constants->count; i++)
+    {
+        uint32_t slot = hashConstant(constants->values[i]) & mask;
+        while (index->slots[slot] != -1)
+            slot = (slot + 1) & mask;
+        index->slots[slot] = i;
+    }
+}
+
+/** 将value加入常量数组，已有相同的常量时复用，返回其索引 */
+static int makeConstant(Value value)
+{
+    ConstantIndex *index = &currentCompiler->constantIndex;
+    ValueArray *constants = &compilingChunk()->constants;
+    if ((index->used + 1) * 2 > index->capacity)
+        rebuildConstantIndex(index, constants, index->capacity < 16 ? 16 : index->capacity * 2);
+
+    uint32_t mask = (uint32_t)index->capacity - 1;
+    uint32_t slot = hashConstant(value) & mask;
+    for (; index->slots[slot] != -1; slot = (slot + 1) & mask)
+    {
+        int32_t existing = index->slots[slot];
+        if (existing < constants->count && isSameConstant(constants->values[existing], value))
+        {
+            currentCompiler->reusedConstants++;
+            return existing;
+        }
+    }
+
     int constantIndex = addConstant(compilingChunk(), value);
-    if (constantIndex > UINT8_MAX)
-    { // OP_CONSTANT <single_byte>, so we can only store UINT8_MAX
+    index->slots[slot] = constantIndex;
+    index->used++;
+    if (constantIndex > WIDE_OPERAND_MAX)
+    { // OP_WIDE OP_CONSTANT <three_bytes>
         error("Too many constants in one chunk.");
-        // TODO：更大的常量池
         return 0;
     }
-    // 因为暂时只支持单字节索引
-    return (uint8_t)constantIndex;
+    return constantIndex;
+}
+
+/** 记录刚生成的常量指令 [start, 当前位置)，与此前的常量不相接时另起一串 */
+static void recordConstant(int start, int index, bool added, Value value)
+{
+    ConstantRun *run = &currentCompiler->constantRun;
+    if (run->count > 0 && run->records[run->count - 1].end != start)
+        run->count = 0;
+    if (run->count == CONSTANT_RUN_MAX)
+    {
+        memmove(run->records, run->records + 1, sizeof(ConstantRecord) * (CONSTANT_RUN_MAX - 1));
+        run->count--;
+    }
+
+    ConstantRecord *record = &run->records[run->count++];
+    record->start = start;
+    record->end = compilingChunk()->count;
+    record->index = index;
+    record->added = added;
+    record->value = value;
 }
 
 static void emitConstant(Value value)
 {
-    emitByte(OP_CONSTANT);
-    emitByte(makeConstant(value));
+    // 先入常量池（会将 value 作为 GC 根），再写指令，避免写指令时触发 GC 回收 value
+    int constantCount = compilingChunk()->constants.count;
+    int constant = makeConstant(value);
+    int start = compilingChunk()->count;
+    emitIndexed(OP_CONSTANT, constant);
+    recordConstant(start, constant, compilingChunk()->constants.count > constantCount, value);
+}
+
+/** nil、true、false 有专用指令，其余值放入常量池 */
+static void emitValue(Value value)
+{
+    int start = compilingChunk()->count;
+    if (IS_NIL(value))
+        emitByte(OP_NIL);
+    else if (IS_BOOL(value))
+        emitByte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    else
+    {
+        emitConstant(value);
+        return;
+    }
+    recordConstant(start, -1, false, value);
+}
+
+//
+// 常量折叠：运算符的操作数恰好是紧邻其前的常量指令时，回退这些指令，改为生成运算结果
+// 只折叠与运行时结果完全一致的情形，会产生运行时错误或依赖未定义行为的运算照常生成指令
+//
+
+/**
+ * 回退字节码到 start，丢弃其后的常量记录，末尾专属于它们的常量池条目一并移除
+ * 此前相接的常量记录保留，回退后重新位于末尾
+ */
+static void discardCode(int start)
+{
+    Compiler *compiler = currentCompiler;
+    ValueArray *constants = &compilingChunk()->constants;
+    ConstantRun *run = &compiler->constantRun;
+    while (run->count > 0 && run->records[run->count - 1].start >= start)
+    {
+        ConstantRecord *record = &run->records[--run->count];
+        if (record->index != -1 && record->added && record->index == constants->count - 1)
+            constants->count--; // 复用的常量可能仍被此前的指令引用，只移除这条指令新增的
+    }
+
+    truncateChunk(compilingChunk(), start);
+    if (compiler->notEnd > start)
+        compiler->notEnd = -1;
+    if (compiler->numericEnd > start)
+        compiler->numericEnd = -1;
+}
+
+/**
+ * 位于字节码末尾的一串常量中，自末尾数第 depth 条（0 为最后一条，即刚解析的操作数）
+ * @return 末尾不是常量指令或相接的常量不足 depth + 1 条时返回 NULL
+ */
+static inline ConstantRecord *trailingConstant(int depth)
+{
+    ConstantRun *run = &currentCompiler->constantRun;
+    if (depth >= run->count || run->records[run->count - 1].end != compilingChunk()->count)
+        return NULL;
+    return &run->records[run->count - 1 - depth];
+}
+
+/** 与 OP_REMAINDER 等位运算相同地转为 int32，超出范围时转换是未定义行为，不折叠 */
+static inline bool toInt32(Value value, int32_t *result)
+{
+    if (!IS_NUMBER(value))
+        return false;
+    double number = AS_NUMBER(value);
+    if (!(number > (double)INT32_MIN - 1 && number < (double)INT32_MAX + 1))
+        return false;
+    *result = (int32_t)number;
+    return true;
+}
+
+static inline bool toUint32(Value value, uint32_t *result)
+{
+    if (!IS_NUMBER(value))
+        return false;
+    double number = AS_NUMBER(value);
+    if (!(number > -1 && number < (double)UINT32_MAX + 1))
+        return false;
+    *result = (uint32_t)number;
+    return true;
+}
+
+/** 字符串与字符串、字符串与数字拼接，同 vm 的 concatenate */
+static Value foldConcatenate(Value a, Value b)
+{
+    char bufferA[FORMAT_BUFFER], bufferB[FORMAT_BUFFER];
+    int lengthA, lengthB;
+    const char *charsA = formatValue(a, bufferA, &lengthA);
+    const char *charsB = formatValue(b, bufferB, &lengthB);
+
+    int length = lengthA + lengthB;
+    if (length <= SMALL_STRING_MAX)
+    {
+        char chars[SMALL_STRING_BUFFER];
+        memcpy(chars, charsA, lengthA);
+        memcpy(chars + lengthA, charsB, lengthB);
+        return copyStringValue(chars, length);
+    }
+    ObjString *string = makeString(length); // 操作数仍在常量池中，触发 GC 也不会被回收
+    memcpy(string->chars, charsA, lengthA);
+    memcpy(string->chars + lengthA, charsB, lengthB);
+    return OBJ_VAL(internString(string));
+}
+
+/** @return 能在编译期求值时返回 true */
+static bool foldUnary(OpCode op, Value operand, Value *result)
+{
+    int32_t integer;
+    switch (op)
+    {
+    case OP_NOT:
+        *result = BOOL_VAL(isFalsey(operand));
+        return true;
+    case OP_NEGATE:
+        if (!IS_NUMBER(operand))
+            return false;
+        *result = NUMBER_VAL(-AS_NUMBER(operand));
+        return true;
+    case OP_BITWISE_NOT:
+        if (!toInt32(operand, &integer))
+            return false;
+        *result = NUMBER_VAL((double)~integer);
+        return true;
+    case OP_TYPEOF:
+    {
+        const char *type = typeofValue(operand);
+        *result = copyStringValue(type, (int)strlen(type));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static bool foldBinary(OpCode op, Value a, Value b, Value *result)
+{
+    if (op == OP_EQUAL)
+    {
+        *result = BOOL_VAL(isValuesEqual(a, b));
+        return true;
+    }
+    if (op == OP_ADD && ((IS_STRING(a) && (IS_STRING(b) || IS_NUMBER(b))) || (IS_NUMBER(a) && IS_STRING(b))))
+    {
+        *result = foldConcatenate(a, b);
+        return true;
+    }
+
+    if (!IS_NUMBER(a) || !IS_NUMBER(b))
+        return false;
+    double x = AS_NUMBER(a), y = AS_NUMBER(b);
+    switch (op)
+    {
+    case OP_ADD:
+        *result = NUMBER_VAL(x + y);
+        return true;
+    case OP_SUBTRACT:
+        *result = NUMBER_VAL(x - y);
+        return true;
+    case OP_MULTIPLY:
+        *result = NUMBER_VAL(x * y);
+        return true;
+    case OP_DIVIDE:
+        *result = NUMBER_VAL(x / y);
+        return true;
+    case OP_GREATER:
+        *result = BOOL_VAL(x > y);
+        return true;
+    case OP_LESS:
+        *result = BOOL_VAL(x < y);
+        return true;
+    default:
+        break;
+    }
+
+    // 位运算
+    if (op == OP_UNSIGNED_LEFT_SHIFT || op == OP_UNSIGNED_RIGHT_SHIFT)
+    {
+        uint32_t i, j;
+        if (!toUint32(a, &i) || !toUint32(b, &j) || j > 31)
+            return false;
+        *result = NUMBER_VAL((double)(op == OP_UNSIGNED_LEFT_SHIFT ? i << j : i >> j));
+        return true;
+    }
+
+    int32_t i, j;
+    if (!toInt32(a, &i) || !toInt32(b, &j))
+        return false;
+    switch (op)
+    {
+    case OP_REMAINDER:
+        if (j == 0 || (i == INT32_MIN && j == -1))
+            return false;
+        *result = NUMBER_VAL((double)(i % j));
+        return true;
+    case OP_BITWISE_XOR:
+        *result = NUMBER_VAL((double)(i ^ j));
+        return true;
+    case OP_BITWISE_AND:
+        *result = NUMBER_VAL((double)(i & j));
+        return true;
+    case OP_BITWISE_OR:
+        *result = NUMBER_VAL((double)(i | j));
+        return true;
+    case OP_LEFT_SHIFT:
+        if (j < 0 || j > 31 || i < 0 || i > (INT32_MAX >> j))
+            return false; // 负数或溢出的左移是未定义行为
+        *result = NUMBER_VAL((double)(i << j));
+        return true;
+    case OP_RIGHT_SHIFT:
+        if (j < 0 || j > 31)
+            return false;
+        *result = NUMBER_VAL((double)(i >> j));
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** 生成一元运算指令，操作数为常量时折叠，!!!x 化简为 !x */
+static void emitUnary(OpCode op)
+{
+    Compiler *compiler = currentCompiler;
+    ConstantRecord *operand = trailingConstant(0);
+    Value result;
+    if (operand != NULL && foldUnary(op, operand->value, &result))
+    {
+        discardCode(operand->start);
+        emitValue(result);
+        return;
+    }
+
+    if (op != OP_NOT)
+    {
+        emitByte(op);
+        compiler->numericEnd = compilingChunk()->count; // OP_NEGATE、OP_BITWISE_NOT 的结果必为数值
+        return;
+    }
+
+    int count = compilingChunk()->count;
+    if (compiler->notEnd == count && compiler->notCount >= 2)
+    { // ! 作用于布尔值，三次取反等于一次
+        discardCode(count - 1);
+        compiler->notEnd = count - 1;
+        compiler->notCount--;
+        return;
+    }
+    compiler->notCount = compiler->notEnd == count ? compiler->notCount + 1 : 1;
+    emitByte(OP_NOT);
+    compiler->notEnd = count + 1;
+}
+
+/** 运算成功时结果必为数值的二元运算 */
+static inline bool isNumericBinary(OpCode op)
+{
+    switch (op)
+    {
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_REMAINDER:
+    case OP_BITWISE_XOR:
+    case OP_BITWISE_AND:
+    case OP_BITWISE_OR:
+    case OP_LEFT_SHIFT:
+    case OP_RIGHT_SHIFT:
+    case OP_UNSIGNED_LEFT_SHIFT:
+    case OP_UNSIGNED_RIGHT_SHIFT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * 左操作数为数值时 x op right 恒等于 x
+ * x + 0 不算：-0 + 0 为 0
+ */
+static inline bool isIdentity(OpCode op, Value right)
+{
+    if (!IS_NUMBER(right))
+        return false;
+    double number = AS_NUMBER(right);
+    switch (op)
+    {
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+        return number == 1;
+    case OP_SUBTRACT:
+        return number == 0 && !signbit(number); // x - -0 在 x 为 -0 时得 0
+    default:
+        return false;
+    }
+}
+
+/**
+ * 生成二元运算指令，两个操作数均为常量时折叠
+ * 只有右操作数是常量时，仅当左操作数是紧邻其前的算术或位运算的结果（必为数值）才化简 x * 1、x / 1、x - 0；
+ * 其余情形另一个操作数的类型编译期未知，仍须在运行时检查
+ */
+static void emitBinary(OpCode op)
+{
+    Compiler *compiler = currentCompiler;
+    ConstantRecord *right = trailingConstant(0);
+    ConstantRecord *left = trailingConstant(1);
+    Value result;
+    if (left != NULL && foldBinary(op, left->value, right->value, &result))
+    {
+        discardCode(left->start);
+        emitValue(result);
+        return;
+    }
+    if (right != NULL && right->start == compiler->numericEnd && isIdentity(op, right->value))
+    {
+        discardCode(right->start); // 左操作数的指令重新位于末尾，numericEnd 不变
+        return;
+    }
+    emitByte(op);
+    if (isNumericBinary(op))
+        compiler->numericEnd = compilingChunk()->count;
+}
+
+/**
+ * 条件只关心真假，末尾的 !! 可以去掉
+ * 调用者保证随后生成的是条件跳转
+ */
+static void simplifyCondition()
+{
+    Compiler *compiler = currentCompiler;
+    int count = compilingChunk()->count;
+    if (compiler->notEnd == count && compiler->notCount >= 2)
+    {
+        discardCode(count - 2);
+        compiler->notEnd = -1;
+    }
 }
 
 /** 步进到下一个标记 */
@@ -399,28 +1143,27 @@ static inline bool match(TokenType type)
     return false;
 }
 
-static inline bool identifiersEqual(Token *a, Token *b)
-{
-    return a->length == b->length ? memcmp(a->start, b->start, a->length) == 0 : false;
-}
-
 /**
  * 局部变量，编译器实际上不需要变量名，只需要根据堆栈效应知道数量即可。
  * 不过当前实现为了比较变量名，仍保存变量名
  */
 static void addLocal(Token name)
 {
-    if (currentCompiler->localCount >= UINT8_MAX + 1) // exceed limit
+    Compiler *compiler = currentCompiler;
+    if (compiler->localCount >= LOCALS_MAX) // exceed limit
     {
         error("Too many local variables in function.");
-        // TODO
         return;
     }
 
-    Local *local = &currentCompiler->locals[currentCompiler->localCount++];
+    compiler->locals = reserveSlot(compiler->locals, &compiler->localCapacity, compiler->localCount, sizeof(Local));
+    Local *local = &compiler->locals[compiler->localCount++];
+    if (compiler->localCount > compiler->function->slotCount)
+        compiler->function->slotCount = compiler->localCount;
     local->name = name;
     local->isCaptured = false;
     local->depth = -1; //! 未初始化状态，防止循环引用 currentCompiler->scopeDepth;
+    pushLocalName(compiler, compiler->localCount - 1);
 
 #ifdef DEBUG_TRACE_EXECUTION
     fprintf(stderr, "[[DEBUG_TRACE_EXECUTION]]  addLocal:  index=%d  ", currentCompiler->localCount - 1);
@@ -432,7 +1175,7 @@ static void addLocal(Token name)
 /** 仅对当前作用域函数添加上值
  * @return 上值在函数的上值列表中的索引
  */
-static int addUpvalue(Compiler *compiler, uint8_t index, bool isLocal)
+static int addUpvalue(Compiler *compiler, int index, bool isLocal)
 {
     int upvalueCount = compiler->function->upvalueCount;
 
@@ -443,12 +1186,13 @@ static int addUpvalue(Compiler *compiler, uint8_t index, bool isLocal)
             return i;
     }
 
-    if (upvalueCount >= UINT8_MAX + 1)
+    if (upvalueCount >= UPVALUES_MAX)
     {
         error("Too many closure variables in function.");
         return 0;
     }
 
+    compiler->upvalues = reserveSlot(compiler->upvalues, &compiler->upvalueCapacity, upvalueCount, sizeof(Upvalue));
     compiler->upvalues[upvalueCount].isLocal = isLocal;
     compiler->upvalues[upvalueCount].index = index;
     return compiler->function->upvalueCount++;
@@ -466,39 +1210,54 @@ static int resolveLocal(Compiler *compiler, Token *name)
     fputc('\n', stderr);
 #endif
 
-    // TODO：local 是所有局部变量，即嵌套作用域的局部变量也存在一起，通过 Local.depth 区分
-    // 这样需要扫描整个数组，并且 identifiersEqual 比较Token字符串，需要优化
-    // 反向遍历：自内层向外层扫描
-    for (int i = compiler->localCount - 1; i >= 0; i--)
+    // 经名字表直接找到同名的最内层局部变量，再沿 shadowed 自内层向外层
+    NameEntry *entry = findName(&compiler->names, name, false);
+    for (int i = entry != NULL ? entry->local : -1; i != -1; i = compiler->locals[i].shadowed)
     {
-        Local *local = &compiler->locals[i];
-
-        if (identifiersEqual(name, &local->name))
-        {
-            if (local->depth == -1)
-                error("Can't read local variable in its own initializer.");
-            else
-                return i;
-        }
+        if (compiler->locals[i].depth != -1)
+            return i;
+        error("Can't read local variable in its own initializer.");
     }
 
     return -1;
 }
 
+/** 在预解析记录的变量名中查找，变量名与上值一一对应 */
+static int resolveCaptured(Compiler *compiler, Token *name)
+{
+    for (int i = 0; i < compiler->function->upvalueCount; i++)
+    {
+        if (identifiersEqual(name, &compiler->captured->names[i]))
+            return i;
+    }
+    return -1;
+}
+
+static int resolveEnclosing(Compiler *compiler, Token *name);
+
 /**
  * 参见 namedVariable 函数说明
  */
 static int resolveUpvalue(Compiler *compiler, Token *name)
 {
-    if (compiler->enclosing == NULL)
+    if (compiler->enclosing == NULL && compiler->captured == NULL)
         return -1;
 
+    NameEntry *entry = findName(&compiler->names, name, true); // 上层函数的查找不改动本函数的名字表
+    if (entry->upvalue == UNRESOLVED)
+        entry->upvalue = compiler->enclosing == NULL ? resolveCaptured(compiler, name) : resolveEnclosing(compiler, name);
+    return entry->upvalue;
+}
+
+/** 在上层函数中解析名字，是上层函数的局部变量或上值时为本函数添加上值 */
+static int resolveEnclosing(Compiler *compiler, Token *name)
+{
     int local = resolveLocal(compiler->enclosing, name); // 在上层函数中找
 
     if (local != -1)
     { // 若是上层函数的局部变量，则标记被捕获
         compiler->enclosing->locals[local].isCaptured = true;
-        return addUpvalue(compiler, (uint8_t)local, true);
+        return addUpvalue(compiler, local, true);
         // true 表示是上层函数的局部变量，不过这个信息保存在当前函数中
         // 注意：只有不是本函数的局部变量，才会解析上值，因此上值总是与上层函数相关
         // 对于解释器来说，由于闭包指令在函数指令的最后，因此解析闭包指令时
@@ -508,7 +1267,7 @@ static int resolveUpvalue(Compiler *compiler, Token *name)
     int upvalue = resolveUpvalue(compiler->enclosing, name);
     if (upvalue != -1)
     { // 为搜索上值的函数和每层中间函数都添加上值，达到穿透的效果
-        return addUpvalue(compiler, (uint8_t)upvalue, false);
+        return addUpvalue(compiler, upvalue, false);
     }
     return -1;
 }
@@ -527,7 +1286,7 @@ static void expression()
  * 将标识符加入常量池
  * @return 标识符在常量数组中的索引
  */
-static uint8_t identifierConstant(Token *name)
+static int identifierConstant(Token *name)
 {
     return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
 }
@@ -548,13 +1307,12 @@ static inline void declareVariable()
     fprintf(stderr, "\n");
 #endif
 
-    for (int i = currentCompiler->localCount - 1; i >= 0; i--)
+    // 同名的最内层局部变量在本作用域中即为重复声明，在上层作用域中则只是遮蔽
+    NameEntry *entry = findName(&currentCompiler->names, name, false);
+    if (entry != NULL && entry->local != -1)
     {
-        Local *local = &currentCompiler->locals[i];
-        if (local->depth != -1 && local->depth < currentCompiler->scopeDepth)
-            break; // 已经遍历到上层词法作用域，无需继续
-
-        if (identifiersEqual(name, &local->name))
+        Local *local = &currentCompiler->locals[entry->local];
+        if (local->depth == -1 || local->depth >= currentCompiler->scopeDepth)
             error("Already a variable with this name in this scope.");
     }
 
@@ -572,7 +1330,7 @@ static void markInitialized()
 /**
  * （声明之后）定义变量
  */
-static inline void defineVariable(uint8_t global)
+static inline void defineVariable(int global)
 {
 #ifdef DEBUG_TRACE_EXECUTION
     fprintf(stderr, "[[DEBUG_TRACE_EXECUTION]]  defineVariable:   index=%d", global);
@@ -586,13 +1344,12 @@ static inline void defineVariable(uint8_t global)
     }
     else
     { // 全局变量
-        emitByte(OP_DEFINE_GLOBAL);
-        emitByte(global);
+        emitIndexed(OP_DEFINE_GLOBAL, global);
     }
 }
 
 /** 实际上是解析解析变量名，不生成任何指令 */
-static uint8_t parseVariable(const char *expectMessage)
+static int parseVariable(const char *expectMessage)
 {
     consume(TOKEN_IDENTIFIER, expectMessage);
 
@@ -614,7 +1371,7 @@ varDecl ::= "var" IDENTIFIER [ "=" expression ] ";"
  */
 static void varDeclaration()
 {
-    uint8_t global = parseVariable("Expect variable name."); // 变量名
+    int global = parseVariable("Expect variable name."); // 变量名
 
     if (match(TOKEN_EQUAL))
         expression(); // 变量值
@@ -663,7 +1420,7 @@ static void endScope()
             emitByte(OP_POP);
         }
 
-        currentCompiler->localCount--;
+        popLocalName(currentCompiler, --currentCompiler->localCount);
     }
 }
 
@@ -700,13 +1457,11 @@ static void namedVariable(Token name, bool canAssign)
     if (canAssign && match(TOKEN_EQUAL))
     {
         expression();
-        emitByte(setOp);
-        emitByte((uint8_t)arg);
+        emitIndexed(setOp, arg);
     }
     else
     {
-        emitByte(getOp);
-        emitByte((uint8_t)arg);
+        emitIndexed(getOp, arg);
     }
 }
 
@@ -725,6 +1480,7 @@ static void ifStatement()
     // if(expression)
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
     expression();
+    simplifyCondition();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
     // statement
@@ -761,9 +1517,11 @@ static void ifStatement()
 static void whileStatement()
 {
     int loopStart = compilingChunk()->count;
+    markJumpTarget();
 
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
     expression();
+    simplifyCondition();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
     int exitJump = emitJump(OP_JUMP_IF_FALSE);
@@ -796,11 +1554,13 @@ static void forStatement()
     int surroundingLoopScopeDepth = innermostLoopScopeDepth;
     innermostLoopStart = compilingChunk()->count;
     innermostLoopScopeDepth = currentCompiler->scopeDepth;
+    markJumpTarget();
 
     int exitJump = -1;
     if (!match(TOKEN_SEMICOLON))
     {
         expression();
+        simplifyCondition();
         consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
         // Jump out of the loop if the condition is false.
@@ -812,6 +1572,7 @@ static void forStatement()
     {
         int bodyJump = emitJump(OP_JUMP);
         int incrementStart = compilingChunk()->count;
+        markJumpTarget();
         expression();
         emitByte(OP_POP);
         consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
@@ -859,11 +1620,10 @@ static void classDeclaration()
 {
     consume(TOKEN_IDENTIFIER, "Expect class name.");
     Token className = parser.previous;
-    uint8_t nameConstant = identifierConstant(&parser.previous);
+    int nameConstant = identifierConstant(&parser.previous);
     declareVariable();
 
-    emitByte(OP_CLASS);
-    emitByte(nameConstant); // 子类字节码
+    emitIndexed(OP_CLASS, nameConstant); // 子类字节码
     defineVariable(nameConstant);
 
     // 保持类编译器链栈
@@ -905,10 +1665,9 @@ static void classDeclaration()
     currentClass = currentClass->enclosing;
 }
 
-static void function(FunctionType type)
+/** 参数列表与函数体的 '{'，参数是函数最外层作用域的局部变量 */
+static void parameterList()
 {
-    Compiler compiler;
-    initCompiler(&compiler, type);
     beginScope();
 
     consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
@@ -920,21 +1679,120 @@ static void function(FunctionType type)
             if (count > 255)
                 errorAtCurrent("Can't have more than 255 parameters.");
 
-            uint8_t constant = parseVariable("Expect parameter name.");
+            int constant = parseVariable("Expect parameter name.");
             defineVariable(constant);
         } while (match(TOKEN_COMMA));
     }
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
     consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
-    block();
+}
 
-    // compiler 进入 函数体块编译并解释，当函数解释完后，整个调用帧被丢弃
-    // 无需 endScope()
+/** 预解析时捕获函数体中的一个名字：是外层的局部变量或上值时添加上值，并记下上值对应的变量名 */
+static void captureName(Compiler *compiler, Token *name, Token **names, int *capacity)
+{
+    if (resolveLocal(compiler, name) != -1)
+        return; // 参数或 this
 
-    ObjFunction *function = endCompiler();
+    int count = compiler->function->upvalueCount;
+    if (resolveUpvalue(compiler, name) == count && compiler->function->upvalueCount > count)
+    {
+        *names = reserveSlot(*names, capacity, count, sizeof(Token));
+        (*names)[count] = *name;
+    }
+}
+
+/**
+ * 预解析函数体：按花括号配对跳过，只记录参数列表的位置与函数体引用的外层变量，然后结束 compiler
+ * 与外层局部变量或上值同名的标识符一律捕获（函数体内声明的同名变量会使之多捕获一个上值，不影响语义），
+ * 属性名（'.' 之后）除外；函数体的语法错误推迟到首次调用时报告
+ */
+static void skipFunctionBody(Compiler *compiler, Token *parameters)
+{
+    Token *names = NULL;
+    int capacity = 0;
+    int depth = 1;
+    while (depth > 0)
+    {
+        if (check(TOKEN_EOF))
+        {
+            errorAtCurrent("Expect '}' after block.");
+            break;
+        }
+        bool property = parser.previous.type == TOKEN_DOT;
+        advance();
+        switch (parser.previous.type)
+        {
+        case TOKEN_LEFT_BRACE:
+            depth++;
+            break;
+        case TOKEN_RIGHT_BRACE:
+            depth--;
+            break;
+        case TOKEN_SUPER:
+        { // super.name 同时引用 this 与 super
+            Token name = syntheticToken("this");
+            captureName(compiler, &name, &names, &capacity);
+            captureName(compiler, &parser.previous, &names, &capacity);
+            break;
+        }
+        case TOKEN_THIS:
+        case TOKEN_IDENTIFIER:
+            if (!property)
+                captureName(compiler, &parser.previous, &names, &capacity);
+            break;
+#ifdef LOXJ_OPTIONS_ESCAPE
+        case TOKEN_STRING:
+        case TOKEN_TEMPLATE_PART:
+        case TOKEN_TEMPLATE:
+            free((char *)parser.previous.start); // 处理转义后的字面量由扫描器分配
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+
+    LazyBody *lazy = (LazyBody *)malloc(sizeof(LazyBody));
+    if (lazy == NULL)
+        exit(1);
+    lazy->source = compilingSource;
+    lazy->start = parameters->start;
+    lazy->line = parameters->line;
+    lazy->type = compiler->type;
+    lazy->inClass = currentClass != NULL;
+    lazy->hasSuperclass = currentClass != NULL && currentClass->hasSuperclass;
+    lazy->names = names;
+    compiler->function->lazy = lazy;
+    currentCompiler = compiler->enclosing;
+}
+
+static void function(FunctionType type)
+{
+    Compiler compiler;
+    initCompiler(&compiler, type, NULL);
+    Token parameters = parser.current;
+    parameterList();
+
+    ObjFunction *function = compiler.function;
+    if (compilingSource != NULL)
+        skipFunctionBody(&compiler, &parameters);
+    else
+    {
+        block();
+        // compiler 进入 函数体块编译并解释，当函数解释完后，整个调用帧被丢弃
+        // 无需 endScope()
+        endCompiler();
+    }
     // 函数编译完成的最后生成一系列闭包指令，令解释器正确处理上值
+    // 此时 function 已不在编译器链上，须先放入常量池使其可达
+    int constant = makeConstant(OBJ_VAL(function));
+    bool wide = constant > UINT8_MAX; // 前缀同时作用于常量与各上值的索引
+    for (int i = 0; i < function->upvalueCount; i++)
+        wide = wide || compiler.upvalues[i].index > UINT8_MAX;
+    if (wide)
+        emitByte(OP_WIDE);
     emitByte(OP_CLOSURE);
-    emitByte(makeConstant(OBJ_VAL(function)));
+    emitOperand(constant, wide);
 
     // 这里无需上值数量的字节码，因为单遍编译并同时解释字节码
     // 编译器针对函数/闭包编译，此信息已保存在编译器中
@@ -942,14 +1800,15 @@ static void function(FunctionType type)
     for (int i = 0; i < function->upvalueCount; i++)
     {
         emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
-        emitByte(compiler.upvalues[i].index);
+        emitOperand(compiler.upvalues[i].index, wide);
     }
+    freeCompiler(&compiler);
 }
 
 static void method()
 {
     consume(TOKEN_IDENTIFIER, "Expect method name.");
-    uint8_t constant = identifierConstant(&parser.previous);
+    int constant = identifierConstant(&parser.previous);
     FunctionType type = TYPE_METHOD;
     if (parser.previous.length == LOXJ_OPTIONS_INIT_LENGTH &&
         memcmp(parser.previous.start, LOXJ_OPTIONS_INIT, LOXJ_OPTIONS_INIT_LENGTH) == 0)
@@ -957,8 +1816,7 @@ static void method()
         type = TYPE_INITIALIZER;
     }
     function(type);
-    emitByte(OP_METHOD);
-    emitByte(constant);
+    emitIndexed(OP_METHOD, constant);
 }
 
 /**
@@ -968,7 +1826,7 @@ funDecl ::= "fun" function
  */
 static void funDeclaration()
 {
-    uint8_t global = parseVariable("Expect function name.");
+    int global = parseVariable("Expect function name.");
     markInitialized();
     function(TYPE_FUNCTION);
     defineVariable(global);
@@ -1071,7 +1929,7 @@ static void super_(bool canAssign)
 
     consume(TOKEN_DOT, "Expect '.' after 'super'.");
     consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
-    uint8_t name = identifierConstant(&parser.previous);
+    int name = identifierConstant(&parser.previous);
 
     namedVariable(syntheticToken("this"), false);
 
@@ -1079,15 +1937,13 @@ static void super_(bool canAssign)
     {
         uint8_t argCount = argumentList();
         namedVariable(syntheticToken("super"), false);
-        emitByte(OP_SUPER_INVOKE);
-        emitByte(name);
+        emitIndexed(OP_SUPER_INVOKE, name);
         emitByte(argCount);
     }
     else
     {
         namedVariable(syntheticToken("super"), false);
-        emitByte(OP_GET_SUPER);
-        emitByte(name);
+        emitIndexed(OP_GET_SUPER, name);
     }
 }
 
@@ -1104,13 +1960,13 @@ static void literal(bool canAssign)
     switch (parser.previous.type)
     {
     case TOKEN_FALSE:
-        emitByte(OP_FALSE);
+        emitValue(BOOL_VAL(false));
         break;
     case TOKEN_NIL:
-        emitByte(OP_NIL);
+        emitValue(NIL_VAL);
         break;
     case TOKEN_TRUE:
-        emitByte(OP_TRUE);
+        emitValue(BOOL_VAL(true));
         break;
     default:
         return; // Unreachable.
@@ -1122,15 +1978,70 @@ static void string(bool canAssign)
 {
 #ifdef LOXJ_OPTIONS_ESCAPE
     // 必须与 scanner 的 stringToken 保持一致
-    emitConstant(OBJ_VAL(takeStringFromToken((char *)parser.previous.start, parser.previous.length)));
+    emitConstant(takeStringFromToken((char *)parser.previous.start, parser.previous.length));
 #else
-    emitConstant(
-        OBJ_VAL(
-            // 去除开头结尾的引号
-            copyString(parser.previous.start + 1, parser.previous.length - 2)));
+    // 去除开头结尾的引号
+    emitConstant(copyStringValue(parser.previous.start + 1, parser.previous.length - 2));
 #endif
 }
 
+/** 模板字符串片段的文本值，片段词素不含定界符 */
+static Value templateText()
+{
+#ifdef LOXJ_OPTIONS_ESCAPE
+    return takeStringFromToken((char *)parser.previous.start, parser.previous.length);
+#else
+    return copyStringValue(parser.previous.start, parser.previous.length);
+#endif
+}
+
+/**
+ * 解析模板字符串
+ * 文本片段与插值表达式依次入栈，最后由一条 OP_BUILD_STRING 一次性拼接，不产生中间字符串
+```
+template ::= TEMPLATE | ( TEMPLATE_PART expression )+ TEMPLATE
+```
+ */
+static void templateString(bool canAssign)
+{
+    if (parser.previous.type == TOKEN_TEMPLATE)
+    { // 没有插值，等同普通字符串
+        emitConstant(templateText());
+        return;
+    }
+
+    int partCount = 0;
+    do
+    {
+        Value text = templateText();
+        if (parser.previous.length > 0)
+        { // 空白片段无需入栈
+            emitConstant(text);
+            partCount++;
+        }
+
+        expression();
+        partCount++;
+    } while (match(TOKEN_TEMPLATE_PART));
+
+    consume(TOKEN_TEMPLATE, "Expect '`' after template string.");
+    if (parser.previous.type == TOKEN_TEMPLATE)
+    {
+        Value text = templateText();
+        if (parser.previous.length > 0)
+        {
+            emitConstant(text);
+            partCount++;
+        }
+    }
+
+    if (partCount > UINT8_MAX)
+        error("Too many parts in template string.");
+
+    emitByte(OP_BUILD_STRING);
+    emitByte((uint8_t)partCount);
+}
+
 // 解析一个分组表达式
 static void grouping(bool canAssign)
 {
@@ -1150,16 +2061,16 @@ static void unary(bool canAssign)
     switch (operatorType)
     {
     case TOKEN_BANG:
-        emitByte(OP_NOT);
+        emitUnary(OP_NOT);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_NEGATE);
+        emitUnary(OP_NEGATE);
         break;
     case TOKEN_TYPEOF:
-        emitByte(OP_TYPEOF);
+        emitUnary(OP_TYPEOF);
         break;
     case TOKEN_BITWISE_NOT:
-        emitByte(OP_BITWISE_NOT);
+        emitUnary(OP_BITWISE_NOT);
         break;
     default:
         // 不可达
@@ -1180,61 +2091,61 @@ static void binary(bool canAssign)
     switch (operatorType)
     {
     case TOKEN_PLUS:
-        emitByte(OP_ADD);
+        emitBinary(OP_ADD);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_SUBTRACT);
+        emitBinary(OP_SUBTRACT);
         break;
     case TOKEN_STAR:
-        emitByte(OP_MULTIPLY);
+        emitBinary(OP_MULTIPLY);
         break;
     case TOKEN_SLASH:
-        emitByte(OP_DIVIDE);
+        emitBinary(OP_DIVIDE);
         break;
     case TOKEN_REMAINDER:
-        emitByte(OP_REMAINDER);
+        emitBinary(OP_REMAINDER);
         break;
     case TOKEN_BANG_EQUAL:
-        emitByte(OP_EQUAL);
-        emitByte(OP_NOT);
+        emitBinary(OP_EQUAL);
+        emitUnary(OP_NOT);
         break;
     case TOKEN_EQUAL_EQUAL:
-        emitByte(OP_EQUAL);
+        emitBinary(OP_EQUAL);
         break;
     case TOKEN_GREATER:
-        emitByte(OP_GREATER);
+        emitBinary(OP_GREATER);
         break;
     case TOKEN_GREATER_EQUAL:
-        emitByte(OP_LESS);
-        emitByte(OP_NOT);
+        emitBinary(OP_LESS);
+        emitUnary(OP_NOT);
         break;
     case TOKEN_LESS:
-        emitByte(OP_LESS);
+        emitBinary(OP_LESS);
         break;
     case TOKEN_LESS_EQUAL:
-        emitByte(OP_GREATER);
-        emitByte(OP_NOT);
+        emitBinary(OP_GREATER);
+        emitUnary(OP_NOT);
         break;
     case TOKEN_BITWISE_XOR:
-        emitByte(OP_BITWISE_XOR);
+        emitBinary(OP_BITWISE_XOR);
         break;
     case TOKEN_BITWISE_AND:
-        emitByte(OP_BITWISE_AND);
+        emitBinary(OP_BITWISE_AND);
         break;
     case TOKEN_BITWISE_OR:
-        emitByte(OP_BITWISE_OR);
+        emitBinary(OP_BITWISE_OR);
         break;
     case TOKEN_LEFT_SHIFT:
-        emitByte(OP_LEFT_SHIFT);
+        emitBinary(OP_LEFT_SHIFT);
         break;
     case TOKEN_RIGHT_SHIFT:
-        emitByte(OP_RIGHT_SHIFT);
+        emitBinary(OP_RIGHT_SHIFT);
         break;
     case TOKEN_UNSIGNED_LEFT_SHIFT:
-        emitByte(OP_UNSIGNED_LEFT_SHIFT);
+        emitBinary(OP_UNSIGNED_LEFT_SHIFT);
         break;
     case TOKEN_UNSIGNED_RIGHT_SHIFT:
-        emitByte(OP_UNSIGNED_RIGHT_SHIFT);
+        emitBinary(OP_UNSIGNED_RIGHT_SHIFT);
         break;
     default:
         // 不可达
@@ -1243,8 +2154,41 @@ static void binary(bool canAssign)
     }
 }
 
+/**
+ * 解析并丢弃一个操作数：常量左操作数使逻辑运算短路时，右操作数不会被求值
+ * 丢弃的代码只可能引用其后加入常量池的条目（表达式中没有函数字面量），一并移除
+ */
+static void skipOperand(Precedence precedence)
+{
+    Compiler *compiler = currentCompiler;
+    ConstantRun constantRun = compiler->constantRun;
+    int count = compilingChunk()->count;
+    int constantCount = compilingChunk()->constants.count;
+
+    parsePrecedence(precedence);
+
+    truncateChunk(compilingChunk(), count);
+    compilingChunk()->constants.count = constantCount;
+    compiler->constantRun = constantRun;
+    compiler->notEnd = -1;
+    compiler->numericEnd = -1;
+}
+
 static void and_(bool canAssign)
 {
+    ConstantRecord *left = trailingConstant(0);
+    if (left != NULL)
+    { // 常量为假时结果就是它，否则结果是右操作数
+        if (isFalsey(left->value))
+            skipOperand(PREC_LOGICAL_AND);
+        else
+        {
+            discardCode(left->start);
+            parsePrecedence(PREC_LOGICAL_AND);
+        }
+        return;
+    }
+
     int endJump = emitJump(OP_JUMP_IF_FALSE);
 
     emitByte(OP_POP);
@@ -1262,6 +2206,19 @@ next-statement
 
 static void or_(bool canAssign)
 {
+    ConstantRecord *left = trailingConstant(0);
+    if (left != NULL)
+    { // 常量为真时结果就是它，否则结果是右操作数
+        if (!isFalsey(left->value))
+            skipOperand(PREC_LOGICAL_OR);
+        else
+        {
+            discardCode(left->start);
+            parsePrecedence(PREC_LOGICAL_OR);
+        }
+        return;
+    }
+
     int elseJump = emitJump(OP_JUMP_IF_FALSE);
     int endJump = emitJump(OP_JUMP);
 
@@ -1309,25 +2266,66 @@ static void call(bool canAssign)
 static void dot(bool canAssign)
 {
     consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-    uint8_t name = identifierConstant(&parser.previous);
+    int name = identifierConstant(&parser.previous);
 
     if (canAssign && match(TOKEN_EQUAL))
     {
         expression();
-        emitByte(OP_SET_PROPERTY);
-        emitByte(name);
+        emitIndexed(OP_SET_PROPERTY, name);
     }
     else if (match(TOKEN_LEFT_PAREN))
     { // instance.method()
         uint8_t argCount = argumentList();
-        emitByte(OP_INVOKE);
-        emitByte(name);
+        emitIndexed(OP_INVOKE, name);
         emitByte(argCount);
     }
     else
     {
-        emitByte(OP_GET_PROPERTY);
-        emitByte(name);
+        emitIndexed(OP_GET_PROPERTY, name);
+    }
+}
+
+/**
+ * 数组字面量 [a, b, c]，允许尾随逗号
+ * 元素依次压栈，由 OP_ARRAY 一次收集
+ */
+static void array(bool canAssign)
+{
+    int count = 0;
+    if (!check(TOKEN_RIGHT_BRACKET))
+    {
+        do
+        {
+            if (check(TOKEN_RIGHT_BRACKET))
+                break; // 尾随逗号
+
+            expression();
+
+            if (count == 255)
+                error("Can't have more than 255 elements in an array literal.");
+
+            count++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after array elements.");
+    emitByte(OP_ARRAY);
+    emitByte((uint8_t)count);
+}
+
+/** 下标访问 target[index] 与下标赋值 target[index] = value */
+static void index_(bool canAssign)
+{
+    expression();
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+    if (canAssign && match(TOKEN_EQUAL))
+    {
+        expression();
+        emitByte(OP_SET_INDEX);
+    }
+    else
+    {
+        emitByte(OP_GET_INDEX);
     }
 }
 
@@ -1378,11 +2376,21 @@ program ::= { declaration } EOF
  */
 ObjFunction *compile(const char *sourceCode)
 {
+    if (lazyFunctions)
+    { // 预解析的函数体在首次调用时才编译，此时调用者可能已释放源码，因此编译副本
+        size_t length = strlen(sourceCode);
+        char *copy = (char *)malloc(length + 1);
+        if (copy == NULL)
+            exit(1);
+        memcpy(copy, sourceCode, length + 1);
+        compilingSource = newFileData(copy, length, false);
+        sourceCode = copy;
+    }
     initScanner(sourceCode); // 初始化扫描器
 
     // TODO: 下面的定义有生命期问题，最好要优化
     Compiler compiler;
-    initCompiler(&compiler, TYPE_SCRIPT);
+    initCompiler(&compiler, TYPE_SCRIPT, NULL);
 
     parser.hadError = false;
     parser.panicMode = false;
@@ -1395,9 +2403,65 @@ ObjFunction *compile(const char *sourceCode)
     }
 
     ObjFunction *function = endCompiler();
+    freeCompiler(&compiler);
+    compilingSource = NULL;
     return parser.hadError ? NULL : function; // NULL 表示编译错误
 }
 
+/**
+ * 编译预解析的函数体，在函数首次被调用时进行
+ * 从参数列表开始重新解析，函数内嵌套的函数同样只做预解析
+ * @return 函数体有语法错误时返回 false，错误已报告，函数仍未编译
+ */
+bool compileLazyFunction(ObjFunction *function)
+{
+    LazyBody *lazy = function->lazy;
+    initScannerAt(lazy->start, lazy->line);
+    parser.hadError = false;
+    parser.panicMode = false;
+    compilingSource = lazy->source;
+
+    ClassCompiler classCompiler;
+    classCompiler.enclosing = NULL;
+    classCompiler.hasSuperclass = lazy->hasSuperclass;
+    currentClass = lazy->inClass ? &classCompiler : NULL;
+
+    int arity = function->arity;
+    function->arity = 0; // 重新解析参数
+    Compiler compiler;
+    initCompiler(&compiler, lazy->type, function);
+    compiler.captured = lazy;
+
+    advance();
+    parameterList();
+    block();
+    endCompiler();
+    freeCompiler(&compiler);
+    currentClass = NULL;
+    compilingSource = NULL;
+
+    if (parser.hadError)
+    {
+        freeChunk(&function->chunk);
+        function->arity = arity;
+        return false;
+    }
+    function->lazy = NULL;
+    freeLazyBody(lazy);
+    return true;
+}
+
+void markLazyBody(LazyBody *lazy)
+{
+    markObject((Obj *)lazy->source);
+}
+
+void freeLazyBody(LazyBody *lazy)
+{
+    free(lazy->names);
+    free(lazy);
+}
+
 // 尝试消除恐慌模式。即跳过可能是级联错误的语素，尝试解析下一个错误（hasError 还是 true）
 static void synchronize()
 {
@@ -1429,6 +2493,7 @@ static void synchronize()
 
 void markCompilerRoots()
 {
+    markObject((Obj *)compilingSource);
     Compiler *compiler = currentCompiler;
     while (compiler != NULL)
     {
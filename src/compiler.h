@@ -4,7 +4,12 @@
 #include "chunk.h"
 #include "object.h"
 
+extern bool lazyFunctions;
+
 ObjFunction *compile(const char *sourceCode);
+bool compileLazyFunction(ObjFunction *function);
+void markLazyBody(LazyBody *lazy);
+void freeLazyBody(LazyBody *lazy);
 void markCompilerRoots();
 
 #endif
\ No newline at end of file
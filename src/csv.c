@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "csv.h"
+#include "array.h"
+#include "file.h"
+#include "memory.h"
+#include "object.h"
+#include "simd.h"
+#include "vm.h"
+
+// readCsv 按 64 字节整块定位分隔符：引号、分隔符与换行各得一张位图，
+// 引号位图的前缀异或给出位于引号内的位置（转义的 "" 翻转两次，自然抵消），
+// 引号外的分隔符与换行即字段边界，逐位取出
+
+typedef struct
+{
+    /** 整个文件的映射，字段视图的持有者 */
+    ObjFileData *file;
+    /** 每行复用的字段数组 */
+    ObjArray *row;
+    NativeCall call;
+    /** 含转义引号的字段解码到此处 */
+    char *scratch;
+    size_t scratchCapacity;
+    double rows;
+    /** 字段过长或内存不足 */
+    bool failed;
+} CsvReader;
+
+/** 与 json.c 相同的前缀异或 */
+static inline uint64_t prefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/**
+ * 字段 [start, end) 的值：去掉包围的引号，"" 还原为 "
+ * 不含转义的字段是引用映射的视图（或短字符串），不复制
+ */
+static bool fieldValue(CsvReader *reader, size_t start, size_t end, Value *value)
+{
+    const char *chars = reader->file->data + start;
+    size_t length = end - start;
+    if (length >= 2 && chars[0] == '"' && chars[length - 1] == '"')
+    {
+        chars++;
+        length -= 2;
+
+        const char *quote = memchr(chars, '"', length);
+        if (quote != NULL)
+        {
+            if (length > reader->scratchCapacity)
+            {
+                char *scratch = (char *)realloc(reader->scratch, length);
+                if (scratch == NULL)
+                    return false;
+                reader->scratch = scratch;
+                reader->scratchCapacity = length;
+            }
+
+            char *out = reader->scratch;
+            for (size_t i = 0; i < length; i++)
+            {
+                *out++ = chars[i];
+                if (chars[i] == '"' && i + 1 < length && chars[i + 1] == '"')
+                    i++;
+            }
+            *value = copyStringValue(reader->scratch, (int)(out - reader->scratch));
+            return true;
+        }
+    }
+
+    if (length > INT32_MAX)
+        return false;
+    if (length <= SMALL_STRING_MAX)
+        *value = copyStringValue(chars, (int)length);
+    else
+        *value = OBJ_VAL(newStringView((Obj *)reader->file, chars, (int)length));
+    return true;
+}
+
+static bool addField(CsvReader *reader, size_t start, size_t end)
+{
+    Value value;
+    if (!fieldValue(reader, start, end, &value))
+    {
+        reader->failed = true;
+        return false;
+    }
+    arrayPush(reader->row, value); // 行数组与映射均在 vm 栈上
+    return true;
+}
+
+/**
+ * 以 [start, end) 为最后一个字段结束当前行并调用回调，只有一个空字段的行（空行）跳过
+ * @return 回调返回 false 或出错时返回 false，运行时错误时置 *error
+ */
+static bool finishRow(CsvReader *reader, size_t start, size_t end, bool *error)
+{
+    if (end > start && reader->file->data[end - 1] == '\r')
+        end--;
+    if (reader->row->values.count == 0 && end == start)
+        return true;
+    if (!addField(reader, start, end))
+        return false;
+
+    reader->rows++;
+    Value result;
+    reader->call.args[0] = OBJ_VAL(reader->row);
+    if (!repeatCall(&reader->call, &result))
+    {
+        *error = true;
+        return false;
+    }
+    reader->row->values.count = 0;
+    return !(IS_BOOL(result) && !AS_BOOL(result));
+}
+
+/**
+ * readCsv(path, fn, delimiter)：逐行调用 fn(row)，row 是字段字符串的数组，delimiter 默认为 ","
+ * 字段可用双引号包围，其中的分隔符与换行属于字段，"" 表示一个引号。fn 返回 false 时停止
+ * row 在各次调用之间复用，需要保留时请复制其元素
+ * @return 处理的行数，无法打开文件或参数无效时返回 nil
+ */
+static Value readCsvNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+
+    char delimiter = ',';
+    if (argCount >= 3)
+    {
+        char buffer[SMALL_STRING_BUFFER];
+        int length = 0;
+        const char *chars = IS_STRING(args[2]) ? stringChars(args[2], buffer, &length) : NULL;
+        if (length != 1 || chars[0] == '"' || chars[0] == '\n')
+            return NIL_VAL;
+        delimiter = chars[0];
+    }
+
+    ObjFileData *file = loadFileData(args[0], false, true);
+    if (file == NULL)
+        return NIL_VAL;
+    ObjArray *row = newArray();
+    push(OBJ_VAL(row));
+
+    CsvReader reader = {file, row, {0}, NULL, 0, 0, false};
+    if (!beginCall(&reader.call, args[1], 1))
+        return NIL_VAL;
+    const char *data = file->data;
+    size_t size = file->length;
+    size_t fieldStart = 0;
+    uint64_t insideQuotes = 0; // 上一块结束时是否位于引号内，全 0 或全 1
+    bool error = false;
+    bool stopped = false;
+
+    for (size_t base = 0; base < size && !stopped; base += 64)
+    {
+        const char *block = data + base;
+        char tail[64];
+        if (size - base < 64)
+        { // 最后不足一块：复制到填充缓冲区，不越过映射末尾读取
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, size - base);
+            block = tail;
+        }
+
+        uint64_t quotes = simdMatchMask(block, '"');
+        uint64_t inside = prefixXor(quotes) ^ insideQuotes;
+        insideQuotes = (uint64_t)((int64_t)inside >> 63);
+
+        uint64_t newlines = simdMatchMask(block, '\n') & ~inside;
+        uint64_t separators = (simdMatchMask(block, delimiter) | newlines) & ~inside;
+        if (size - base < 64)
+            separators &= (1ULL << (size - base)) - 1;
+
+        while (separators != 0)
+        {
+            int bit = __builtin_ctzll(separators);
+            size_t position = base + (size_t)bit;
+            separators &= separators - 1;
+
+            bool ok = (newlines >> bit) & 1 ? finishRow(&reader, fieldStart, position, &error)
+                                            : addField(&reader, fieldStart, position);
+            if (!ok)
+            {
+                stopped = true;
+                break;
+            }
+            fieldStart = position + 1;
+        }
+    }
+
+    if (error)
+    { // 运行时错误已报告，栈已重置，返回值会被丢弃
+        free(reader.scratch);
+        return NIL_VAL;
+    }
+    if (!stopped && (fieldStart < size || row->values.count > 0))
+        finishRow(&reader, fieldStart, size, &error); // 最后一行没有换行符
+
+    free(reader.scratch);
+    if (error)
+        return NIL_VAL;
+    endCall(&reader.call);
+    pop(); // row
+    pop(); // file
+    return reader.failed ? NIL_VAL : NUMBER_VAL(reader.rows);
+}
+
+void loadCsvNatives()
+{
+    defineNative("readCsv", readCsvNative);
+}
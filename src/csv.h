@@ -0,0 +1,8 @@
+#ifndef loxj_csv_h
+#define loxj_csv_h
+
+#include "common.h"
+
+void loadCsvNatives();
+
+#endif
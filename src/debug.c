@@ -14,9 +14,14 @@ static int simpleInstruction(const char *name, int offset)
     printf("%s\n", name);
     return offset + 1;
 }
-static int constantInstruction(const char *name, Chunk *chunk, int offset)
+/** 索引操作数：单字节，OP_WIDE 前缀时为 3 字节 */
+static int readIndex(Chunk *chunk, int offset, bool wide)
 {
-    uint8_t constantIndex = chunk->code[offset + 1];
+    return wide ? readWideOperand(chunk, offset) : chunk->code[offset];
+}
+static int constantInstruction(const char *name, Chunk *chunk, int offset, bool wide)
+{
+    int constantIndex = readIndex(chunk, offset + 1, wide);
 
     printf("%-16s ", name);
     printf("constantIndex=%-4d ", constantIndex);
@@ -24,7 +29,7 @@ static int constantInstruction(const char *name, Chunk *chunk, int offset)
     printValue(chunk->constants.values[constantIndex]);
     putchar('\n');
     // OP_CONSTANT         0 '1.2'
-    return offset + 2;
+    return offset + (wide ? 4 : 2);
 }
 static int byteInstruction(const char *name, Chunk *chunk, int offset)
 {
@@ -34,21 +39,32 @@ static int byteInstruction(const char *name, Chunk *chunk, int offset)
     putchar('\n');
     return offset + 2;
 }
+/** 局部变量槽或上值索引 */
+static int slotInstruction(const char *name, Chunk *chunk, int offset, bool wide)
+{
+    printf("%-16s ", name);
+    printf("%d", readIndex(chunk, offset + 1, wide));
+    putchar('\n');
+    return offset + (wide ? 4 : 2);
+}
 /** @param sign forth or back */
-static int jumpInstruction(const char *name, int8_t sign, Chunk *chunk, int offset)
+static int jumpInstruction(const char *name, int8_t sign, Chunk *chunk, int offset, bool wide)
 {
-    uint16_t jump = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2]; // 大端
-    printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
-    return offset + 3;
+    int jump = wide ? readWideOperand(chunk, offset + 1)
+                    : (chunk->code[offset + 1] << 8) | chunk->code[offset + 2]; // 大端
+    int next = offset + (wide ? 4 : 3);
+    printf("%-16s %4d -> %d\n", name, offset, next + sign * jump);
+    return next;
 }
-static int invokeInstruction(const char *name, Chunk *chunk, int offset)
+static int invokeInstruction(const char *name, Chunk *chunk, int offset, bool wide)
 {
-    uint8_t constant = chunk->code[offset + 1];
-    uint8_t argCount = chunk->code[offset + 2];
+    int constant = readIndex(chunk, offset + 1, wide);
+    int next = offset + (wide ? 4 : 2);
+    uint8_t argCount = chunk->code[next];
     printf("%-16s constantIndex=%d ", name, constant);
     printValue(chunk->constants.values[constant]);
     printf("(%d args)\n", argCount);
-    return offset + 3;
+    return next + 1;
 }
 
 //
@@ -80,20 +96,28 @@ int disassembleInstruction(Chunk *chunk, int offset)
     printf("%04d  ", offset);
 
     // 打印行号
-    if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
+    int line = getLine(chunk, offset);
+    if (offset > 0 && line == getLine(chunk, offset - 1))
     { // 表示当前指令的源码位置和上一行处于同一行
         printf("   | ");
     }
     else
     { // 当前行
-        printf("%4d ", chunk->lines[offset]);
+        printf("%4d ", line);
+    }
+
+    bool wide = chunk->code[offset] == OP_WIDE;
+    if (wide)
+    { // 前缀与其后的指令一并打印，偏移指向操作码
+        printf("OP_WIDE ");
+        offset++;
     }
 
     uint8_t instruction = chunk->code[offset];
     switch (instruction)
     {
     case OP_CONSTANT:
-        return constantInstruction("OP_CONSTANT", chunk, offset);
+        return constantInstruction("OP_CONSTANT", chunk, offset, wide);
     case OP_NIL:
         return simpleInstruction("OP_NIL", offset);
     case OP_TRUE:
@@ -102,26 +126,28 @@ int disassembleInstruction(Chunk *chunk, int offset)
         return simpleInstruction("OP_FALSE", offset);
     case OP_POP:
         return simpleInstruction("OP_POP", offset);
+    case OP_POPN:
+        return byteInstruction("OP_POPN", chunk, offset);
     case OP_GET_PROPERTY:
-        return constantInstruction("OP_GET_PROPERTY", chunk, offset);
+        return constantInstruction("OP_GET_PROPERTY", chunk, offset, wide);
     case OP_SET_PROPERTY:
-        return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+        return constantInstruction("OP_SET_PROPERTY", chunk, offset, wide);
     case OP_EQUAL:
         return simpleInstruction("OP_EQUAL", offset);
     case OP_GET_GLOBAL:
-        return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+        return constantInstruction("OP_GET_GLOBAL", chunk, offset, wide);
     case OP_DEFINE_GLOBAL:
-        return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset, wide);
     case OP_SET_GLOBAL:
-        return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+        return constantInstruction("OP_SET_GLOBAL", chunk, offset, wide);
     case OP_GET_UPVALUE:
-        return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+        return slotInstruction("OP_GET_UPVALUE", chunk, offset, wide);
     case OP_SET_UPVALUE:
-        return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+        return slotInstruction("OP_SET_UPVALUE", chunk, offset, wide);
     case OP_GET_LOCAL:
-        return byteInstruction("OP_GET_LOCAL", chunk, offset);
+        return slotInstruction("OP_GET_LOCAL", chunk, offset, wide);
     case OP_SET_LOCAL:
-        return byteInstruction("OP_SET_LOCAL", chunk, offset);
+        return slotInstruction("OP_SET_LOCAL", chunk, offset, wide);
     case OP_GREATER:
         return simpleInstruction("OP_GREATER", offset);
     case OP_LESS:
@@ -156,20 +182,31 @@ int disassembleInstruction(Chunk *chunk, int offset)
         return simpleInstruction("OP_UNSIGNED_RIGHT_SHIFT", offset);
     case OP_NEGATE:
         return simpleInstruction("OP_NEGATE", offset);
+    case OP_BUILD_STRING:
+        return byteInstruction("OP_BUILD_STRING", chunk, offset);
+    case OP_ARRAY:
+        return byteInstruction("OP_ARRAY", chunk, offset);
+    case OP_GET_INDEX:
+        return simpleInstruction("OP_GET_INDEX", offset);
+    case OP_SET_INDEX:
+        return simpleInstruction("OP_SET_INDEX", offset);
     case OP_PRINT:
         return simpleInstruction("OP_PRINT", offset);
     case OP_JUMP:
-        return jumpInstruction("OP_JUMP", 1, chunk, offset);
+        return jumpInstruction("OP_JUMP", 1, chunk, offset, wide);
     case OP_JUMP_IF_FALSE:
-        return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset, wide);
+    case OP_POP_JUMP_IF_FALSE:
+        return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, chunk, offset, wide);
     case OP_LOOP:
-        return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        return jumpInstruction("OP_LOOP", -1, chunk, offset, wide);
     case OP_CALL:
         return byteInstruction("OP_CALL", chunk, offset);
     case OP_CLOSURE:
     {
         offset++;
-        uint8_t constant = chunk->code[offset++];
+        int constant = readIndex(chunk, offset, wide);
+        offset += wide ? 3 : 1;
         printf("%-16s %4d ", "OP_CLOSURE", constant);
         printValue(chunk->constants.values[constant]);
         printf("\n");
@@ -177,9 +214,11 @@ int disassembleInstruction(Chunk *chunk, int offset)
         ObjFunction *function = AS_FUNCTION(chunk->constants.values[constant]);
         for (int j = 0; j < function->upvalueCount; j++)
         {
+            int start = offset;
             int isLocal = chunk->code[offset++];
-            int index = chunk->code[offset++];
-            printf("%04d      |                     %s %d\n", offset - 2, isLocal ? "local" : "upvalue", index);
+            int index = readIndex(chunk, offset, wide);
+            offset += wide ? 3 : 1;
+            printf("%04d      |                     %s %d\n", start, isLocal ? "local" : "upvalue", index);
         }
         return offset;
     }
@@ -188,17 +227,17 @@ int disassembleInstruction(Chunk *chunk, int offset)
     case OP_RETURN:
         return simpleInstruction("OP_RETURN", offset);
     case OP_CLASS:
-        return constantInstruction("OP_CLASS", chunk, offset);
+        return constantInstruction("OP_CLASS", chunk, offset, wide);
     case OP_METHOD:
-        return constantInstruction("OP_METHOD", chunk, offset);
+        return constantInstruction("OP_METHOD", chunk, offset, wide);
     case OP_INVOKE:
-        return invokeInstruction("OP_INVOKE", chunk, offset);
+        return invokeInstruction("OP_INVOKE", chunk, offset, wide);
     case OP_INHERIT:
         return simpleInstruction("OP_INHERIT", offset);
     case OP_GET_SUPER:
-        return constantInstruction("OP_GET_SUPER", chunk, offset);
+        return constantInstruction("OP_GET_SUPER", chunk, offset, wide);
     case OP_SUPER_INVOKE:
-        return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
+        return invokeInstruction("OP_SUPER_INVOKE", chunk, offset, wide);
     case OP_TYPEOF:
         return simpleInstruction("OP_TYPEOF", offset);
     default:
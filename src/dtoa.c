@@ -0,0 +1,555 @@
+#include <float.h>
+#include <string.h>
+
+#include "dtoa.h"
+
+// Grisu3（Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers"）
+// 以 64 位整数运算生成能精确回读的最短且最接近的十进制数字，不依赖 printf 与区域设置
+// Grisu3 能判断自己的结果是否可靠，不可靠时改用大整数的精确算法
+
+/** 无符号 64 位尾数 f 与二进制指数 e，表示 f * 2^e */
+typedef struct
+{
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_EXPONENT_BIAS (0x3FF + 52)
+
+/** 10^k 的 64 位规格化近似，k = -348 + 8i */
+static const uint64_t cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL};
+
+static const int16_t cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066};
+
+static const uint64_t powersOf10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL};
+
+static inline DiyFp makeDiyFp(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biased = (int)((bits & DP_EXPONENT_MASK) >> 52);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    DiyFp fp;
+    if (biased != 0)
+    {
+        fp.f = significand + DP_HIDDEN_BIT;
+        fp.e = biased - DP_EXPONENT_BIAS;
+    }
+    else
+    { // 非规格化数
+        fp.f = significand;
+        fp.e = 1 - DP_EXPONENT_BIAS;
+    }
+    return fp;
+}
+
+/** 128 位乘积的高 64 位（四舍五入） */
+static inline DiyFp multiply(DiyFp x, DiyFp y)
+{
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask;
+    uint64_t c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+
+    DiyFp product = {ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+    return product;
+}
+
+static inline DiyFp normalize(DiyFp fp)
+{
+    int shift = __builtin_clzll(fp.f);
+    fp.f <<= shift;
+    fp.e -= shift;
+    return fp;
+}
+
+/** value 与相邻两个 double 的中点，即能回读为 value 的区间边界，两者指数相同 */
+static void boundaries(DiyFp v, DiyFp *minus, DiyFp *plus)
+{
+    DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+    upper = normalize(upper);
+
+    DiyFp lower;
+    if (v.f == DP_HIDDEN_BIT && v.e != 1 - DP_EXPONENT_BIAS)
+    { // 2 的整数次幂，下方间隔只有上方的一半（最小的规格化数除外，下方的非规格化数间隔相同）
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
+    }
+    else
+    {
+        lower.f = (v.f << 1) - 1;
+        lower.e = v.e - 1;
+    }
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus = upper;
+}
+
+/**
+ * 选取 10^-k，使乘积的二进制指数落在 [-60, -32] 内
+ * @param k 输出所选的十进制指数
+ */
+static DiyFp cachedPower(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // log10(2)
+    int ik = (int)dk;
+    if (dk - ik > 0.0)
+        ik++;
+
+    int index = (ik >> 3) + 1;
+    *k = -(-348 + index * 8);
+    DiyFp power = {cachedPowersF[index], cachedPowersE[index]};
+    return power;
+}
+
+static inline int countDigits(uint32_t n)
+{
+    int digits = 1;
+    while (digits < 10 && n >= powersOf10[digits])
+        digits++;
+    return digits;
+}
+
+/**
+ * 在不越出安全区间的前提下，让末位数字更接近真实值
+ * 乘法误差使 w 的真实位置只能确定在 [distance - unit, distance + unit] 内，两端都能确定最接近的数字时才可靠
+ * @param distance 区间上界到 w 的距离
+ * @param delta 不安全区间（两端各放宽 unit）的宽度
+ * @return false 表示无法保证结果最短且最接近，须改用精确算法
+ */
+static bool roundWeed(char *digits, int length, uint64_t distance, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t unit)
+{
+    uint64_t smallDistance = distance - unit;
+    uint64_t bigDistance = distance + unit;
+    while (rest < smallDistance && delta - rest >= tenKappa &&
+           (rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance))
+    {
+        digits[length - 1]--;
+        rest += tenKappa;
+    }
+
+    // 按 w 的另一端还能再减小末位，说明两端结论不一致
+    if (rest < bigDistance && delta - rest >= tenKappa &&
+        (rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance))
+        return false;
+
+    // 结果须落在安全区间（不安全区间两端各收窄 2 unit）内
+    return 2 * unit <= rest && rest <= delta - 4 * unit;
+}
+
+/**
+ * 逐位生成 high 的数字，直到剩余部分落在不安全区间 [low, high] 内
+ * @param k 输入时为缩放的十进制指数，输出时加上省去的位数
+ * @return 数字个数，无法保证结果时返回 0
+ */
+static int generateDigits(DiyFp low, DiyFp w, DiyFp high, char *digits, int *k)
+{
+    uint64_t unit = 1;
+    DiyFp one = {1ULL << -w.e, w.e};
+    uint64_t delta = high.f - low.f;
+    uint64_t distance = high.f - w.f;
+    uint32_t integral = (uint32_t)(high.f >> -one.e);
+    uint64_t fraction = high.f & (one.f - 1);
+    int kappa = countDigits(integral);
+    int length = 0;
+
+    while (kappa > 0)
+    {
+        uint32_t digit = integral / (uint32_t)powersOf10[kappa - 1];
+        integral %= (uint32_t)powersOf10[kappa - 1];
+        if (digit != 0 || length != 0)
+            digits[length++] = (char)('0' + digit);
+        kappa--;
+
+        uint64_t rest = ((uint64_t)integral << -one.e) + fraction;
+        if (rest < delta)
+        {
+            *k += kappa;
+            return roundWeed(digits, length, distance, delta, rest, powersOf10[kappa] << -one.e, unit) ? length : 0;
+        }
+    }
+
+    for (;;)
+    {
+        fraction *= 10;
+        unit *= 10;
+        delta *= 10;
+        char digit = (char)(fraction >> -one.e);
+        if (digit != 0 || length != 0)
+            digits[length++] = (char)('0' + digit);
+        fraction &= one.f - 1;
+        kappa--;
+
+        if (fraction < delta)
+        {
+            *k += kappa;
+            return roundWeed(digits, length, distance * unit, delta, fraction, one.f, unit) ? length : 0;
+        }
+    }
+}
+
+/**
+ * Grisu3：有限正数的十进制数字，value = digits * 10^k
+ * 约 0.5% 的输入无法确认结果最短且最接近，此时返回 0
+ * @return 数字个数，至多 17
+ */
+static int grisu3(double value, char *digits, int *k)
+{
+    DiyFp v = makeDiyFp(value);
+    DiyFp minus, plus;
+    boundaries(v, &minus, &plus);
+
+    DiyFp power = cachedPower(plus.e, k);
+    DiyFp w = multiply(normalize(v), power);
+    DiyFp high = multiply(plus, power);
+    DiyFp low = multiply(minus, power);
+    low.f--; // 乘法各有 1 ulp 误差，放宽为不安全区间，由 roundWeed 判断结果是否可靠
+    high.f++;
+    return generateDigits(low, w, high, digits, k);
+}
+
+//
+// 精确算法（Burger & Dybvig, "Printing Floating-Point Numbers Quickly and Accurately"）
+// 以大整数表示 value 与区间边界，Grisu3 无法确认结果时使用
+//
+
+/** 大整数的 32 位字数，足以容纳最小非规格化数放大后的 2^1131 */
+#define BIGNUM_WORDS 40
+
+/** 小端序的无符号大整数 */
+typedef struct
+{
+    uint32_t words[BIGNUM_WORDS];
+    int length;
+} Bignum;
+
+static void bignumSet(Bignum *n, uint64_t value)
+{
+    n->words[0] = (uint32_t)value;
+    n->words[1] = (uint32_t)(value >> 32);
+    n->length = n->words[1] != 0 ? 2 : n->words[0] != 0 ? 1 : 0;
+}
+
+static void bignumMultiply(Bignum *n, uint32_t factor)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < n->length; i++)
+    {
+        uint64_t product = (uint64_t)n->words[i] * factor + carry;
+        n->words[i] = (uint32_t)product;
+        carry = product >> 32;
+    }
+    if (carry != 0)
+        n->words[n->length++] = (uint32_t)carry;
+}
+
+static void bignumMultiplyPower10(Bignum *n, int exponent)
+{
+    for (; exponent >= 9; exponent -= 9)
+        bignumMultiply(n, 1000000000u);
+    if (exponent > 0)
+        bignumMultiply(n, (uint32_t)powersOf10[exponent]);
+}
+
+static void bignumShiftLeft(Bignum *n, int shift)
+{
+    if (n->length == 0)
+        return;
+    int words = shift / 32;
+    int bits = shift % 32;
+    n->words[n->length + words] = 0;
+    for (int i = n->length - 1; i >= 0; i--)
+    {
+        n->words[i + words + 1] |= bits != 0 ? n->words[i] >> (32 - bits) : 0;
+        n->words[i + words] = n->words[i] << bits;
+    }
+    for (int i = 0; i < words; i++)
+        n->words[i] = 0;
+    n->length += words + 1;
+    while (n->length > 0 && n->words[n->length - 1] == 0)
+        n->length--;
+}
+
+static int bignumCompare(const Bignum *a, const Bignum *b)
+{
+    if (a->length != b->length)
+        return a->length < b->length ? -1 : 1;
+    for (int i = a->length - 1; i >= 0; i--)
+        if (a->words[i] != b->words[i])
+            return a->words[i] < b->words[i] ? -1 : 1;
+    return 0;
+}
+
+/** a + b 与 c 比较 */
+static int bignumPlusCompare(const Bignum *a, const Bignum *b, const Bignum *c)
+{
+    Bignum sum;
+    uint64_t carry = 0;
+    int length = a->length > b->length ? a->length : b->length;
+    for (int i = 0; i < length; i++)
+    {
+        carry += (uint64_t)(i < a->length ? a->words[i] : 0) + (i < b->length ? b->words[i] : 0);
+        sum.words[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum.length = length;
+    if (carry != 0)
+        sum.words[sum.length++] = (uint32_t)carry;
+    return bignumCompare(&sum, c);
+}
+
+/** a -= b，要求 a >= b */
+static void bignumSubtract(Bignum *a, const Bignum *b)
+{
+    int64_t borrow = 0;
+    for (int i = 0; i < a->length; i++)
+    {
+        borrow += (int64_t)a->words[i] - (i < b->length ? b->words[i] : 0);
+        a->words[i] = (uint32_t)borrow;
+        borrow = borrow < 0 ? -1 : 0;
+    }
+    while (a->length > 0 && a->words[a->length - 1] == 0)
+        a->length--;
+}
+
+/**
+ * 同 grisu3，但总能得到最短且最接近的结果
+ * 尾数为偶数时，区间边界按就近舍入到偶数回读为 value，可以取到
+ */
+static int exactShortest(double value, char *digits, int *k)
+{
+    DiyFp v = makeDiyFp(value);
+    bool even = (v.f & 1) == 0;
+    bool closerLower = v.f == DP_HIDDEN_BIT && v.e != 1 - DP_EXPONENT_BIAS;
+
+    // value = r / s，上下边界分别为 (r + plus) / s 与 (r - minus) / s
+    Bignum r, s, plus, minus;
+    bignumSet(&r, v.f);
+    bignumSet(&s, 1);
+    bignumSet(&minus, 1);
+    int shift = closerLower ? 2 : 1;
+    bignumShiftLeft(&r, shift);
+    bignumShiftLeft(&s, shift);
+    if (v.e >= 0)
+    {
+        bignumShiftLeft(&r, v.e);
+        bignumShiftLeft(&minus, v.e);
+    }
+    else
+    {
+        bignumShiftLeft(&s, -v.e);
+    }
+    plus = minus;
+    if (closerLower)
+        bignumShiftLeft(&plus, 1);
+
+    // 十进制指数的估计值 ceil(log10(value))，至多偏小 1
+    int bits = 64 - __builtin_clzll(v.f);
+    double estimate = (v.e + bits - 1) * 0.30102999566398114 - 1e-10;
+    int exponent = (int)estimate;
+    if (estimate > exponent)
+        exponent++;
+    if (exponent >= 0)
+    {
+        bignumMultiplyPower10(&s, exponent);
+    }
+    else
+    {
+        bignumMultiplyPower10(&r, -exponent);
+        bignumMultiplyPower10(&plus, -exponent);
+        bignumMultiplyPower10(&minus, -exponent);
+    }
+    int compare = bignumPlusCompare(&r, &plus, &s);
+    if (even ? compare >= 0 : compare > 0)
+    {
+        bignumMultiply(&s, 10);
+        exponent++;
+    }
+
+    int length = 0;
+    for (;;)
+    {
+        bignumMultiply(&r, 10);
+        bignumMultiply(&plus, 10);
+        bignumMultiply(&minus, 10);
+        int digit = 0;
+        while (bignumCompare(&r, &s) >= 0)
+        {
+            bignumSubtract(&r, &s);
+            digit++;
+        }
+
+        compare = bignumCompare(&r, &minus);
+        bool low = even ? compare <= 0 : compare < 0;
+        compare = bignumPlusCompare(&r, &plus, &s);
+        bool high = even ? compare >= 0 : compare > 0;
+        if (!low && !high)
+        {
+            digits[length++] = (char)('0' + digit);
+            continue;
+        }
+
+        if (low && high)
+        { // 两个候选都能回读，取更接近的一个，正好居中时取偶数
+            compare = bignumPlusCompare(&r, &r, &s);
+            high = compare > 0 || (compare == 0 && digit % 2 != 0);
+        }
+        digits[length++] = (char)('0' + digit + (high ? 1 : 0));
+        break;
+    }
+    *k = exponent - length;
+    return length;
+}
+
+/**
+ * 有限正数的十进制数字，value = digits * 10^k
+ * @return 数字个数，至多 17
+ */
+static int shortestDigits(double value, char *digits, int *k)
+{
+    int length = grisu3(value, digits, k);
+    return length != 0 ? length : exactShortest(value, digits, k);
+}
+
+static int writeInteger(uint64_t n, char *buffer)
+{
+    char reversed[20];
+    int length = 0;
+    do
+    {
+        reversed[length++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+
+    for (int i = 0; i < length; i++)
+        buffer[i] = reversed[length - 1 - i];
+    return length;
+}
+
+/**
+ * 按 JavaScript Number.prototype.toString 的规则排版：
+ * 小数点位置 point 在 (-6, 21] 内时使用定点表示，否则使用 d.ddde±n
+ */
+static int layout(const char *digits, int length, int point, char *buffer)
+{
+    char *out = buffer;
+    if (length <= point && point <= 21)
+    { // 整数：补零
+        memcpy(out, digits, length);
+        memset(out + length, '0', point - length);
+        return point;
+    }
+    if (0 < point && point <= 21)
+    { // 小数点位于数字中间
+        memcpy(out, digits, point);
+        out[point] = '.';
+        memcpy(out + point + 1, digits + point, length - point);
+        return length + 1;
+    }
+    if (-6 < point && point <= 0)
+    { // 0.000ddd
+        out[0] = '0';
+        out[1] = '.';
+        memset(out + 2, '0', -point);
+        memcpy(out + 2 - point, digits, length);
+        return 2 - point + length;
+    }
+
+    *out++ = digits[0];
+    if (length > 1)
+    {
+        *out++ = '.';
+        memcpy(out, digits + 1, length - 1);
+        out += length - 1;
+    }
+    *out++ = 'e';
+    int exponent = point - 1;
+    *out++ = exponent < 0 ? '-' : '+';
+    out += writeInteger((uint64_t)(exponent < 0 ? -exponent : exponent), out);
+    return (int)(out - buffer);
+}
+
+int formatDouble(double value, char *buffer)
+{
+    if (value != value)
+    {
+        memcpy(buffer, "NaN", 3);
+        return 3;
+    }
+
+    char *out = buffer;
+    if (value < 0)
+    {
+        *out++ = '-';
+        value = -value;
+    }
+
+    if (value > DBL_MAX)
+    {
+        memcpy(out, "Infinity", 8);
+        return (int)(out - buffer) + 8;
+    }
+    if (value == 0)
+    { // -0 同样输出 0
+        buffer[0] = '0';
+        return 1;
+    }
+
+    // 快速路径：2^53 以内的整数，无需生成数字
+    if (value < 9007199254740992.0 && value == (double)(uint64_t)value)
+        return (int)(out - buffer) + writeInteger((uint64_t)value, out);
+
+    char digits[18];
+    int k;
+    int length = shortestDigits(value, digits, &k);
+    return (int)(out - buffer) + layout(digits, length, length + k, out);
+}
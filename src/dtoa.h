@@ -0,0 +1,17 @@
+#ifndef loxj_dtoa_h
+#define loxj_dtoa_h
+
+#include "common.h"
+
+/** formatDouble 输出的最大长度，如 -1.2345678901234567e-308 */
+#define DTOA_BUFFER 26
+
+/**
+ * 将 double 格式化为能精确回读的最短十进制文本（Grisu3，不可靠时改用精确算法），排版同 JavaScript
+ * 不写入结尾的 '\0'
+ * @param buffer 至少 DTOA_BUFFER 字节
+ * @return 写入的长度
+ */
+int formatDouble(double value, char *buffer);
+
+#endif
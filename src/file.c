@@ -0,0 +1,358 @@
+#define _POSIX_C_SOURCE 200809L // mmap, fstat, posix_madvise
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+#if defined(_WIN32) || defined(__wasi__)
+#define LOXJ_NO_MMAP // 退化为读入 malloc 的缓冲区，接口与语义不变
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** 路径参数的最大长度 */
+#define PATH_BUFFER 4096
+/** readLines 每次映射的窗口大小，遇到更长的行时加倍 */
+#define LINE_WINDOW (16 * 1024 * 1024)
+
+//
+// 平台层：按偏移与长度取得文件内容，映射或读入
+//
+
+typedef struct
+{
+#ifdef LOXJ_NO_MMAP
+    FILE *file;
+#else
+    int fd;
+#endif
+    uint64_t size;
+} InputFile;
+
+static bool openInput(const char *path, InputFile *input)
+{
+#ifdef LOXJ_NO_MMAP
+    input->file = fopen(path, "rb");
+    if (input->file == NULL)
+        return false;
+    if (fseek(input->file, 0L, SEEK_END) != 0)
+    {
+        fclose(input->file);
+        return false;
+    }
+    long size = ftell(input->file);
+    if (size < 0)
+    {
+        fclose(input->file);
+        return false;
+    }
+    input->size = (uint64_t)size;
+#else
+    input->fd = open(path, O_RDONLY);
+    if (input->fd < 0)
+        return false;
+    struct stat status;
+    if (fstat(input->fd, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        close(input->fd);
+        return false;
+    }
+    input->size = (uint64_t)status.st_size;
+#endif
+    return true;
+}
+
+static void closeInput(InputFile *input)
+{
+#ifdef LOXJ_NO_MMAP
+    fclose(input->file);
+#else
+    close(input->fd); // 已建立的映射不受影响
+#endif
+}
+
+/** 映射偏移须为页大小的整数倍 */
+static uint64_t pageSize()
+{
+#ifdef LOXJ_NO_MMAP
+    return 4096;
+#else
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (uint64_t)size : 4096;
+#endif
+}
+
+/**
+ * 取得 [offset, offset + length) 的内容，length 为 0 时返回空缓冲区
+ * @param writable 写入只影响本进程的副本（写时复制），不会写回文件
+ * @param sequential 提示内核将顺序读取，便于预读并尽早回收已读过的页
+ * @return 失败返回 NULL
+ */
+static char *loadRange(InputFile *input, uint64_t offset, size_t length, bool writable, bool sequential, bool *mapped)
+{
+#ifdef LOXJ_NO_MMAP
+    *mapped = false;
+    char *data = (char *)malloc(length > 0 ? length : 1);
+    if (data == NULL)
+        return NULL;
+    if (fseek(input->file, (long)offset, SEEK_SET) != 0 || fread(data, 1, length, input->file) != length)
+    {
+        free(data);
+        return NULL;
+    }
+    return data;
+#else
+    if (length == 0)
+    { // 不能映射 0 字节
+        *mapped = false;
+        return (char *)malloc(1);
+    }
+
+    *mapped = true;
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *data = mmap(NULL, length, protection, MAP_PRIVATE, input->fd, (off_t)offset);
+    if (data == MAP_FAILED)
+        return NULL;
+    if (sequential)
+        posix_madvise(data, length, POSIX_MADV_SEQUENTIAL);
+    return (char *)data;
+#endif
+}
+
+/** 回收 ObjFileData 时由 freeObject 调用 */
+void releaseFileData(ObjFileData *file)
+{
+#ifndef LOXJ_NO_MMAP
+    if (file->mapped)
+    {
+        munmap(file->data, file->length);
+        return;
+    }
+#endif
+    free(file->data);
+}
+
+/**
+ * 复制路径参数为 NUL 结尾的字符串（视图的字符不以 NUL 结尾）
+ * @return 不是字符串或过长时返回 false
+ */
+static bool readPath(Value value, char path[PATH_BUFFER])
+{
+    if (!IS_STRING(value))
+        return false;
+
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(value, buffer, &length);
+    if (length >= PATH_BUFFER)
+        return false;
+    memcpy(path, chars, length);
+    path[length] = '\0';
+    return true;
+}
+
+/**
+ * 整个文件作为一个 ObjFileData，结果已压入 vm 栈
+ * @param sequential 提示内核将顺序读取
+ * @return 失败返回 NULL，栈不变
+ */
+ObjFileData *loadPathData(const char *path, bool writable, bool sequential)
+{
+    InputFile input;
+    if (!openInput(path, &input))
+        return NULL;
+
+    ObjFileData *file = NULL;
+    bool mapped;
+    char *data = input.size <= SIZE_MAX ? loadRange(&input, 0, (size_t)input.size, writable, sequential, &mapped) : NULL;
+    if (data != NULL)
+    {
+        file = newFileData(data, (size_t)input.size, mapped);
+        push(OBJ_VAL(file));
+    }
+    closeInput(&input);
+    return file;
+}
+
+/** 同 loadPathData，路径为 Lox 字符串 */
+ObjFileData *loadFileData(Value pathValue, bool writable, bool sequential)
+{
+    char path[PATH_BUFFER];
+    if (!readPath(pathValue, path))
+        return NULL;
+    return loadPathData(path, writable, sequential);
+}
+
+//
+// natives
+//
+
+/**
+ * readFile(path)：文件内容作为字符串，长串是直接引用映射的视图，不复制
+ * 失败或超过 2GB 时返回 nil
+ */
+static Value readFileNative(int argCount, Value *args)
+{
+    if (argCount < 1)
+        return NIL_VAL;
+
+    ObjFileData *file = loadFileData(args[0], false, false);
+    if (file == NULL)
+        return NIL_VAL;
+    if (file->length > INT32_MAX)
+    {
+        pop(); // 映射由 GC 解除
+        return NIL_VAL;
+    }
+
+    int length = (int)file->length;
+    Value string = length <= SMALL_STRING_MAX ? copyStringValue(file->data, length)
+                                              : OBJ_VAL(newStringView((Obj *)file, file->data, length));
+    pop();
+    return string;
+}
+
+/**
+ * readBytes(path)：文件内容作为 Uint8Array，元素直接引用写时复制的映射
+ * 修改数组不会写回文件。失败或超过 2GB 时返回 nil
+ */
+static Value readBytesNative(int argCount, Value *args)
+{
+    if (argCount < 1)
+        return NIL_VAL;
+
+    ObjFileData *file = loadFileData(args[0], true, false);
+    if (file == NULL)
+        return NIL_VAL;
+    if (file->length > INT32_MAX)
+    {
+        pop();
+        return NIL_VAL;
+    }
+
+    Value array = OBJ_VAL(wrapTypedArray((Obj *)file, TYPED_UINT8, file->data, (int)file->length));
+    pop();
+    return array;
+}
+
+/**
+ * 把一行交给回调
+ * @return 回调返回 false 时返回 false，发生运行时错误时置 *error
+ */
+static bool emitLine(NativeCall *call, ObjFileData *window, size_t start, size_t length, bool *error)
+{
+    const char *chars = window->data + start;
+    if (length > 0 && chars[length - 1] == '\r')
+        length--;
+
+    // 视图的分配可能触发 GC，此时参数槽中的旧值无需保留
+    call->args[0] = length <= SMALL_STRING_MAX ? copyStringValue(chars, (int)length)
+                                               : OBJ_VAL(newStringView((Obj *)window, chars, (int)length));
+    Value result;
+    if (!repeatCall(call, &result))
+    {
+        *error = true;
+        return false;
+    }
+    return !(IS_BOOL(result) && !AS_BOOL(result));
+}
+
+/**
+ * readLines(path, fn)：逐行调用 fn(line)，行不含换行符（\n 或 \r\n），fn 返回 false 时停止
+ * 文件按窗口依次映射，行是引用窗口的视图，不为每行复制或分配缓冲区；
+ * 不再被引用的窗口由 GC 解除映射，因此可以处理大于内存的文件
+ * @return 处理的行数，无法打开文件或单行超过 2GB 时返回 nil
+ */
+static Value readLinesNative(int argCount, Value *args)
+{
+    char path[PATH_BUFFER];
+    InputFile input;
+    if (argCount < 2 || !readPath(args[0], path) || !openInput(path, &input))
+        return NIL_VAL;
+
+    uint64_t page = pageSize();
+    size_t windowSize = LINE_WINDOW;
+    uint64_t lineStart = 0; // 下一行在文件中的偏移
+    double lines = 0;
+    bool failed = false; // 读取失败或行过长
+    bool stopped = false;
+
+    while (lineStart < input.size && !stopped)
+    {
+        uint64_t base = lineStart - lineStart % page;
+        size_t length = input.size - base < windowSize ? (size_t)(input.size - base) : windowSize;
+        bool last = base + length == input.size;
+
+        bool mapped;
+        char *data = loadRange(&input, base, length, false, true, &mapped);
+        if (data == NULL)
+        {
+            failed = true;
+            break;
+        }
+        ObjFileData *window = newFileData(data, length, mapped);
+        push(OBJ_VAL(window));
+        NativeCall call;
+        if (!beginCall(&call, args[1], 1))
+        {
+            closeInput(&input);
+            return NIL_VAL;
+        }
+
+        size_t position = (size_t)(lineStart - base);
+        size_t consumed = position;
+        while (position < length)
+        {
+            const char *newline = memchr(data + position, '\n', length - position);
+            size_t end = newline != NULL ? (size_t)(newline - data) : length;
+            if (newline == NULL && !last)
+                break; // 行在下一个窗口中结束
+            if (end - position > INT32_MAX)
+            {
+                failed = true;
+                break;
+            }
+
+            lines++;
+            bool error = false;
+            if (!emitLine(&call, window, position, end - position, &error))
+            {
+                if (error)
+                { // 运行时错误已报告，栈已重置，返回值会被丢弃
+                    closeInput(&input);
+                    return NIL_VAL;
+                }
+                stopped = true;
+                break;
+            }
+            position = end + 1;
+            consumed = position < length ? position : length;
+        }
+        endCall(&call);
+        pop(); // window
+        if (failed)
+            break;
+
+        if (consumed == (size_t)(lineStart - base) && !last && !stopped)
+            windowSize *= 2; // 窗口内没有完整的行
+        lineStart = base + consumed;
+    }
+
+    closeInput(&input);
+    return failed ? NIL_VAL : NUMBER_VAL(lines);
+}
+
+void loadFileNatives()
+{
+    defineNative("readFile", readFileNative);
+    defineNative("readBytes", readBytesNative);
+    defineNative("readLines", readLinesNative);
+}
@@ -0,0 +1,13 @@
+#ifndef loxj_file_h
+#define loxj_file_h
+
+#include "common.h"
+#include "object.h"
+
+void releaseFileData(ObjFileData *file);
+ObjFileData *loadPathData(const char *path, bool writable, bool sequential);
+ObjFileData *loadFileData(Value pathValue, bool writable, bool sequential);
+
+void loadFileNatives();
+
+#endif
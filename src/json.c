@@ -0,0 +1,845 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "array.h"
+#include "memory.h"
+#include "object.h"
+#include "simd.h"
+#include "typedarray.h"
+#include "vm.h"
+
+/** 嵌套层数上限 */
+#define JSON_MAX_DEPTH 256
+/** 解析时每层至多占用的 vm 栈槽位：对象本身、键与值（数组为数组本身与 arrayPush 压栈的元素） */
+#define JSON_LEVEL_SLOTS 3
+/** 输入副本末尾的填充，使第一阶段总能按 64 字节整块读取 */
+#define JSON_PADDING 64
+
+//
+// 第一阶段：结构索引（simdjson 的做法）
+// 每 64 字节得到引号、反斜杠、结构字符与空白的位图，用位运算排除被转义的引号与字符串内部，
+// 再补上标量（数字、true/false/null）的起始位置，最终得到所有记号起点的有序下标
+//
+
+/** 前缀异或：第 i 位为输入第 0..i 位的异或，即该位置是否位于一对引号之间 */
+static inline uint64_t prefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/**
+ * 被奇数个连续反斜杠转义的字符
+ * @param carry 上一块是否以奇数个反斜杠结尾，输出本块的结果
+ */
+static inline uint64_t escapedChars(uint64_t backslashes, uint64_t *carry)
+{
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    const uint64_t oddBits = ~evenBits;
+
+    uint64_t starts = backslashes & ~(backslashes << 1);
+    uint64_t evenStartMask = evenBits ^ *carry;
+    uint64_t evenStarts = starts & evenStartMask;
+    uint64_t oddStarts = starts & ~evenStartMask;
+
+    uint64_t evenCarries = backslashes + evenStarts;
+    uint64_t oddCarries = backslashes + oddStarts;
+    bool overflow = oddCarries < backslashes;
+    oddCarries |= *carry;
+    *carry = overflow ? 1 : 0;
+
+    uint64_t evenCarryEnds = evenCarries & ~backslashes;
+    uint64_t oddCarryEnds = oddCarries & ~backslashes;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+/**
+ * 生成结构索引：结构字符、字符串的起始引号与标量的首字符
+ * @param index 至少 length + 1 项
+ * @return 索引项数，字符串未闭合返回 -1
+ */
+static int buildIndex(const char *json, int length, uint32_t *index)
+{
+    uint64_t escapeCarry = 0;
+    uint64_t insideString = 0;       // 上一块结束时是否位于字符串内，全 0 或全 1
+    uint64_t precedingStructural = 1; // 输入开头视为前面是结构字符
+    int count = 0;
+
+    for (int base = 0; base < length; base += 64)
+    {
+        uint64_t masks[4];
+        simdClassifyJson(json + base, masks);
+        uint64_t whitespace = masks[3];
+        if (length - base < 64)
+            whitespace |= ~0ULL << (length - base); // 填充部分视为空白
+
+        uint64_t quotes = masks[0] & ~escapedChars(masks[1], &escapeCarry);
+        uint64_t stringMask = prefixXor(quotes) ^ insideString; // 含起始引号，不含结束引号
+        insideString = (uint64_t)((int64_t)stringMask >> 63);
+
+        uint64_t structurals = (masks[2] & ~stringMask) | quotes;
+        uint64_t predecessors = structurals | whitespace;
+        uint64_t scalars = ((predecessors << 1) | precedingStructural) & ~whitespace & ~stringMask;
+        precedingStructural = predecessors >> 63;
+        structurals = (structurals | scalars) & ~(quotes & ~stringMask);
+
+        while (structurals != 0)
+        {
+            index[count++] = (uint32_t)(base + __builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    return insideString != 0 ? -1 : count;
+}
+
+//
+// 第二阶段：按索引递归下降构造值
+// 构造中的容器、键与值都压在 vm 栈上，分配触发 GC 也不会被回收
+//
+
+typedef struct
+{
+    const char *json;
+    int length;
+    const uint32_t *index;
+    int count;
+    int next;
+    int depth;
+    /** 含转义的字符串解码到此处 */
+    char *scratch;
+    size_t scratchCapacity;
+    /** 解析失败的位置（字节偏移）与原因，默认为最近读取的记号 */
+    int errorAt;
+    const char *error;
+} JsonParser;
+
+/** 下一个记号的位置，耗尽时返回 length（该处为 '\0'，不匹配任何记号） */
+static inline int nextToken(JsonParser *parser)
+{
+    parser->errorAt = parser->next < parser->count ? (int)parser->index[parser->next++] : parser->length;
+    return parser->errorAt;
+}
+
+/** 失败位置在记号内部时记下确切位置 */
+static inline bool failAt(JsonParser *parser, const char *p)
+{
+    parser->errorAt = (int)(p - parser->json);
+    return false;
+}
+
+static inline char peekToken(JsonParser *parser)
+{
+    return parser->next < parser->count ? parser->json[parser->index[parser->next]] : '\0';
+}
+
+/** 标量之后必须紧接空白、结构字符或输入结尾 */
+static inline bool isScalarEnd(char c)
+{
+    switch (c)
+    {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+    case ':':
+    case '}':
+    case ']':
+    case '[':
+    case '{':
+    case '"':
+    case '\0':
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/** 10 的非负整数次幂，double 可精确表示到 10^22 */
+static const double exactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * 按 JSON 语法读取数字
+ * 尾数不超过 2^53 且十进制指数在 ±22 以内时一次乘除即可精确得到结果，否则交给 strtod
+ */
+static bool parseNumber(JsonParser *parser, int start, Value *value)
+{
+    const char *p = parser->json + start;
+    bool negative = *p == '-';
+    if (negative)
+        p++;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    if (*p == '0')
+    {
+        p++;
+    }
+    else if (isDigit(*p))
+    {
+        for (; isDigit(*p); p++, digits++)
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    }
+    else
+    {
+        return false;
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        if (!isDigit(*p))
+            return false;
+        for (; isDigit(*p); p++, digits++, exponent--)
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    }
+
+    if (*p == 'e' || *p == 'E')
+    {
+        p++;
+        bool negativeExponent = *p == '-';
+        if (*p == '-' || *p == '+')
+            p++;
+        if (!isDigit(*p))
+            return false;
+        int explicitExponent = 0;
+        for (; isDigit(*p); p++)
+        {
+            if (explicitExponent < 100000)
+                explicitExponent = explicitExponent * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+
+    if (!isScalarEnd(*p))
+        return false;
+
+    double number;
+    if (digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        number = (double)mantissa;
+        number = exponent < 0 ? number / exactPowers[-exponent] : number * exactPowers[exponent];
+        if (negative)
+            number = -number;
+    }
+    else
+    {
+        number = strtod(parser->json + start, NULL); // 语法已校验，strtod 恰好读到数字结尾
+    }
+
+    *value = NUMBER_VAL(number);
+    return true;
+}
+
+static bool parseLiteral(JsonParser *parser, int start, const char *literal, int length, Value value, Value *out)
+{
+    if (memcmp(parser->json + start, literal, length) != 0 || !isScalarEnd(parser->json[start + length]))
+        return false;
+    *out = value;
+    return true;
+}
+
+static inline int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool readHex4(const char *p, uint32_t *code)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int digit = hexDigit(p[i]);
+        if (digit < 0)
+            return false;
+        result = (result << 4) | (uint32_t)digit;
+    }
+    *code = result;
+    return true;
+}
+
+static int writeUtf8(uint32_t code, char *out)
+{
+    if (code < 0x80)
+    {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+/** 需要特殊处理的字符串字节：引号、反斜杠与控制字符 */
+static bool stringStops[256];
+
+/**
+ * 读取 start 处引号开始的字符串
+ * 没有转义时直接从输入构造；含转义时解码到 scratch，解码结果不会长于原文
+ * 键与值都经 copyStringValue：短字符串不分配，其余先在 vm.strings 中查找已驻留的字符串
+ */
+static bool parseString(JsonParser *parser, int start, Value *value)
+{
+    const char *begin = parser->json + start + 1;
+    const char *p = begin;
+    while (!stringStops[(uint8_t)*p])
+        p++;
+    if (*p == '"')
+    {
+        *value = copyStringValue(begin, (int)(p - begin));
+        return true;
+    }
+
+    size_t needed = (size_t)(parser->length - start);
+    if (needed > parser->scratchCapacity)
+    {
+        char *scratch = (char *)realloc(parser->scratch, needed);
+        if (scratch == NULL)
+            return false;
+        parser->scratch = scratch;
+        parser->scratchCapacity = needed;
+    }
+
+    char *out = parser->scratch;
+    memcpy(out, begin, p - begin);
+    out += p - begin;
+    for (;;)
+    {
+        char c = *p++;
+        if (c == '"')
+            break;
+        if ((uint8_t)c < 0x20)
+            return failAt(parser, p - 1); // 控制字符必须转义，'\0' 亦即输入结尾
+        if (c != '\\')
+        {
+            *out++ = c;
+            continue;
+        }
+
+        const char *escape = p - 1;
+        switch (*p++)
+        {
+        case '"':
+            *out++ = '"';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        case '/':
+            *out++ = '/';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u':
+        {
+            uint32_t code;
+            if (!readHex4(p, &code))
+                return failAt(parser, escape);
+            p += 4;
+            if (code >= 0xD800 && code <= 0xDBFF)
+            { // 代理对
+                uint32_t low;
+                if (p[0] != '\\' || p[1] != 'u' || !readHex4(p + 2, &low) || low < 0xDC00 || low > 0xDFFF)
+                    return failAt(parser, escape); // 缺少低位代理
+                p += 6;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (code >= 0xDC00 && code <= 0xDFFF)
+            {
+                return failAt(parser, escape);
+            }
+            out += writeUtf8(code, out); // \uXXXX 6 字节至多解码为 3 字节，代理对 12 字节解码为 4 字节
+            break;
+        }
+        default:
+            return failAt(parser, escape);
+        }
+    }
+
+    *value = copyStringValue(parser->scratch, (int)(out - parser->scratch));
+    return true;
+}
+
+static bool parseValue(JsonParser *parser, Value *value);
+
+/**
+ * 空间不足时放弃，而不是让深层嵌套溢出 vm 栈
+ * 每层进入时按本层的最大用量检查，外层在递归期间占用的槽位不超过该用量，已计入 vm.stackTop
+ */
+static inline bool enterContainer(JsonParser *parser)
+{
+    if (++parser->depth <= JSON_MAX_DEPTH && vm.stackTop + JSON_LEVEL_SLOTS <= vm.stack + STACK_MAX)
+        return true;
+    parser->error = "JSON nested too deeply";
+    return false;
+}
+
+static bool parseArray(JsonParser *parser, Value *value)
+{
+    if (!enterContainer(parser))
+        return false;
+
+    ObjArray *array = newArray();
+    push(OBJ_VAL(array));
+    if (peekToken(parser) == ']')
+    {
+        nextToken(parser);
+    }
+    else
+    {
+        for (;;)
+        {
+            Value element;
+            if (!parseValue(parser, &element))
+                return false;
+            arrayPush(array, element);
+
+            char c = parser->json[nextToken(parser)];
+            if (c == ']')
+                break;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    parser->depth--;
+    *value = pop();
+    return true;
+}
+
+/** 对象构造为 Map，保持键的原有顺序 */
+static bool parseObject(JsonParser *parser, Value *value)
+{
+    if (!enterContainer(parser))
+        return false;
+
+    ObjMap *map = newMap();
+    push(OBJ_VAL(map));
+    if (peekToken(parser) == '}')
+    {
+        nextToken(parser);
+    }
+    else
+    {
+        for (;;)
+        {
+            int start = nextToken(parser);
+            Value key;
+            if (parser->json[start] != '"' || !parseString(parser, start, &key))
+                return false;
+            push(key);
+            if (parser->json[nextToken(parser)] != ':')
+                return false;
+
+            Value element;
+            if (!parseValue(parser, &element))
+                return false;
+            push(element);
+            valueTableSet(&map->table, key, element);
+            pop();
+            pop();
+
+            char c = parser->json[nextToken(parser)];
+            if (c == '}')
+                break;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    parser->depth--;
+    *value = pop();
+    return true;
+}
+
+static bool parseValue(JsonParser *parser, Value *value)
+{
+    int start = nextToken(parser);
+    switch (parser->json[start])
+    {
+    case '{':
+        return parseObject(parser, value);
+    case '[':
+        return parseArray(parser, value);
+    case '"':
+        return parseString(parser, start, value);
+    case 't':
+        return parseLiteral(parser, start, "true", 4, BOOL_VAL(true), value);
+    case 'f':
+        return parseLiteral(parser, start, "false", 5, BOOL_VAL(false), value);
+    case 'n':
+        return parseLiteral(parser, start, "null", 4, NIL_VAL, value);
+    default:
+        return parseNumber(parser, start, value);
+    }
+}
+
+/**
+ * jsonParse(text)：对象解析为 Map，数组解析为 Array，null 为 nil
+ * 输入不是合法 JSON 时报告运行时错误，指出出错处的字节偏移
+ */
+static Value jsonParseNative(int argCount, Value *args)
+{
+    if (argCount < 1 || !IS_STRING(args[0]))
+        return NIL_VAL;
+
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(args[0], buffer, &length);
+
+    // 复制到带填充的缓冲区：第一阶段按整块读取，第二阶段依赖结尾的 '\0'
+    char *json = (char *)malloc((size_t)length + JSON_PADDING);
+    uint32_t *index = (uint32_t *)malloc(sizeof(uint32_t) * ((size_t)length + 1));
+    if (json == NULL || index == NULL)
+    {
+        free(json);
+        free(index);
+        return NIL_VAL;
+    }
+    memcpy(json, chars, length);
+    memset(json + length, '\0', JSON_PADDING);
+
+    Value result = NIL_VAL;
+    JsonParser parser = {json, length, index, 0, 0, 0, NULL, 0, length, "Invalid JSON"};
+    int count = buildIndex(json, length, index);
+    if (count > 0)
+    {
+        parser.count = count;
+        Value *stackTop = vm.stackTop;
+        bool parsed = parseValue(&parser, &result);
+        if (parsed && parser.next != parser.count)
+        { // 值之后还有多余的记号
+            nextToken(&parser);
+            parsed = false;
+        }
+        vm.stackTop = stackTop; // 出错时丢弃未完成的容器
+        free(parser.scratch);
+        if (!parsed)
+            count = 0;
+    }
+
+    free(json);
+    free(index);
+    if (count <= 0) // 空输入与未闭合的字符串在输入结尾处出错
+        nativeError("%s at byte %d.", parser.error, parser.errorAt);
+    return result;
+}
+
+//
+// jsonStringify：写入可增长的 C 缓冲区，完成后一次构造字符串
+//
+
+typedef struct
+{
+    char *chars;
+    size_t length;
+    size_t capacity;
+    int depth;
+} JsonWriter;
+
+static bool reserve(JsonWriter *writer, size_t size)
+{
+    if (writer->length + size <= writer->capacity)
+        return true;
+
+    size_t capacity = writer->capacity < 64 ? 64 : writer->capacity;
+    while (capacity < writer->length + size)
+        capacity *= 2;
+    char *chars = (char *)realloc(writer->chars, capacity);
+    if (chars == NULL)
+        return false;
+    writer->chars = chars;
+    writer->capacity = capacity;
+    return true;
+}
+
+static inline bool writeChars(JsonWriter *writer, const char *chars, size_t length)
+{
+    if (!reserve(writer, length))
+        return false;
+    memcpy(writer->chars + writer->length, chars, length);
+    writer->length += length;
+    return true;
+}
+
+static inline bool writeChar(JsonWriter *writer, char c)
+{
+    if (!reserve(writer, 1))
+        return false;
+    writer->chars[writer->length++] = c;
+    return true;
+}
+
+/** 逐段复制无需转义的字节，遇到引号、反斜杠与控制字符时写入转义序列 */
+static bool writeString(JsonWriter *writer, const char *chars, int length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    // 最坏情况每个字节转义为 6 字节
+    if (!reserve(writer, (size_t)length * 6 + 2))
+        return false;
+
+    char *out = writer->chars + writer->length;
+    *out++ = '"';
+    int copied = 0;
+    for (int i = 0; i < length; i++)
+    {
+        uint8_t c = (uint8_t)chars[i];
+        if (!stringStops[c])
+            continue;
+
+        memcpy(out, chars + copied, i - copied);
+        out += i - copied;
+        copied = i + 1;
+
+        *out++ = '\\';
+        switch (c)
+        {
+        case '"':
+            *out++ = '"';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        case '\b':
+            *out++ = 'b';
+            break;
+        case '\f':
+            *out++ = 'f';
+            break;
+        case '\n':
+            *out++ = 'n';
+            break;
+        case '\r':
+            *out++ = 'r';
+            break;
+        case '\t':
+            *out++ = 't';
+            break;
+        default:
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 0xF];
+            break;
+        }
+    }
+    memcpy(out, chars + copied, length - copied);
+    out += length - copied;
+    *out++ = '"';
+
+    writer->length = (size_t)(out - writer->chars);
+    return true;
+}
+
+static bool writeValue(JsonWriter *writer, Value value);
+
+/** Map 的键：字符串原样写入，数字等写为其文本，其他键忽略 */
+static bool writeKey(JsonWriter *writer, Value key)
+{
+    char buffer[FORMAT_BUFFER];
+    int length;
+    const char *text = formatValue(key, buffer, &length);
+    return writeString(writer, text, length);
+}
+
+static inline bool isJsonKey(Value key)
+{
+    return IS_STRING(key) || IS_NUMBER(key) || IS_BOOL(key) || IS_NIL(key);
+}
+
+static bool writeValues(JsonWriter *writer, Value *values, int count)
+{
+    if (!writeChar(writer, '['))
+        return false;
+    for (int i = 0; i < count; i++)
+    {
+        if ((i > 0 && !writeChar(writer, ',')) || !writeValue(writer, values[i]))
+            return false;
+    }
+    return writeChar(writer, ']');
+}
+
+static bool writeObject(JsonWriter *writer, Value value)
+{
+    switch (OBJ_TYPE(value))
+    {
+    case OBJ_ARRAY:
+        return writeValues(writer, AS_ARRAY(value)->values.values, AS_ARRAY(value)->values.count);
+
+    case OBJ_TYPED_ARRAY:
+    {
+        ObjTypedArray *array = AS_TYPED_ARRAY(value);
+        if (!writeChar(writer, '['))
+            return false;
+        for (int i = 0; i < array->length; i++)
+        {
+            if ((i > 0 && !writeChar(writer, ',')) || !writeValue(writer, NUMBER_VAL(typedArrayGet(array, i))))
+                return false;
+        }
+        return writeChar(writer, ']');
+    }
+
+    case OBJ_MAP:
+    case OBJ_SET:
+    {
+        bool isMap = OBJ_TYPE(value) == OBJ_MAP;
+        ValueTable *table = isMap ? &AS_MAP(value)->table : &AS_SET(value)->table;
+        if (!writeChar(writer, isMap ? '{' : '['))
+            return false;
+        bool first = true;
+        for (int i = 0; i < table->entryCount; i++)
+        {
+            ValueEntry *entry = &table->entries[i];
+            if (!entry->live || (isMap && !isJsonKey(entry->key)))
+                continue;
+            if (!first && !writeChar(writer, ','))
+                return false;
+            first = false;
+
+            if (!isMap)
+            {
+                if (!writeValue(writer, entry->key))
+                    return false;
+            }
+            else if (!writeKey(writer, entry->key) || !writeChar(writer, ':') || !writeValue(writer, entry->value))
+            {
+                return false;
+            }
+        }
+        return writeChar(writer, isMap ? '}' : ']');
+    }
+
+    case OBJ_INSTANCE:
+    {
+        Table *fields = &AS_INSTANCE(value)->fields;
+        if (!writeChar(writer, '{'))
+            return false;
+        bool first = true;
+        for (int i = 0; i < fields->capacity; i++)
+        {
+            Entry *entry = &fields->entries[i];
+            if (entry->key == NULL)
+                continue;
+            if ((!first && !writeChar(writer, ',')) ||
+                !writeString(writer, entry->key->chars, entry->key->length) ||
+                !writeChar(writer, ':') || !writeValue(writer, entry->value))
+                return false;
+            first = false;
+        }
+        return writeChar(writer, '}');
+    }
+
+    default: // 函数、类等没有 JSON 表示
+        return writeChars(writer, "null", 4);
+    }
+}
+
+static bool writeValue(JsonWriter *writer, Value value)
+{
+    if (IS_STRING(value))
+    {
+        char buffer[SMALL_STRING_BUFFER];
+        int length;
+        const char *chars = stringChars(value, buffer, &length);
+        return writeString(writer, chars, length);
+    }
+    if (IS_NUMBER(value))
+    {
+        double number = AS_NUMBER(value);
+        if (number != number || number - number != 0) // NaN 与无穷
+            return writeChars(writer, "null", 4);
+        char buffer[NUMBER_BUFFER];
+        return writeChars(writer, buffer, formatNumber(number, buffer));
+    }
+    if (IS_BOOL(value))
+        return AS_BOOL(value) ? writeChars(writer, "true", 4) : writeChars(writer, "false", 5);
+    if (IS_NIL(value))
+        return writeChars(writer, "null", 4);
+
+    if (++writer->depth > JSON_MAX_DEPTH)
+        return false; // 多半是循环引用
+    bool written = writeObject(writer, value);
+    writer->depth--;
+    return written;
+}
+
+/**
+ * jsonStringify(value)：Map 与实例写为对象，Array、Set 与类型化数组写为数组
+ * 嵌套过深（包括循环引用）时返回 nil
+ */
+static Value jsonStringifyNative(int argCount, Value *args)
+{
+    if (argCount < 1)
+        return NIL_VAL;
+
+    JsonWriter writer = {NULL, 0, 0, 0};
+    Value result = NIL_VAL;
+    if (writeValue(&writer, args[0]))
+        result = copyStringValue(writer.chars, (int)writer.length);
+    free(writer.chars);
+    return result;
+}
+
+void loadJsonNatives()
+{
+    stringStops['"'] = true;
+    stringStops['\\'] = true;
+    for (int c = 0; c < 0x20; c++)
+        stringStops[c] = true;
+
+    defineNative("jsonParse", jsonParseNative);
+    defineNative("jsonStringify", jsonStringifyNative);
+}
@@ -0,0 +1,8 @@
+#ifndef loxj_json_h
+#define loxj_json_h
+
+#include "common.h"
+
+void loadJsonNatives();
+
+#endif
@@ -4,8 +4,13 @@
 #include <errno.h>
 
 #include "common.h"
+#include "bytecode.h"
+#include "cache.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "optimizer.h"
+#include "snapshot.h"
 #include "vm.h"
 
 static void repl()
@@ -129,11 +134,33 @@ static char *readFile(const char *path)
     return buffer;
 }
 
+/** 编译缓存目录，NULL 时使用默认目录 */
+static const char *cacheDir = NULL;
+/** --no-cache 关闭编译缓存 */
+static bool cacheEnabled = true;
+
+/** 字节码文件按魔数识别，与扩展名无关；源文件经由编译缓存编译，延迟编译时不使用缓存 */
 static void runFile(const char *path)
 {
-    char *sourceCode = readFile(path);
-    InterpretResult result = interpret(sourceCode);
-    free(sourceCode);
+    InterpretResult result;
+    if (isBytecodeFile(path))
+    {
+        const char *error;
+        ObjFunction *function = loadBytecode(path, NULL, &error);
+        if (function == NULL)
+        {
+            fprintf(stderr, "Could not load '%s': %s.\n", path, error);
+            exit(65);
+        }
+        result = interpretFunction(function);
+    }
+    else
+    {
+        char *sourceCode = readFile(path);
+        ObjFunction *function = cacheEnabled && !lazyFunctions ? compileCached(sourceCode, cacheDir) : compile(sourceCode);
+        free(sourceCode);
+        result = function != NULL ? interpretFunction(function) : INTERPRET_COMPILE_ERROR;
+    }
 
     if (result == INTERPRET_COMPILE_ERROR)
         exit(65);
@@ -141,21 +168,145 @@ static void runFile(const char *path)
         exit(70);
 }
 
+/** --compile：编译源文件并写出字节码文件，不执行 */
+static void compileFile(const char *path, const char *outputPath)
+{
+    char *sourceCode = readFile(path);
+    lazyFunctions = false; // 写出的字节码须完整，函数体的语法错误也应在此报告
+    ObjFunction *function = compile(sourceCode);
+    free(sourceCode);
+    if (function == NULL)
+        exit(65);
+
+    if (!writeBytecode(function, NULL, outputPath))
+    {
+        fprintf(stderr, "Could not write '%s'.\n", outputPath);
+        exit(74);
+    }
+}
+
+/** 打印函数及其嵌套函数的字节码 */
+static void disassembleFunction(ObjFunction *function)
+{
+    disassembleChunk(&function->chunk, function->name != NULL ? function->name->chars : "<script>");
+    for (int i = 0; i < function->chunk.constants.count; i++)
+    {
+        Value constant = function->chunk.constants.values[i];
+        if (IS_FUNCTION(constant))
+            disassembleFunction(AS_FUNCTION(constant));
+    }
+}
+
+/** --disassemble：编译源文件并打印字节码，不执行 */
+static void disassembleFile(const char *path)
+{
+    char *sourceCode = readFile(path);
+    lazyFunctions = false;
+    ObjFunction *function = compile(sourceCode);
+    free(sourceCode);
+    if (function == NULL)
+        exit(65);
+    disassembleFunction(function); // 打印不分配对象，function 不会被回收
+}
+
+/** --snapshot：运行前导脚本，再将全局变量及其可达的对象写为堆快照 */
+static void snapshotFile(const char *path, const char *outputPath)
+{
+    runFile(path);
+
+    const char *error;
+    if (!writeSnapshot(outputPath, &error))
+    {
+        fprintf(stderr, "Could not write '%s': %s.\n", outputPath, error);
+        exit(74);
+    }
+}
+
 int main(int argc, const char *argv[])
 {
+    // -O0 关闭优化，-O 或 -O1 启用（默认）；--cache-dir 指定编译缓存目录，--no-cache 关闭编译缓存；
+    // --restore 在运行之前恢复堆快照，代替重新运行前导脚本；--lazy 延迟编译函数体
+    const char *snapshotPath = NULL;
+    int argIndex = 1;
+    for (; argIndex < argc; argIndex++)
+    {
+        const char *option = argv[argIndex];
+        if (strcmp(option, "--restore") == 0 && argIndex + 1 < argc)
+        {
+            snapshotPath = argv[++argIndex];
+            continue;
+        }
+        if (strcmp(option, "--cache-dir") == 0 && argIndex + 1 < argc)
+        {
+            cacheDir = argv[++argIndex];
+            continue;
+        }
+        if (strcmp(option, "--no-cache") == 0)
+        {
+            cacheEnabled = false;
+            continue;
+        }
+        if (strcmp(option, "--lazy") == 0)
+        {
+            lazyFunctions = true;
+            continue;
+        }
+        if (strncmp(option, "-O", 2) != 0)
+            break;
+
+        const char *level = option + 2;
+        if (level[0] == '\0')
+            optimizeLevel = 1;
+        else if ((level[0] == '0' || level[0] == '1') && level[1] == '\0')
+            optimizeLevel = level[0] - '0';
+        else
+        {
+            fprintf(stderr, "Unknown option '%s'.\n", option);
+            exit(64);
+        }
+    }
+
     initVM();
 
-    if (argc == 1)
+    const char *error;
+    if (snapshotPath != NULL && !restoreSnapshot(snapshotPath, &error))
+    {
+        fprintf(stderr, "Could not restore '%s': %s.\n", snapshotPath, error);
+        exit(65);
+    }
+
+    bool compileMode = argIndex < argc && strcmp(argv[argIndex], "--compile") == 0;
+    if (compileMode || (argIndex < argc && strcmp(argv[argIndex], "--snapshot") == 0))
+    {
+        if (argIndex + 4 != argc || strcmp(argv[argIndex + 2], "-o") != 0)
+        {
+            fprintf(stderr, "Usage: %s [options] %s <path> -o <output>\n", argv[0], argv[argIndex]);
+            exit(64);
+        }
+        if (compileMode)
+            compileFile(argv[argIndex + 1], argv[argIndex + 3]);
+        else
+            snapshotFile(argv[argIndex + 1], argv[argIndex + 3]);
+    }
+    else if (argIndex + 2 == argc && strcmp(argv[argIndex], "--disassemble") == 0)
+    {
+        disassembleFile(argv[argIndex + 1]);
+    }
+    else if (argIndex == argc)
     {
         repl();
     }
-    else if (argc == 2)
+    else if (argIndex == argc - 1)
     {
-        runFile(argv[1]);
+        runFile(argv[argIndex]);
     }
     else
     {
-        fprintf(stderr, "Usage: %s [path]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [options] [path]\n", argv[0]);
+        fprintf(stderr, "       %s [options] --compile <path> -o <output>\n", argv[0]);
+        fprintf(stderr, "       %s [options] --snapshot <prelude> -o <output>\n", argv[0]);
+        fprintf(stderr, "       %s [options] --disassemble <path>\n", argv[0]);
+        fprintf(stderr, "Options: -O0|-O1, --lazy, --cache-dir <dir>, --no-cache, --restore <snapshot>\n");
         exit(64);
     }
 
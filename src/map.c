@@ -0,0 +1,172 @@
+#include "map.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+/**
+ * 将 vm 栈上的键规范化后写回原槽位：子串视图驻留为字符串，以免键长期引用视图的持有者
+ * 查找不需要规范化，视图与内容相同的字符串哈希一致且相等
+ */
+static Value internKey(Value *slot)
+{
+    if (IS_STRING_VIEW(*slot))
+        *slot = OBJ_VAL(internStringValue(*slot));
+    return *slot;
+}
+
+/** 按插入顺序收集键（或值）为数组 */
+static Value collect(ValueTable *table, bool keys)
+{
+    ObjArray *array = newArray();
+    push(OBJ_VAL(array));
+    if (table->count > 0)
+    {
+        array->values.values = GROW_ARRAY(Value, NULL, 0, table->count);
+        array->values.capacity = table->count;
+    }
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (entry->live)
+            array->values.values[array->values.count++] = keys ? entry->key : entry->value;
+    }
+    pop();
+    return OBJ_VAL(array);
+}
+
+//
+// Map，方法的 args[0] 为接收者
+//
+
+static Value mapNative(int argCount, Value *args)
+{
+    return OBJ_VAL(newMap());
+}
+
+/** get(key)：不存在返回 nil */
+static Value mapGetNative(int argCount, Value *args)
+{
+    Value value = NIL_VAL;
+    if (argCount >= 2)
+        valueTableGet(&AS_MAP(args[0])->table, args[1], &value);
+    return value;
+}
+
+/** set(key, value)：返回接收者 */
+static Value mapSetNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+    Value key = internKey(&args[1]);
+    valueTableSet(&AS_MAP(args[0])->table, key, argCount >= 3 ? args[2] : NIL_VAL);
+    return args[0];
+}
+
+static Value mapHasNative(int argCount, Value *args)
+{
+    Value value;
+    return BOOL_VAL(argCount >= 2 && valueTableGet(&AS_MAP(args[0])->table, args[1], &value));
+}
+
+/** delete(key)：返回键是否存在 */
+static Value mapDeleteNative(int argCount, Value *args)
+{
+    return BOOL_VAL(argCount >= 2 && valueTableDelete(&AS_MAP(args[0])->table, args[1]));
+}
+
+static Value mapClearNative(int argCount, Value *args)
+{
+    freeValueTable(&AS_MAP(args[0])->table);
+    return NIL_VAL;
+}
+
+static Value mapKeysNative(int argCount, Value *args)
+{
+    return collect(&AS_MAP(args[0])->table, true);
+}
+
+static Value mapValuesNative(int argCount, Value *args)
+{
+    return collect(&AS_MAP(args[0])->table, false);
+}
+
+//
+// Set
+//
+
+/** Set(array)：可选地以数组元素初始化 */
+static Value setNative(int argCount, Value *args)
+{
+    if (argCount >= 1 && !IS_ARRAY(args[0]))
+        return NIL_VAL;
+
+    ObjSet *set = newSet();
+    push(OBJ_VAL(set));
+    if (argCount >= 1)
+    {
+        ObjArray *array = AS_ARRAY(args[0]);
+        for (int i = 0; i < array->values.count; i++)
+        {
+            push(array->values.values[i]);
+            Value key = internKey(vm.stackTop - 1);
+            valueTableSet(&set->table, key, BOOL_VAL(true));
+            pop();
+        }
+    }
+    pop();
+    return OBJ_VAL(set);
+}
+
+/** add(value)：返回接收者 */
+static Value setAddNative(int argCount, Value *args)
+{
+    if (argCount < 2)
+        return NIL_VAL;
+    Value key = internKey(&args[1]);
+    valueTableSet(&AS_SET(args[0])->table, key, BOOL_VAL(true));
+    return args[0];
+}
+
+static Value setHasNative(int argCount, Value *args)
+{
+    Value value;
+    return BOOL_VAL(argCount >= 2 && valueTableGet(&AS_SET(args[0])->table, args[1], &value));
+}
+
+static Value setDeleteNative(int argCount, Value *args)
+{
+    return BOOL_VAL(argCount >= 2 && valueTableDelete(&AS_SET(args[0])->table, args[1]));
+}
+
+static Value setClearNative(int argCount, Value *args)
+{
+    freeValueTable(&AS_SET(args[0])->table);
+    return NIL_VAL;
+}
+
+static Value setValuesNative(int argCount, Value *args)
+{
+    return collect(&AS_SET(args[0])->table, true);
+}
+
+void loadMapNatives()
+{
+    defineNative("Map", mapNative);
+    defineNative("Set", setNative);
+
+    vm.mapClass = newBuiltinClass("Map");
+    defineNativeMethod(vm.mapClass, "get", mapGetNative);
+    defineNativeMethod(vm.mapClass, "set", mapSetNative);
+    defineNativeMethod(vm.mapClass, "has", mapHasNative);
+    defineNativeMethod(vm.mapClass, "delete", mapDeleteNative);
+    defineNativeMethod(vm.mapClass, "clear", mapClearNative);
+    defineNativeMethod(vm.mapClass, "keys", mapKeysNative);
+    defineNativeMethod(vm.mapClass, "values", mapValuesNative);
+
+    vm.setClass = newBuiltinClass("Set");
+    defineNativeMethod(vm.setClass, "add", setAddNative);
+    defineNativeMethod(vm.setClass, "has", setHasNative);
+    defineNativeMethod(vm.setClass, "delete", setDeleteNative);
+    defineNativeMethod(vm.setClass, "clear", setClearNative);
+    defineNativeMethod(vm.setClass, "values", setValuesNative);
+}
@@ -0,0 +1,8 @@
+#ifndef loxj_map_h
+#define loxj_map_h
+
+#include "common.h"
+
+void loadMapNatives();
+
+#endif
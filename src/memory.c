@@ -1,14 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "memory.h"
 #include "vm.h"
+#include "file.h"
 
 #ifdef DEBUG_LOG_GC
 #include "debug.h"
 #endif
 
 #define GC_HEAP_GROW_FACTOR 2
+// 持有者长度至少为 VIEW_PIN_MIN 且超过视图的 VIEW_PIN_RATIO 倍时，物化视图而非保活持有者
+#define VIEW_PIN_MIN 1024
+#define VIEW_PIN_RATIO 8
 
 void *reallocate(void *pointer, size_t oldSize, size_t newSize)
 {
@@ -46,6 +51,13 @@ static void freeObject(Obj *object)
 
     switch (object->type)
     {
+    case OBJ_ARRAY:
+    {
+        ObjArray *array = (ObjArray *)object;
+        freeValueArray(&array->values);
+        FREE(ObjArray, object);
+        break;
+    }
     case OBJ_CLASS:
     {
         ObjClass *klass = (ObjClass *)object;
@@ -66,27 +78,70 @@ static void freeObject(Obj *object)
     case OBJ_CLOSURE:
     {
         ObjClosure *closure = (ObjClosure *)object;
-        FREE_ARRAY(ObjUpvalue *, closure->upvalues, closure->upvalueCount);
-        FREE(ObjClosure, object);
+        FREE_FLEX(ObjClosure, ObjUpvalue *, object, closure->upvalueCount);
         break;
     }
     case OBJ_FUNCTION:
     {
         ObjFunction *function = (ObjFunction *)object;
+        if (function->lazy != NULL)
+            freeLazyBody(function->lazy);
         freeChunk(&function->chunk);
         FREE(ObjFunction, object);
         break;
     }
+    case OBJ_FILE_DATA:
+    {
+        ObjFileData *file = (ObjFileData *)object;
+        releaseFileData(file);
+        vm.bytesAllocated -= file->length;
+        FREE(ObjFileData, object);
+        break;
+    }
+    case OBJ_MAP:
+    {
+        freeValueTable(&((ObjMap *)object)->table);
+        FREE(ObjMap, object);
+        break;
+    }
     case OBJ_NATIVE:
     {
         FREE(ObjNative, object);
         break;
     }
+    case OBJ_SET:
+    {
+        freeValueTable(&((ObjSet *)object)->table);
+        FREE(ObjSet, object);
+        break;
+    }
     case OBJ_STRING:
     {
         ObjString *string = (ObjString *)object;
-        FREE_ARRAY(char, string->chars, string->length + 1);
-        FREE(ObjString, object);
+        FREE_FLEX(ObjString, char, object, string->length + 1);
+        break;
+    }
+    case OBJ_STRING_BUILDER:
+    {
+        ObjStringBuilder *builder = (ObjStringBuilder *)object;
+        FREE_ARRAY(char, builder->chars, builder->capacity);
+        FREE(ObjStringBuilder, object);
+        break;
+    }
+    case OBJ_STRING_VIEW:
+    {
+        ObjStringView *view = (ObjStringView *)object;
+        if (view->owner == NULL)
+            FREE_ARRAY(char, (char *)view->chars, view->length);
+        FREE(ObjStringView, object);
+        break;
+    }
+    case OBJ_TYPED_ARRAY:
+    {
+        ObjTypedArray *array = (ObjTypedArray *)object;
+        if (array->owner == NULL)
+            FREE_ARRAY(uint8_t, array->data, typedArrayElementSize(array->kind) * array->length);
+        FREE(ObjTypedArray, object);
         break;
     }
     case OBJ_UPVALUE:
@@ -107,6 +162,7 @@ void freeObjects()
         object = next;
     }
     free(vm.grayStack);
+    free(vm.viewStack);
 }
 
 void markValue(Value value)
@@ -158,11 +214,22 @@ static void markRoots()
     for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
     {
         markValue(*slot);
+        // native 可能正持有栈上视图的字符，因此这些视图不物化，直接保活其持有者
+        if (IS_STRING_VIEW(*slot))
+            markObject(AS_STRING_VIEW(*slot)->owner);
     }
 
     markTable(&vm.globals);
     markCompilerRoots();
     markObject((Obj *)vm.initString);
+    markObject((Obj *)vm.stringBuilderClass);
+    markObject((Obj *)vm.stringClass);
+    markObject((Obj *)vm.arrayClass);
+    markObject((Obj *)vm.typedArrayClass);
+    markObject((Obj *)vm.mapClass);
+    markObject((Obj *)vm.setClass);
+    markObject((Obj *)vm.lengthString);
+    markObject((Obj *)vm.sizeString);
 
     for (int i = 0; i < vm.frameCount; i++)
     {
@@ -178,6 +245,23 @@ static void markRoots()
     // 另外，驻留的字符串表是弱引用
 }
 
+static void deferView(ObjStringView *view)
+{
+    if (vm.viewCapacity < vm.viewCount + 1)
+    {
+        vm.viewCapacity = GROW_CAPACITY(vm.viewCapacity);
+        vm.viewStack = (ObjStringView **)realloc(vm.viewStack, sizeof(ObjStringView *) * vm.viewCapacity);
+
+        if (vm.viewStack == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    vm.viewStack[vm.viewCount++] = view;
+}
+
 static void blackenObject(Obj *object)
 {
 #ifdef DEBUG_LOG_GC
@@ -188,6 +272,11 @@ static void blackenObject(Obj *object)
 
     switch (object->type)
     {
+    case OBJ_ARRAY:
+    {
+        markArray(&((ObjArray *)object)->values);
+        break;
+    }
     case OBJ_CLASS:
     {
         ObjClass *klass = (ObjClass *)object;
@@ -227,8 +316,36 @@ static void blackenObject(Obj *object)
         ObjFunction *function = (ObjFunction *)object;
         markObject((Obj *)function->name);
         markArray(&function->chunk.constants);
+        if (function->lazy != NULL)
+            markLazyBody(function->lazy);
         break;
     }
+    case OBJ_STRING_BUILDER:
+    {
+        markValue(((ObjStringBuilder *)object)->string);
+        break;
+    }
+    case OBJ_MAP:
+    {
+        markValueTable(&((ObjMap *)object)->table);
+        break;
+    }
+    case OBJ_SET:
+    {
+        markValueTable(&((ObjSet *)object)->table);
+        break;
+    }
+    case OBJ_STRING_VIEW:
+    {
+        ObjStringView *view = (ObjStringView *)object;
+        if (view->owner != NULL && !view->owner->isMarked)
+            deferView(view); // 持有者可能仅被视图引用，待标记结束后再决定
+        break;
+    }
+    case OBJ_TYPED_ARRAY:
+        markObject(((ObjTypedArray *)object)->owner);
+        break;
+    case OBJ_FILE_DATA:
     case OBJ_NATIVE:
     case OBJ_STRING:
         break;
@@ -244,6 +361,58 @@ static void traceReferences()
     }
 }
 
+/**
+ * 将视图的字符复制到视图自身，不再引用持有者
+ * 正在回收，不能经 reallocate 分配（会重入 GC），故直接 malloc 并计入堆大小
+ */
+static void materializeView(ObjStringView *view)
+{
+    char *chars = (char *)malloc(view->length);
+    if (chars == NULL)
+        exit(1);
+    memcpy(chars, view->chars, view->length);
+    vm.bytesAllocated += view->length;
+
+    view->chars = chars;
+    view->owner = NULL;
+}
+
+static size_t ownerLength(Obj *owner)
+{
+    switch (owner->type)
+    {
+    case OBJ_STRING:
+        return ((ObjString *)owner)->length;
+    case OBJ_FILE_DATA:
+        return ((ObjFileData *)owner)->length;
+    default:
+        return ((ObjStringView *)owner)->length;
+    }
+}
+
+/**
+ * 其余可达对象均已标记后处理推迟的视图
+ * 持有者已可达则无需处理；否则持有者仅被视图引用，若它远大于视图则物化视图使其可被回收，否则保活持有者
+ */
+static void resolveViews()
+{
+    for (int i = 0; i < vm.viewCount; i++)
+    {
+        ObjStringView *view = vm.viewStack[i];
+        if (view->owner->isMarked)
+            continue;
+
+        size_t length = ownerLength(view->owner);
+        if (length >= VIEW_PIN_MIN && length / VIEW_PIN_RATIO > (size_t)view->length)
+            materializeView(view);
+        else
+            markObject(view->owner);
+    }
+    vm.viewCount = 0;
+
+    traceReferences(); // 持有者是字符串、文件内容或已物化的视图，不会再推迟新的视图
+}
+
 static void sweep()
 { // 插入是头插
     Obj *previous = NULL;
@@ -288,6 +457,7 @@ void collectGarbage()
 
     markRoots();
     traceReferences();
+    resolveViews();
     tableRemoveWhite(&vm.strings);
     sweep();
     vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
@@ -22,6 +22,10 @@ void *reallocate(void *pointer, size_t oldSize, size_t newSize);
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+/** 释放带灵活数组成员的对象，count 为尾部元素个数 */
+#define FREE_FLEX(TYPE, ELEMENT_TYPE, pointer, count) \
+    reallocate(pointer, sizeof(TYPE) + sizeof(ELEMENT_TYPE) * (count), 0)
+
 void freeObjects();
 
 void markValue(Value value);
@@ -9,6 +9,9 @@
 #include "table.h"
 
 #define ALLOCATE_OBJ(TYPE, objectType) (TYPE *)allocateObject(sizeof(TYPE), objectType)
+// 带灵活数组成员的对象，count 为尾部元素个数
+#define ALLOCATE_FLEX_OBJ(TYPE, ELEMENT_TYPE, count, objectType) \
+    (TYPE *)allocateObject(sizeof(TYPE) + sizeof(ELEMENT_TYPE) * (count), objectType)
 
 static Obj *allocateObject(size_t size, ObjType type)
 {
@@ -28,14 +31,20 @@ static Obj *allocateObject(size_t size, ObjType type)
 }
 
 /**
- * chars 所有权被转移到此函数
- * 注意此函数分配的是 obj，而非其内部的 chars
+ * 分配可容纳 length 个字符的字符串对象，字符直接存放于对象尾部
+ * 返回的字符串尚未驻留：调用方写入字符后须立即调用 internString，期间不得再分配内存
  */
-static ObjString *allocateString(char *chars, int length, uint32_t hash)
+ObjString *makeString(int length)
 {
-    ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+    ObjString *string = ALLOCATE_FLEX_OBJ(ObjString, char, length + 1, OBJ_STRING);
     string->length = length;
-    string->chars = chars;
+    string->hash = 0;
+    string->chars[length] = '\0';
+    return string;
+}
+
+static ObjString *registerString(ObjString *string, uint32_t hash)
+{
     string->hash = hash;
 
     push(OBJ_VAL(string));
@@ -45,7 +54,28 @@ static ObjString *allocateString(char *chars, int length, uint32_t hash)
     return string;
 }
 
-static uint32_t hashString(const char *key, int length);
+/**
+ * 驻留 makeString 得到的字符串
+ * @return 若已有相同内容的驻留值则返回驻留值，新对象随即释放
+ */
+ObjString *internString(ObjString *string)
+{
+    uint32_t hash = hashString(string->chars, string->length);
+
+    ObjString *interned = tableFindString(&vm.strings, string->chars, string->length, hash);
+    if (interned != NULL)
+    {
+        // 新对象是最近一次分配的，仍位于对象链表表头，可直接摘下释放
+        if (vm.objects == (Obj *)string)
+        {
+            vm.objects = string->obj.next;
+            FREE_FLEX(ObjString, char, string, string->length + 1);
+        } // 否则交由 GC 回收
+        return interned;
+    }
+
+    return registerString(string, hash);
+}
 
 // 调用方无 chars 所有权
 ObjString *copyString(const char *chars, int length)
@@ -56,50 +86,138 @@ ObjString *copyString(const char *chars, int length)
     if (interned != NULL)
         return interned; // 若有驻留值，返回驻留值，无需重复分配内存
 
-    char *heapChars = ALLOCATE(char, length + 1);
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    ObjString *string = makeString(length);
+    memcpy(string->chars, chars, length);
+    return registerString(string, hash);
 }
 
-// 调用方需具有 chars 所有权
+// 调用方需具有 chars 所有权（由 ALLOCATE 分配），字符会被复制进对象，随后释放 chars
 ObjString *takeString(char *chars, int length)
 {
-    uint32_t hash = hashString(chars, length);
+    ObjString *string = copyString(chars, length);
+    FREE_ARRAY(char, chars, length + 1); // NULL 结尾，size = length + 1
+    return string;
+}
 
-    ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
-    if (interned != NULL)
-    {
-        FREE_ARRAY(char, chars, length + 1); // NULL 结尾，size = length + 1
-        return interned;
-        // 如果字符串已经驻留了，传入的 chars 就是多余的。所以需要释放其内存
-    }
+static inline bool fitsSmallString(const char *chars, int length)
+{
+#ifdef NAN_BOXING
+    return length <= SMALL_STRING_MAX && memchr(chars, '\0', length) == NULL;
+#else
+    return false;
+#endif
+}
 
-    return allocateString(chars, length, hash);
+/**
+ * 构造字符串值：足够短时直接编码为短字符串，无需分配与驻留
+ */
+Value copyStringValue(const char *chars, int length)
+{
+    if (fitsSmallString(chars, length))
+        return makeSmallString(chars, length);
+    return OBJ_VAL(copyString(chars, length));
 }
 
 /**
  * 由于 scanner 内存不归 vm 管理，因此需要做特殊处理
  */
-ObjString *takeStringFromToken(char *chars, int length)
+Value takeStringFromToken(char *chars, int length)
 {
-    uint32_t hash = hashString(chars, length);
+    Value string = copyStringValue(chars, length);
+    free(chars); // 使用普通 free
+    return string;
+}
 
-    ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
-    if (interned != NULL)
+/**
+ * 读取任意字符串值的字符
+ * @param buffer 短字符串的解码缓冲区，至少 SMALL_STRING_BUFFER 字节
+ * @param length 输出字符串长度
+ * @return 字符，短字符串指向 buffer。视图的字符不以 NUL 结尾，须配合 length 使用
+ */
+const char *stringChars(Value value, char *buffer, int *length)
+{
+    if (IS_SMALL_STRING(value))
     {
-        free(chars); // 使用普通 free
-        return interned;
+        *length = readSmallString(value, buffer);
+        return buffer;
     }
-    // 移交所有权
-    return allocateString(chars, length, hash);
+    if (IS_STRING_VIEW(value))
+    {
+        *length = AS_STRING_VIEW(value)->length;
+        return AS_STRING_VIEW(value)->chars;
+    }
+    ObjString *string = AS_STRING(value);
+    *length = string->length;
+    return string->chars;
+}
+
+/**
+ * 哈希表的键都是驻留的 ObjString，查找时只需在驻留表中找到对应对象，不分配内存
+ * @return 驻留的 ObjString，若从未驻留（因此不可能是任何表的键）返回 NULL
+ */
+ObjString *findStringValue(Value value)
+{
+    if (IS_OBJ_STRING(value))
+        return AS_STRING(value);
+
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(value, buffer, &length);
+    return tableFindString(&vm.strings, chars, length, hashString(chars, length));
+}
+
+/**
+ * 取得字符串值对应的驻留 ObjString，用作哈希表键，必要时分配
+ */
+ObjString *internStringValue(Value value)
+{
+    if (IS_OBJ_STRING(value))
+        return AS_STRING(value);
+
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(value, buffer, &length);
+    return copyString(chars, length);
+}
+
+/**
+ * 取 string 中 [start, start + length) 的子串，调用方保证范围合法且 string 位于 vm 栈上
+ * 足够短的子串为短字符串，其余为引用原字符的视图，不复制字符
+ */
+Value substringValue(Value string, int start, int length)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int total;
+    const char *chars = stringChars(string, buffer, &total);
+    if (start == 0 && length == total)
+        return string;
+    if (length <= SMALL_STRING_MAX)
+        return copyStringValue(chars + start, length);
+
+    // 视图的视图直接引用最初的持有者，不形成链
+    Obj *owner = AS_OBJ(string);
+    if (IS_STRING_VIEW(string) && AS_STRING_VIEW(string)->owner != NULL)
+        owner = AS_STRING_VIEW(string)->owner;
+    return OBJ_VAL(newStringView(owner, chars + start, length));
+}
+
+/**
+ * 按内容比较两个字符串值，用于涉及视图的相等判断（其余字符串值驻留，比较地址即可）
+ */
+bool isStringsEqual(Value a, Value b)
+{
+    char bufferA[SMALL_STRING_BUFFER], bufferB[SMALL_STRING_BUFFER];
+    int lengthA, lengthB;
+    const char *charsA = stringChars(a, bufferA, &lengthA);
+    const char *charsB = stringChars(b, bufferB, &lengthB);
+    return lengthA == lengthB && memcmp(charsA, charsB, lengthA) == 0;
 }
 
 /**
  * FNV-1a (32-bit) 算法
  * http://www.isthe.com/chongo/tech/comp/fnv/
  */
-static uint32_t hashString(const char *key, int length)
+uint32_t hashString(const char *key, int length)
 {
     uint32_t hash = 2166136261u;
     for (int i = 0; i < length; i++)
@@ -117,6 +235,8 @@ ObjFunction *newFunction()
     function->name = NULL;
     initChunk(&function->chunk);
     function->upvalueCount = 0;
+    function->slotCount = 1;
+    function->lazy = NULL;
     return function;
 }
 
@@ -129,16 +249,13 @@ ObjNative *newNative(NativeFn function)
 
 ObjClosure *newClosure(ObjFunction *function)
 {
-    ObjUpvalue **upvalues = ALLOCATE(ObjUpvalue *, function->upvalueCount);
+    ObjClosure *closure = ALLOCATE_FLEX_OBJ(ObjClosure, ObjUpvalue *, function->upvalueCount, OBJ_CLOSURE);
+    closure->function = function;
+    closure->upvalueCount = function->upvalueCount;
     for (int i = 0; i < function->upvalueCount; i++)
     {
-        upvalues[i] = NULL;
+        closure->upvalues[i] = NULL;
     }
-
-    ObjClosure *closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
-    closure->function = function;
-    closure->upvalues = upvalues;
-    closure->upvalueCount = function->upvalueCount;
     return closure;
 }
 
@@ -173,4 +290,116 @@ ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method)
     bound->receiver = receiver;
     bound->method = method;
     return bound;
-}
\ No newline at end of file
+}
+
+ObjStringBuilder *newStringBuilder()
+{
+    ObjStringBuilder *builder = ALLOCATE_OBJ(ObjStringBuilder, OBJ_STRING_BUILDER);
+    builder->length = 0;
+    builder->capacity = 0;
+    builder->chars = NULL;
+    builder->string = NIL_VAL;
+    return builder;
+}
+
+ObjStringView *newStringView(Obj *owner, const char *chars, int length)
+{
+    ObjStringView *view = ALLOCATE_OBJ(ObjStringView, OBJ_STRING_VIEW);
+    view->owner = owner;
+    view->chars = chars;
+    view->length = length;
+    return view;
+}
+
+ObjArray *newArray()
+{
+    ObjArray *array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+    initValueArray(&array->values);
+    return array;
+}
+
+size_t typedArrayElementSize(TypedArrayKind kind)
+{
+    switch (kind)
+    {
+    case TYPED_FLOAT64:
+        return sizeof(double);
+    case TYPED_INT32:
+        return sizeof(int32_t);
+    case TYPED_UINT8:
+        return sizeof(uint8_t);
+    }
+    return 0; // unreachable
+}
+
+const char *typedArrayName(TypedArrayKind kind)
+{
+    switch (kind)
+    {
+    case TYPED_FLOAT64:
+        return "Float64Array";
+    case TYPED_INT32:
+        return "Int32Array";
+    case TYPED_UINT8:
+        return "Uint8Array";
+    }
+    return "TypedArray"; // unreachable
+}
+
+/**
+ * 创建元素全为 0 的类型化数组
+ */
+ObjTypedArray *newTypedArray(TypedArrayKind kind, int length)
+{
+    // 先分配元素缓冲区：此时对象尚不存在，分配触发 GC 也无需保护
+    size_t size = typedArrayElementSize(kind) * length;
+    void *data = reallocate(NULL, 0, size);
+    if (size > 0)
+        memset(data, 0, size);
+
+    ObjTypedArray *array = ALLOCATE_OBJ(ObjTypedArray, OBJ_TYPED_ARRAY);
+    array->kind = kind;
+    array->length = length;
+    array->data = data;
+    array->owner = NULL;
+    return array;
+}
+
+/** 以 owner 持有的缓冲区作为元素，不复制，调用方须保证 owner 可被 GC 找到 */
+ObjTypedArray *wrapTypedArray(Obj *owner, TypedArrayKind kind, void *data, int length)
+{
+    ObjTypedArray *array = ALLOCATE_OBJ(ObjTypedArray, OBJ_TYPED_ARRAY);
+    array->kind = kind;
+    array->length = length;
+    array->data = data;
+    array->owner = owner;
+    return array;
+}
+
+ObjMap *newMap()
+{
+    ObjMap *map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+    initValueTable(&map->table);
+    return map;
+}
+
+ObjSet *newSet()
+{
+    ObjSet *set = ALLOCATE_OBJ(ObjSet, OBJ_SET);
+    initValueTable(&set->table);
+    return set;
+}
+
+/**
+ * 接管 data 的所有权，回收时按 mapped 解除映射或释放
+ * 先登记对象再计入内容长度，此后的分配才可能因此触发 GC
+ */
+ObjFileData *newFileData(char *data, size_t length, bool mapped)
+{
+    ObjFileData *file = ALLOCATE_OBJ(ObjFileData, OBJ_FILE_DATA);
+    file->data = data;
+    file->length = length;
+    file->mapped = mapped;
+    vm.bytesAllocated += length;
+    return file;
+}
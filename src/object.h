@@ -5,6 +5,7 @@
 #include "value.h"
 #include "chunk.h"
 #include "table.h"
+#include "valuetable.h"
 
 //
 // objects
@@ -12,13 +13,20 @@
 
 typedef enum
 {
+    OBJ_ARRAY,
     OBJ_CLASS,
     OBJ_BOUND_METHOD,
     OBJ_CLOSURE,
+    OBJ_FILE_DATA,
     OBJ_FUNCTION,
     OBJ_INSTANCE,
+    OBJ_MAP,
     OBJ_NATIVE,
+    OBJ_SET,
     OBJ_STRING,
+    OBJ_STRING_BUILDER,
+    OBJ_STRING_VIEW,
+    OBJ_TYPED_ARRAY,
     OBJ_UPVALUE
 } ObjType;
 
@@ -41,16 +49,53 @@ struct ObjString
     Obj obj;
     int length;
     uint32_t hash; // Jay字符串是不可变值，故其哈希不变。字符串存储哈希以免多次计算
-    char *chars;   // TODO：使用灵活数组成员改写：https://ray.deno.dev/posts/clang-flexible-array-member
+    char chars[];  // 灵活数组成员：字符与对象头一次分配，https://ray.deno.dev/posts/clang-flexible-array-member
 };
 
-#define IS_STRING(value) isObjType(value, OBJ_STRING)
-#define AS_STRING(value) ((ObjString *)AS_OBJ(value))
+// 子串视图：引用另一对象的字符而不复制，视图存活期间其持有者亦存活
+// 仅用于长度超过 SMALL_STRING_MAX 的子串。视图从不驻留，与其他字符串按内容比较
+typedef struct
+{
+    Obj obj;
+    /** 持有字符的对象（ObjString 或已物化的视图），NULL 表示视图已物化，chars 归视图自身所有 */
+    Obj *owner;
+    const char *chars; // 不以 NUL 结尾
+    int length;
+} ObjStringView;
+
+// 字符串值有三种表示：堆上的 ObjString、子串视图，以及 NaN 装箱下直接编码在值里的短字符串
+// 不超过 SMALL_STRING_MAX 且不含 NUL 的字符串值总是短字符串，因此内容相同的短字符串位模式相同
+#define IS_STRING(value) isStringValue(value)
+#define IS_OBJ_STRING(value) isObjType(value, OBJ_STRING)
+#define IS_STRING_VIEW(value) isObjType(value, OBJ_STRING_VIEW)
+#define AS_STRING_VIEW(value) ((ObjStringView *)AS_OBJ(value))
+#define AS_STRING(value) ((ObjString *)AS_OBJ(value)) // 仅适用于 IS_OBJ_STRING
 #define AS_CSTRING(value) (((ObjString *)AS_OBJ(value))->chars)
 
+static inline bool isStringValue(Value value)
+{
+    if (IS_SMALL_STRING(value))
+        return true;
+    return IS_OBJ(value) && (OBJ_TYPE(value) == OBJ_STRING || OBJ_TYPE(value) == OBJ_STRING_VIEW);
+}
+
+uint32_t hashString(const char *key, int length);
+ObjString *makeString(int length);
+ObjString *internString(ObjString *string);
 ObjString *copyString(const char *chars, int length);
 ObjString *takeString(char *chars, int length);
-ObjString *takeStringFromToken(char *chars, int length);
+
+Value copyStringValue(const char *chars, int length);
+Value takeStringFromToken(char *chars, int length);
+const char *stringChars(Value value, char *buffer, int *length);
+ObjString *findStringValue(Value value);
+ObjString *internStringValue(Value value);
+Value substringValue(Value string, int start, int length);
+bool isStringsEqual(Value a, Value b);
+ObjStringView *newStringView(Obj *owner, const char *chars, int length);
+
+/** 预解析而尚未编译的函数体，定义见 compiler.c */
+typedef struct LazyBody LazyBody;
 
 typedef struct
 {
@@ -60,6 +105,10 @@ typedef struct
     /** 每个函数有自己的字节码块 */
     Chunk chunk; // TODO：也可以令函数的字节码块嵌入整个块
     int upvalueCount;
+    /** 同时存活的局部变量槽数的最大值（含槽 0），调用时据此检查值栈余量 */
+    int slotCount;
+    /** 延迟编译的函数在首次调用之前非 NULL，此时字节码块为空 */
+    LazyBody *lazy;
 } ObjFunction;
 
 typedef Value (*NativeFn)(int argCount, Value *args);
@@ -99,8 +148,8 @@ typedef struct
 {
     Obj obj;
     ObjFunction *function;
-    ObjUpvalue **upvalues;
     int upvalueCount;
+    ObjUpvalue *upvalues[]; // 灵活数组成员，与闭包一次分配
 } ObjClosure;
 
 ObjClosure *newClosure(ObjFunction *function);
@@ -141,4 +190,88 @@ ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method);
 #define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
 #define AS_BOUND_METHOD(value) ((ObjBoundMethod *)AS_OBJ(value))
 
+// 可变字符缓冲区，按几何级数扩容，避免反复拼接字符串产生的中间驻留字符串
+typedef struct
+{
+    Obj obj;
+    int length;
+    int capacity;
+    char *chars;
+    /** toString 的结果缓存，追加内容后置为 nil */
+    Value string;
+} ObjStringBuilder;
+
+ObjStringBuilder *newStringBuilder();
+#define IS_STRING_BUILDER(value) isObjType(value, OBJ_STRING_BUILDER)
+#define AS_STRING_BUILDER(value) ((ObjStringBuilder *)AS_OBJ(value))
+
+// 稠密数组，元素连续存放，追加按几何级数扩容
+typedef struct
+{
+    Obj obj;
+    ValueArray values;
+} ObjArray;
+
+ObjArray *newArray();
+#define IS_ARRAY(value) isObjType(value, OBJ_ARRAY)
+#define AS_ARRAY(value) ((ObjArray *)AS_OBJ(value))
+
+typedef enum
+{
+    TYPED_FLOAT64,
+    TYPED_INT32,
+    TYPED_UINT8
+} TypedArrayKind;
+
+// 类型化数组：元素以原始数值连续存放，长度固定
+typedef struct
+{
+    Obj obj;
+    TypedArrayKind kind;
+    int length;
+    void *data; // length 个 kind 类型的元素
+    /** 元素缓冲区的持有者，NULL 表示缓冲区归数组自身所有 */
+    Obj *owner;
+} ObjTypedArray;
+
+ObjTypedArray *newTypedArray(TypedArrayKind kind, int length);
+ObjTypedArray *wrapTypedArray(Obj *owner, TypedArrayKind kind, void *data, int length);
+size_t typedArrayElementSize(TypedArrayKind kind);
+const char *typedArrayName(TypedArrayKind kind);
+#define IS_TYPED_ARRAY(value) isObjType(value, OBJ_TYPED_ARRAY)
+#define AS_TYPED_ARRAY(value) ((ObjTypedArray *)AS_OBJ(value))
+
+// 以任意值为键的映射与集合，按插入顺序迭代。集合的条目值恒为 true
+typedef struct
+{
+    Obj obj;
+    ValueTable table;
+} ObjMap;
+
+typedef struct
+{
+    Obj obj;
+    ValueTable table;
+} ObjSet;
+
+ObjMap *newMap();
+ObjSet *newSet();
+#define IS_MAP(value) isObjType(value, OBJ_MAP)
+#define AS_MAP(value) ((ObjMap *)AS_OBJ(value))
+#define IS_SET(value) isObjType(value, OBJ_SET)
+#define AS_SET(value) ((ObjSet *)AS_OBJ(value))
+
+// 文件内容：只读内存映射（或不支持 mmap 时读入的缓冲区），作为视图与类型化数组的持有者，不直接暴露给脚本
+// 内容长度计入堆大小，使 GC 能及时解除不再被引用的映射
+typedef struct
+{
+    Obj obj;
+    char *data;
+    size_t length;
+    /** data 来自 mmap，否则来自 malloc */
+    bool mapped;
+} ObjFileData;
+
+ObjFileData *newFileData(char *data, size_t length, bool mapped);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,523 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "optimizer.h"
+#include "memory.h"
+
+// 窥孔优化：单遍编译器生成的字节码先解码为指令序列，跳转改为指向指令下标，
+// 反复改写直到没有变化，最后按新的位置写回字节码与行号并重新计算跳转偏移。
+// 编译器生成的向前跳转一律带 OP_WIDE 前缀，写回时按实际距离选择宽度，
+// 因此即使不做改写（-O0）也要解码并写回一次
+
+int optimizeLevel = 1;
+
+typedef struct
+{
+    /** 在原字节码中的位置，操作数从这里复制 */
+    int offset;
+    /** 改写后的长度 */
+    int length;
+    /** 改写后的操作码，不含 OP_WIDE 前缀 */
+    uint8_t op;
+    /** 带 OP_WIDE 前缀；跳转指令的宽度在写回时重新选择 */
+    bool wide;
+    /** 跳转目标的指令下标，非跳转指令为 -1 */
+    int target;
+    /** OP_POPN 的操作数 */
+    int popCount;
+    /** 有多少条未删除的跳转指向这里 */
+    int targetCount;
+    /** 前后相邻的未删除指令，没有时为 -1；删除后保留删除时的值 */
+    int previous;
+    int next;
+    bool removed;
+} Instruction;
+
+typedef struct
+{
+    Chunk *chunk;
+    Instruction *code;
+    int count;
+} Optimizer;
+
+static inline bool isJump(uint8_t op)
+{
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_POP_JUMP_IF_FALSE || op == OP_LOOP;
+}
+
+/** 执行后不会落到下一条指令 */
+static inline bool isTerminator(uint8_t op)
+{
+    return op == OP_JUMP || op == OP_LOOP || op == OP_RETURN;
+}
+
+/** @return 下一条未删除的指令，没有时返回 -1 */
+static inline int nextLive(Optimizer *optimizer, int index)
+{
+    return optimizer->code[index].next;
+}
+
+static inline int previousLive(Optimizer *optimizer, int index)
+{
+    return optimizer->code[index].previous;
+}
+
+/** 标记删除并从相邻链表中摘除，不处理跳转引用 */
+static void unlinkInstruction(Optimizer *optimizer, int index)
+{
+    Instruction *instruction = &optimizer->code[index];
+    if (instruction->previous != -1)
+        optimizer->code[instruction->previous].next = instruction->next;
+    if (instruction->next != -1)
+        optimizer->code[instruction->next].previous = instruction->previous;
+    instruction->removed = true;
+}
+
+/**
+ * 解码字节码并解析跳转目标
+ * @return 跳转没有落在指令起点时返回 false，放弃优化
+ */
+static bool decode(Optimizer *optimizer)
+{
+    Chunk *chunk = optimizer->chunk;
+    int *indices = (int *)malloc(sizeof(int) * (chunk->count + 1));
+    optimizer->code = (Instruction *)malloc(sizeof(Instruction) * chunk->count);
+    if (indices == NULL || optimizer->code == NULL)
+    {
+        free(indices);
+        return false;
+    }
+
+    for (int offset = 0; offset <= chunk->count; offset++)
+        indices[offset] = -1;
+
+    int count = 0;
+    for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset))
+    {
+        Instruction *instruction = &optimizer->code[count];
+        instruction->offset = offset;
+        instruction->length = instructionLength(chunk, offset);
+        instruction->wide = chunk->code[offset] == OP_WIDE;
+        instruction->op = chunk->code[instruction->wide ? offset + 1 : offset];
+        instruction->target = -1;
+        instruction->popCount = 0;
+        instruction->targetCount = 0;
+        instruction->previous = count - 1;
+        instruction->next = count + 1;
+        instruction->removed = false;
+        indices[offset] = count++;
+    }
+    optimizer->count = count;
+    if (count > 0)
+        optimizer->code[count - 1].next = -1;
+
+    bool valid = true;
+    for (int i = 0; i < count && valid; i++)
+    {
+        Instruction *instruction = &optimizer->code[i];
+        if (!isJump(instruction->op))
+            continue;
+
+        int offset = instruction->offset;
+        int end = offset + instruction->length;
+        int jump = instruction->wide ? readWideOperand(chunk, offset + 2)
+                                     : (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+        int target = instruction->op == OP_LOOP ? end - jump : end + jump;
+        if (target < 0 || target >= chunk->count || indices[target] == -1)
+            valid = false;
+        else
+            instruction->target = indices[target];
+    }
+
+    free(indices);
+    return valid;
+}
+
+/** 删除指令，删除的是跳转时同时撤销它对目标的引用 */
+static void removeInstruction(Optimizer *optimizer, int index)
+{
+    Instruction *instruction = &optimizer->code[index];
+    if (instruction->target != -1)
+        optimizer->code[instruction->target].targetCount--;
+    instruction->target = -1;
+    unlinkInstruction(optimizer, index);
+}
+
+static void retarget(Optimizer *optimizer, int index, int target)
+{
+    Instruction *instruction = &optimizer->code[index];
+    optimizer->code[instruction->target].targetCount--;
+    optimizer->code[target].targetCount++;
+    instruction->target = target;
+}
+
+/**
+ * 从第一条指令出发沿顺序执行与跳转标记可达的指令，删除其余指令，并重新统计跳转目标
+ * @return 是否删除了指令
+ */
+static bool removeUnreachable(Optimizer *optimizer)
+{
+    int count = optimizer->count;
+    bool *reached = (bool *)calloc(count, sizeof(bool));
+    int *worklist = (int *)malloc(sizeof(int) * count);
+    if (reached == NULL || worklist == NULL)
+    { // 内存不足时保守地认为全部可达
+        free(reached);
+        free(worklist);
+        return false;
+    }
+
+    int top = 0;
+    worklist[top++] = 0;
+    reached[0] = true;
+    while (top > 0)
+    {
+        int index = worklist[--top];
+        Instruction *instruction = &optimizer->code[index];
+        int successors[2] = {instruction->target, isTerminator(instruction->op) ? -1 : nextLive(optimizer, index)};
+        for (int i = 0; i < 2; i++)
+        {
+            int successor = successors[i];
+            if (successor != -1 && !reached[successor])
+            {
+                reached[successor] = true;
+                worklist[top++] = successor;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (int i = 0; i < count; i++)
+    {
+        optimizer->code[i].targetCount = 0;
+        if (!optimizer->code[i].removed && !reached[i])
+        {
+            unlinkInstruction(optimizer, i);
+            optimizer->code[i].target = -1;
+            changed = true;
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        Instruction *instruction = &optimizer->code[i];
+        if (!instruction->removed && instruction->target != -1)
+            optimizer->code[instruction->target].targetCount++;
+    }
+
+    free(reached);
+    free(worklist);
+    return changed;
+}
+
+/**
+ * 跳转到无条件跳转时直接跳到最终目标（向后的 OP_LOOP 只在最终目标仍在其前时改写）；
+ * 跳转到下一条指令时删除
+ */
+static bool simplifyJump(Optimizer *optimizer, int index)
+{
+    Instruction *instruction = &optimizer->code[index];
+    bool changed = false;
+
+    int target = instruction->target;
+    for (int hops = 0; optimizer->code[target].op == OP_JUMP && hops < 8; hops++)
+        target = optimizer->code[target].target;
+    if (target != instruction->target && (instruction->op != OP_LOOP || target < index))
+    {
+        retarget(optimizer, index, target);
+        changed = true;
+    }
+
+    if (instruction->op != OP_LOOP && instruction->target == nextLive(optimizer, index))
+    {
+        if (instruction->op == OP_POP_JUMP_IF_FALSE)
+        { // 两条路径都只是弹出条件
+            optimizer->code[instruction->target].targetCount--;
+            instruction->op = OP_POP;
+            instruction->wide = false;
+            instruction->length = 1;
+            instruction->target = -1;
+        }
+        else
+        {
+            removeInstruction(optimizer, index);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+/**
+ * if/while/for 的条件在两个分支上各有一条 OP_POP：
+ * OP_JUMP_IF_FALSE L; OP_POP; ... L: OP_POP
+ * 当 L 只能从这条跳转到达时，改为 OP_POP_JUMP_IF_FALSE 并删除两条 OP_POP
+ */
+static bool fuseConditionPop(Optimizer *optimizer, int index)
+{
+    Instruction *instruction = &optimizer->code[index];
+    int next = nextLive(optimizer, index);
+    int landing = instruction->target;
+    if (next == -1 || next == landing)
+        return false;
+
+    Instruction *fallthrough = &optimizer->code[next];
+    Instruction *branch = &optimizer->code[landing];
+    int before = previousLive(optimizer, landing);
+    int after = nextLive(optimizer, landing);
+    if (fallthrough->op != OP_POP || fallthrough->targetCount != 0 ||
+        branch->op != OP_POP || branch->targetCount != 1 ||
+        before == -1 || !isTerminator(optimizer->code[before].op) || after == -1)
+        return false;
+
+    instruction->op = OP_POP_JUMP_IF_FALSE;
+    retarget(optimizer, index, after);
+    removeInstruction(optimizer, next);
+    removeInstruction(optimizer, landing);
+    return true;
+}
+
+/** 索引操作数，带前缀时为 3 字节 */
+static int operandOf(Chunk *chunk, Instruction *instruction)
+{
+    return instruction->wide ? readWideOperand(chunk, instruction->offset + 2) : chunk->code[instruction->offset + 1];
+}
+
+/** 赋值表达式语句后紧接着读取同一变量：SET x; OP_POP; GET x 只需保留 SET x */
+static bool removeReload(Optimizer *optimizer, int index)
+{
+    Instruction *instruction = &optimizer->code[index];
+    uint8_t getOp;
+    switch (instruction->op)
+    {
+    case OP_SET_LOCAL:
+        getOp = OP_GET_LOCAL;
+        break;
+    case OP_SET_UPVALUE:
+        getOp = OP_GET_UPVALUE;
+        break;
+    case OP_SET_GLOBAL:
+        getOp = OP_GET_GLOBAL;
+        break;
+    default:
+        return false;
+    }
+
+    int pop = nextLive(optimizer, index);
+    int get = pop != -1 ? nextLive(optimizer, pop) : -1;
+    if (get == -1)
+        return false;
+
+    Chunk *chunk = optimizer->chunk;
+    Instruction *popInstruction = &optimizer->code[pop];
+    Instruction *getInstruction = &optimizer->code[get];
+    if (popInstruction->op != OP_POP || popInstruction->targetCount != 0 ||
+        getInstruction->op != getOp || getInstruction->targetCount != 0)
+        return false;
+
+    if (operandOf(chunk, instruction) != operandOf(chunk, getInstruction))
+        return false; // 同名的全局变量共用一个常量
+
+    removeInstruction(optimizer, pop);
+    removeInstruction(optimizer, get);
+    return true;
+}
+
+/** 作用域结束时连续的 OP_POP 合并为一条 OP_POPN */
+static void mergePops(Optimizer *optimizer)
+{
+    for (int i = 0; i < optimizer->count; i++)
+    {
+        Instruction *instruction = &optimizer->code[i];
+        if (instruction->removed || instruction->op != OP_POP)
+            continue;
+
+        int count = 1;
+        for (int next = nextLive(optimizer, i); next != -1 && count < UINT8_MAX; next = nextLive(optimizer, next))
+        {
+            Instruction *pop = &optimizer->code[next];
+            if (pop->op != OP_POP || pop->targetCount != 0)
+                break;
+            unlinkInstruction(optimizer, next); // 摘除后 next 仍指向其后的指令，循环可以继续
+            count++;
+        }
+
+        if (count > 1)
+        {
+            instruction->op = OP_POPN;
+            instruction->length = 2;
+            instruction->popCount = count;
+        }
+    }
+}
+
+/** 按各指令当前的长度计算位置，返回总长度 */
+static int layout(Optimizer *optimizer, int *positions)
+{
+    int position = 0;
+    for (int i = 0; i < optimizer->count; i++)
+    {
+        positions[i] = position;
+        if (!optimizer->code[i].removed)
+            position += optimizer->code[i].length;
+    }
+    return position;
+}
+
+/**
+ * 跳转先按 2 字节偏移排布，放不下的改为带前缀的 3 字节偏移后重新排布，直到不再变化
+ * 指令只会变长，距离随之单调增加，因此必然终止
+ */
+static int sizeJumps(Optimizer *optimizer, int *positions)
+{
+    for (int i = 0; i < optimizer->count; i++)
+    {
+        Instruction *instruction = &optimizer->code[i];
+        if (isJump(instruction->op))
+        {
+            instruction->wide = false;
+            instruction->length = 3;
+        }
+    }
+
+    for (;;)
+    {
+        int size = layout(optimizer, positions);
+        bool changed = false;
+        for (int i = 0; i < optimizer->count; i++)
+        {
+            Instruction *instruction = &optimizer->code[i];
+            if (instruction->removed || !isJump(instruction->op) || instruction->wide)
+                continue;
+
+            int from = positions[i] + instruction->length;
+            int target = positions[instruction->target];
+            int jump = instruction->op == OP_LOOP ? from - target : target - from;
+            if (jump > UINT16_MAX)
+            {
+                instruction->wide = true;
+                instruction->length = 5;
+                changed = true;
+            }
+        }
+        if (!changed)
+            return size;
+    }
+}
+
+/** 按新位置写回字节码与行号 */
+static void encode(Optimizer *optimizer)
+{
+    Chunk *chunk = optimizer->chunk;
+    int *positions = (int *)malloc(sizeof(int) * optimizer->count);
+    if (positions == NULL)
+        return; // 解码前的字节码仍然完整
+
+    int size = sizeJumps(optimizer, positions);
+    uint8_t *code = (uint8_t *)malloc(size > 0 ? size : 1);
+    int *lines = (int *)malloc(sizeof(int) * optimizer->count); // 每条指令的行号
+    if (code == NULL || lines == NULL)
+    {
+        free(code);
+        free(lines);
+        free(positions);
+        return;
+    }
+
+    for (int i = 0; i < optimizer->count; i++)
+    {
+        Instruction *instruction = &optimizer->code[i];
+        if (instruction->removed)
+            continue;
+
+        int at = positions[i];
+        lines[i] = getLine(chunk, instruction->offset);
+        if (isJump(instruction->op))
+        {
+            int from = at + instruction->length;
+            int target = positions[instruction->target];
+            int jump = instruction->op == OP_LOOP ? from - target : target - from;
+            if (instruction->wide)
+            {
+                code[at] = OP_WIDE;
+                code[at + 1] = instruction->op;
+                code[at + 2] = (jump >> 16) & 0xff;
+                code[at + 3] = (jump >> 8) & 0xff;
+                code[at + 4] = jump & 0xff;
+            }
+            else
+            {
+                code[at] = instruction->op;
+                code[at + 1] = (jump >> 8) & 0xff;
+                code[at + 2] = jump & 0xff;
+            }
+        }
+        else if (instruction->op == OP_POPN)
+        {
+            code[at] = OP_POPN;
+            code[at + 1] = (uint8_t)instruction->popCount;
+        }
+        else
+        { // 其余改写只产生单字节指令，带前缀的指令原样复制
+            memcpy(code + at, chunk->code + instruction->offset, instruction->length);
+            if (!instruction->wide)
+                code[at] = instruction->op;
+        }
+    }
+
+    if (size > chunk->capacity)
+    { // 跳转改道后可能需要更长的偏移，总长度偶尔超过原字节码
+        chunk->code = GROW_ARRAY(uint8_t, chunk->code, chunk->capacity, size);
+        chunk->capacity = size;
+    }
+    memcpy(chunk->code, code, size);
+    chunk->count = size;
+
+    chunk->lineCount = 0; // 按新位置重建行号表，项数不会多于原表
+    for (int i = 0; i < optimizer->count; i++)
+        if (!optimizer->code[i].removed)
+            markLine(chunk, positions[i], lines[i]);
+
+    free(code);
+    free(lines);
+    free(positions);
+}
+
+/**
+ * 对编译完成的字节码做窥孔优化并选择跳转宽度，调用方保证字节码没有编译错误
+ * optimizeLevel 为 0 时只选择跳转宽度
+ */
+void optimizeChunk(Chunk *chunk)
+{
+    if (chunk->count == 0)
+        return;
+
+    Optimizer optimizer = {chunk, NULL, 0};
+    if (!decode(&optimizer))
+    {
+        free(optimizer.code);
+        return;
+    }
+
+    bool changed = optimizeLevel > 0;
+    while (changed)
+    {
+        changed = removeUnreachable(&optimizer);
+        for (int i = 0; i < optimizer.count; i++)
+        {
+            Instruction *instruction = &optimizer.code[i];
+            if (instruction->removed)
+                continue;
+
+            if (isJump(instruction->op) && simplifyJump(&optimizer, i))
+                changed = true;
+            if (!instruction->removed && instruction->op == OP_JUMP_IF_FALSE && fuseConditionPop(&optimizer, i))
+                changed = true;
+            if (removeReload(&optimizer, i))
+                changed = true;
+        }
+    }
+
+    if (optimizeLevel > 0)
+        mergePops(&optimizer);
+    encode(&optimizer);
+    free(optimizer.code);
+}
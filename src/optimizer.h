@@ -0,0 +1,11 @@
+#ifndef loxj_optimizer_h
+#define loxj_optimizer_h
+
+#include "chunk.h"
+
+/** 优化级别：0 不优化（仍按距离选择跳转宽度），1（默认）在每个函数编译结束时做窥孔优化 */
+extern int optimizeLevel;
+
+void optimizeChunk(Chunk *chunk);
+
+#endif
@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 200809L // fileno
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "vm.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+static char buffer[OUTPUT_BUFFER];
+static OutputMode mode = OUTPUT_LINE;
+static bool initialized = false;
+
+/** 显式刷新模式下尚未写出的输出，stdout 的缓冲区满时也不写出 */
+static char *pending = NULL;
+static size_t pendingCount = 0;
+static size_t pendingCapacity = 0;
+
+/** 将 pending 交给 stdout，不刷新 */
+static void writePending()
+{
+    fwrite(pending, 1, pendingCount, stdout);
+    pendingCount = 0;
+}
+
+/** 为 pending 预留 length 字节，内存不足时先写出已有内容 */
+static bool reservePending(size_t length)
+{
+    if (pendingCount + length <= pendingCapacity)
+        return true;
+
+    size_t capacity = pendingCapacity < OUTPUT_BUFFER ? OUTPUT_BUFFER : pendingCapacity;
+    while (capacity < pendingCount + length)
+        capacity *= 2;
+    char *grown = (char *)realloc(pending, capacity);
+    if (grown == NULL)
+    {
+        writePending();
+        return false;
+    }
+    pending = grown;
+    pendingCapacity = capacity;
+    return true;
+}
+
+/**
+ * 为 stdout 设置全缓冲，刷新时机由 mode 决定
+ * setvbuf 必须在首次输出前调用，因此只在第一次 initVM 时生效
+ */
+void initOutput()
+{
+    if (initialized)
+        return;
+    initialized = true;
+
+    setvbuf(stdout, buffer, _IOFBF, OUTPUT_BUFFER);
+    mode = isatty(fileno(stdout)) ? OUTPUT_LINE : OUTPUT_BLOCK;
+}
+
+void setOutputMode(OutputMode newMode)
+{
+    if (mode == OUTPUT_EXPLICIT)
+        writePending();
+    mode = newMode;
+    if (mode == OUTPUT_LINE)
+        fflush(stdout);
+}
+
+/** print / echo 的输出经由此处写出 */
+void writeOutput(const char *chars, size_t length)
+{
+    if (mode == OUTPUT_EXPLICIT && reservePending(length))
+    {
+        memcpy(pending + pendingCount, chars, length);
+        pendingCount += length;
+        return;
+    }
+    fwrite(chars, 1, length, stdout);
+}
+
+void printOutput(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (mode != OUTPUT_EXPLICIT)
+    {
+        vfprintf(stdout, format, args);
+        va_end(args);
+        return;
+    }
+
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length >= 0 && reservePending((size_t)length + 1)) // vsnprintf 另写结尾的 '\0'
+    {
+        vsnprintf(pending + pendingCount, (size_t)length + 1, format, args);
+        pendingCount += (size_t)length;
+    }
+    else if (length >= 0)
+    {
+        vfprintf(stdout, format, args);
+    }
+    va_end(args);
+}
+
+/** 退出、报告运行时错误与执行外部命令前调用，保证输出顺序 */
+void flushOutput()
+{
+    if (pendingCount > 0)
+        writePending();
+    fflush(stdout);
+}
+
+/** print / echo 结束时调用，行缓冲模式下刷新 */
+void flushLine()
+{
+    if (mode == OUTPUT_LINE)
+        fflush(stdout);
+}
+
+/** flush()：立即写出缓冲区 */
+static Value flushNative(int argCount, Value *args)
+{
+    flushOutput();
+    return NIL_VAL;
+}
+
+/** outputMode(mode)：设置刷新策略 "line"、"block" 或 "explicit"，返回之前的策略，参数无效时不改变 */
+static Value outputModeNative(int argCount, Value *args)
+{
+    static const char *names[] = {"line", "block", "explicit"};
+    Value previous = copyStringValue(names[mode], (int)strlen(names[mode]));
+    if (argCount == 0 || !IS_STRING(args[0]))
+        return previous;
+
+    char chars[SMALL_STRING_BUFFER];
+    int length;
+    const char *name = stringChars(args[0], chars, &length);
+    if (length == 4 && memcmp(name, "line", 4) == 0)
+        setOutputMode(OUTPUT_LINE);
+    else if (length == 5 && memcmp(name, "block", 5) == 0)
+        setOutputMode(OUTPUT_BLOCK);
+    else if (length == 8 && memcmp(name, "explicit", 8) == 0)
+        setOutputMode(OUTPUT_EXPLICIT);
+    return previous;
+}
+
+void loadOutputNatives()
+{
+    defineNative("flush", flushNative);
+    defineNative("outputMode", outputModeNative);
+}
@@ -0,0 +1,30 @@
+#ifndef loxj_output_h
+#define loxj_output_h
+
+#include "common.h"
+
+// 标准输出的缓冲层：print 与 echo 写入用户态缓冲区，按刷新策略批量写出
+
+/** 输出缓冲区大小 */
+#define OUTPUT_BUFFER (64 * 1024)
+
+typedef enum
+{
+    /** 每条 print / 每次 echo 后刷新，标准输出为终端时的默认值 */
+    OUTPUT_LINE,
+    /** 仅在缓冲区满、调用 flush() 或退出时刷新，标准输出为文件或管道时的默认值 */
+    OUTPUT_BLOCK,
+    /** 仅在调用 flush() 或退出时刷新，缓冲区按需增长 */
+    OUTPUT_EXPLICIT,
+} OutputMode;
+
+void initOutput();
+void setOutputMode(OutputMode mode);
+void writeOutput(const char *chars, size_t length);
+void printOutput(const char *format, ...);
+void flushOutput();
+void flushLine();
+
+void loadOutputNatives();
+
+#endif
@@ -17,6 +17,9 @@
 // 更好的IEEE754支持，包括 +-Infinity
 // 实现 i++ i-- 操作符
 
+/** 模板字符串插值的最大嵌套层数 */
+#define TEMPLATE_NESTING_MAX 8
+
 typedef struct
 {
     /** 指向当前词素起点 */
@@ -25,6 +28,10 @@ typedef struct
     const char *current;
     /** 行号 */
     int line;
+    /** 当前所在的模板字符串插值层数 */
+    int templateDepth;
+    /** 每层插值中尚未闭合的 { 数量，遇到未配对的 } 即回到模板文本 */
+    int braceDepth[TEMPLATE_NESTING_MAX];
 } Scanner;
 
 // 注意目前使用全局变量
@@ -35,6 +42,14 @@ void initScanner(const char *source)
     scanner.start = source;
     scanner.current = source;
     scanner.line = 1;
+    scanner.templateDepth = 0;
+}
+
+/** 从源码中间的 position 处（第 line 行）继续扫描，用于编译预解析过的函数体 */
+void initScannerAt(const char *position, int line)
+{
+    initScanner(position);
+    scanner.line = line;
 }
 
 //
@@ -158,6 +173,54 @@ static Token errorToken(const char *message)
 }
 
 #ifdef LOXJ_OPTIONS_ESCAPE
+/**
+ * @return 转义序列 \c 表示的字符，不支持的转义返回 '\0'
+ */
+static char escapeChar(char c)
+{
+    switch (c)
+    {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case '\\':
+    case '"':
+    case '`':
+    case '$':
+        return c;
+    default:
+        return '\0';
+    }
+}
+
+/**
+ * 复制 src 并处理转义，token.start 指向 malloc 分配的字符串
+ */
+static Token unescapedToken(TokenType type, const char *src, int srcLen, int escapeCount)
+{
+    int len = srcLen - escapeCount;
+    char *unescaped = (char *)malloc(len + 2); // 请注意这里分配了内存
+    char *dst = unescaped;
+    unescaped[len] = '\0';
+
+    for (int i = 0; i < srcLen; i++)
+    {
+        if (src[i] == '\\')
+            *dst = escapeChar(src[++i]);
+        else
+            *dst = src[i];
+        dst++;
+    }
+
+    Token token;
+    token.type = type;         // TOKEN_STRING 或模板字符串片段
+    token.start = unescaped;   // 其 start 指向的字符串
+    token.length = len;        // 所有权移交给调用方
+    token.line = scanner.line; // 因此调用方必须负责管理其内存
+    return token;              // 参见 takeStringFromToken 辅助函数
+}
+
 static Token stringToken()
 {
     int escapeCount = 0;
@@ -169,18 +232,10 @@ static Token stringToken()
         if (peek() == '\\' && !isAtEnd())
         {
             advance(); // skip the backslash
-            switch (peek())
-            {
-            case 'n':
-            case 't':
-            case '\\':
-            case '"':
-                escapeCount++;
-                advance(); // skip
-                break;
-            default:
+            if (escapeChar(peek()) == '\0')
                 return errorToken("Unsupported escape sequences.");
-            }
+            escapeCount++;
+            advance(); // skip
         }
         else
         {
@@ -194,46 +249,7 @@ static Token stringToken()
     advance(); // Consume the closing quote
 
     int srcLen = (int)(scanner.current - scanner.start) - 2;
-    int len = srcLen - escapeCount;
-    char *unescaped = (char *)malloc(len + 2); // 请注意这里分配了内存
-    char *dst = unescaped;
-    unescaped[len] = '\0';
-
-    for (int i = 0; i < srcLen; i++)
-    {
-        if (src[i] == '\\')
-        {
-            switch (src[++i])
-            {
-            case 't':
-                *dst = '\t';
-                break;
-            case 'n':
-                *dst = '\n';
-                break;
-            case '"':
-                *dst = '"';
-                break;
-            case '\\':
-                *dst = '\\';
-                break;
-            default:
-                break; // unreachable
-            }
-        }
-        else
-        {
-            *dst = src[i];
-        }
-        dst++;
-    }
-
-    Token token;
-    token.type = TOKEN_STRING; // scanner 保证 TOKEN_STRING 标识符
-    token.start = unescaped;   // 其 start 指向的字符串
-    token.length = len;        // 所有权移交给调用方
-    token.line = scanner.line; // 因此调用方必须负责管理其内存
-    return token;              // 参见 takeStringFromToken 辅助函数
+    return unescapedToken(TOKEN_STRING, src, srcLen, escapeCount);
 }
 #else
 static Token stringToken()
@@ -253,6 +269,57 @@ static Token stringToken()
 }
 #endif
 
+/**
+ * 模板字符串 `text ${expression} text`
+ * 扫描一段文本，直到结束的反引号（TOKEN_TEMPLATE）或插值开头的 ${（TOKEN_TEMPLATE_PART）
+ * 调用时 scanner.current 位于开头的反引号或结束插值的 } 之后
+ * 与字符串不同，词素只包含文本本身，不含两端的定界符
+ */
+static Token templateToken()
+{
+    int escapeCount = 0;
+    const char *src = scanner.current;
+    while (peek() != '`' && !(peek() == '$' && peekNext() == '{') && !isAtEnd())
+    {
+        if (peek() == '\n')
+            scanner.line++;
+#ifdef LOXJ_OPTIONS_ESCAPE
+        if (peek() == '\\')
+        {
+            advance(); // skip the backslash
+            if (escapeChar(peek()) == '\0')
+                return errorToken("Unsupported escape sequences.");
+            escapeCount++;
+        }
+#endif
+        advance();
+    }
+
+    if (isAtEnd())
+        return errorToken("Unterminated template string.");
+
+    int srcLen = (int)(scanner.current - src);
+    TokenType type = TOKEN_TEMPLATE;
+    if (!match('`'))
+    {
+        advance(); // $
+        advance(); // {
+        if (scanner.templateDepth == TEMPLATE_NESTING_MAX)
+            return errorToken("Template string nested too deeply.");
+        scanner.braceDepth[scanner.templateDepth++] = 0;
+        type = TOKEN_TEMPLATE_PART;
+    }
+
+#ifdef LOXJ_OPTIONS_ESCAPE
+    return unescapedToken(type, src, srcLen, escapeCount);
+#else
+    Token token = makeToken(type);
+    token.start = src;
+    token.length = srcLen;
+    return token;
+#endif
+}
+
 /*
 number         = integer [fraction] ; 整数部分后可选小数部分
 integer        = 1*DIGIT            ; 一个或多个数字
@@ -402,9 +469,24 @@ Token scanToken()
     case ')':
         return makeToken(TOKEN_RIGHT_PAREN);
     case '{':
+        if (scanner.templateDepth > 0)
+            scanner.braceDepth[scanner.templateDepth - 1]++;
         return makeToken(TOKEN_LEFT_BRACE);
     case '}':
+        if (scanner.templateDepth > 0)
+        {
+            if (scanner.braceDepth[scanner.templateDepth - 1] == 0)
+            { // 插值结束，继续扫描模板文本
+                scanner.templateDepth--;
+                return templateToken();
+            }
+            scanner.braceDepth[scanner.templateDepth - 1]--;
+        }
         return makeToken(TOKEN_RIGHT_BRACE);
+    case '[':
+        return makeToken(TOKEN_LEFT_BRACKET);
+    case ']':
+        return makeToken(TOKEN_RIGHT_BRACKET);
     case ';':
         return makeToken(TOKEN_SEMICOLON);
     case ',':
@@ -447,6 +529,8 @@ Token scanToken()
     }
     case '"':
         return stringToken();
+    case '`':
+        return templateToken();
     case '&':
         return makeToken(match('&') ? TOKEN_AND : TOKEN_BITWISE_AND);
     case '|':
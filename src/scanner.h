@@ -8,6 +8,8 @@ typedef enum
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACE,
     TOKEN_RIGHT_BRACE,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
     TOKEN_COMMA,
     TOKEN_DOT,
     TOKEN_MINUS,
@@ -28,6 +30,8 @@ typedef enum
     TOKEN_IDENTIFIER,
     TOKEN_STRING,
     TOKEN_NUMBER,
+    TOKEN_TEMPLATE_PART, // `text${ 或 }text${，其后是插值表达式
+    TOKEN_TEMPLATE,      // `text` 或 }text`，模板字符串结束
     // Keywords
     TOKEN_CLASS,
     TOKEN_ELSE,
@@ -73,6 +77,7 @@ typedef struct
 } Token;
 
 void initScanner(const char *sourceCode);
+void initScannerAt(const char *position, int line);
 Token scanToken();
 Token syntheticToken(const char *text);
 
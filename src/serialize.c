@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200809L // getpid
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serialize.h"
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#elif !defined(__wasi__)
+#include <unistd.h>
+#endif
+
+//
+// 写出
+//
+
+void writeBytes(Writer *writer, const void *bytes, size_t length)
+{
+    if (writer->failed)
+        return;
+
+    if (length > writer->capacity - writer->count)
+    {
+        size_t capacity = writer->capacity < 256 ? 256 : writer->capacity;
+        while (capacity - writer->count < length)
+            capacity *= 2;
+        uint8_t *grown = (uint8_t *)realloc(writer->bytes, capacity);
+        if (grown == NULL)
+        {
+            writer->failed = true;
+            return;
+        }
+        writer->bytes = grown;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->bytes + writer->count, bytes, length);
+    writer->count += length;
+}
+
+void writeByte(Writer *writer, uint8_t byte)
+{
+    writeBytes(writer, &byte, 1);
+}
+
+void writeU32(Writer *writer, uint32_t value)
+{
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+void writeU64(Writer *writer, uint64_t value)
+{
+    writeU32(writer, (uint32_t)value);
+    writeU32(writer, (uint32_t)(value >> 32));
+}
+
+/** 改写 position 处已写出的 u32，用于先占位后回填的长度 */
+void patchU32(Writer *writer, size_t position, uint32_t value)
+{
+    if (writer->failed)
+        return;
+    for (int i = 0; i < 4; i++)
+        writer->bytes[position + i] = (uint8_t)(value >> (8 * i));
+}
+
+/** u32 长度与字节，适用于各种字符串值 */
+void writeString(Writer *writer, Value string)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(string, buffer, &length);
+    writeU32(writer, (uint32_t)length);
+    writeBytes(writer, chars, (size_t)length);
+}
+
+/**
+ * 将缓冲区写入文件并释放缓冲区
+ * 先写入同目录的临时文件再改名，其他进程（或已映射旧文件的进程）不会读到写了一半的文件
+ * @return 此前的写出失败或写入文件失败时返回 false
+ */
+bool saveWriter(Writer *writer, const char *path)
+{
+    size_t size = strlen(path) + 32;
+    char *temporaryPath = (char *)malloc(size);
+    bool written = false;
+    if (!writer->failed && temporaryPath != NULL)
+    {
+#ifdef __wasi__
+        snprintf(temporaryPath, size, "%s.tmp", path);
+#else
+        snprintf(temporaryPath, size, "%s.%ld.tmp", path, (long)getpid()); // 并发写入同一文件的进程互不干扰
+#endif
+        FILE *file = fopen(temporaryPath, "wb");
+        if (file != NULL)
+        {
+            written = fwrite(writer->bytes, 1, writer->count, file) == writer->count;
+            written = fclose(file) == 0 && written;
+            if (written && rename(temporaryPath, path) != 0)
+            { // Windows 上目标已存在时 rename 失败
+                remove(path);
+                written = rename(temporaryPath, path) == 0;
+            }
+            if (!written)
+                remove(temporaryPath);
+        }
+    }
+    free(temporaryPath);
+    free(writer->bytes);
+    writer->bytes = NULL;
+    writer->count = writer->capacity = 0;
+    return written;
+}
+
+//
+// 读取
+//
+
+/** @return 剩余字节不足 length 时返回 NULL */
+const uint8_t *readSpan(Reader *reader, size_t length)
+{
+    if (length > reader->size - reader->position)
+        return NULL;
+    const uint8_t *span = reader->bytes + reader->position;
+    reader->position += length;
+    return span;
+}
+
+bool readU32(Reader *reader, uint32_t *value)
+{
+    const uint8_t *bytes = readSpan(reader, 4);
+    if (bytes == NULL)
+        return false;
+    *value = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return true;
+}
+
+bool readU64(Reader *reader, uint64_t *value)
+{
+    uint32_t low, high;
+    if (!readU32(reader, &low) || !readU32(reader, &high))
+        return false;
+    *value = (uint64_t)high << 32 | low;
+    return true;
+}
+
+/** 读取 writeString 写出的字符串，chars 指向映射内部，不以 NUL 结尾 */
+bool readString(Reader *reader, const char **chars, int *length)
+{
+    uint32_t size;
+    if (!readU32(reader, &size) || size > INT32_MAX)
+        return false;
+    *chars = (const char *)readSpan(reader, size);
+    *length = (int)size;
+    return *chars != NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef loxj_serialize_h
+#define loxj_serialize_h
+
+#include "common.h"
+#include "object.h"
+
+// 字节码文件与堆快照共用的读写原语，整数均为小端
+
+/** 写出缓冲区，全部内容生成后一次写入文件 */
+typedef struct
+{
+    uint8_t *bytes;
+    size_t count;
+    size_t capacity;
+    /** 内存不足或遇到无法写出的内容，此后的写入均被忽略 */
+    bool failed;
+} Writer;
+
+/** 读取映射的文件，每次读取都检查剩余字节数 */
+typedef struct
+{
+    const uint8_t *bytes;
+    size_t size;
+    size_t position;
+    /** 文件的映射，引用其内容的字符串视图的持有者 */
+    ObjFileData *file;
+} Reader;
+
+void writeBytes(Writer *writer, const void *bytes, size_t length);
+void writeByte(Writer *writer, uint8_t byte);
+void writeU32(Writer *writer, uint32_t value);
+void writeU64(Writer *writer, uint64_t value);
+void patchU32(Writer *writer, size_t position, uint32_t value);
+void writeString(Writer *writer, Value string);
+bool saveWriter(Writer *writer, const char *path);
+
+const uint8_t *readSpan(Reader *reader, size_t length);
+bool readU32(Reader *reader, uint32_t *value);
+bool readU64(Reader *reader, uint64_t *value);
+bool readString(Reader *reader, const char **chars, int *length);
+
+#endif
@@ -0,0 +1,677 @@
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 浮点内核在 AVX2 下每次处理 4 个 double，SSE2 下 2 个
+// 整数内核使用 SSE2（AVX2 目标同样支持），每次处理 16 字节
+// AVX2 内核以 target 属性单独编译，不需要 -mavx2，运行时按 CPU 是否支持选用；
+// AVX2 部分处理整块之后，剩余部分依次交给 SSE2 与标量循环
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+
+/** CPU 是否支持 AVX2，第一次调用时检测 */
+static bool hasAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") != 0;
+    }
+    return supported;
+#endif
+}
+#endif
+
+#if defined(__SSE2__) || defined(SIMD_AVX2)
+/** movemask 结果中第一个置位的位置，mask 不为 0 */
+static inline int firstSetBit(int mask)
+{
+    return __builtin_ctz((unsigned)mask);
+}
+#endif
+
+//
+// Float64
+//
+
+#if defined(SIMD_AVX2)
+/** @return 处理过的元素个数，部分和写入 sum */
+AVX2_TARGET static int sumF64Avx2(const double *data, int length, double *sum)
+{
+    int i = 0;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd(); // 两路累加，隐藏加法延迟
+    for (; i + 8 <= length; i += 8)
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(data + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(data + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    *sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+}
+#endif
+
+double simdSumF64(const double *data, int length)
+{
+    int i = 0;
+    double sum = 0;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        i = sumF64Avx2(data, length, &sum);
+#endif
+#if defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    for (; i + 4 <= length; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(data + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum += lanes[0] + lanes[1];
+#endif
+    for (; i < length; i++)
+        sum += data[i];
+    return sum;
+}
+
+#if defined(SIMD_AVX2)
+AVX2_TARGET static int dotF64Avx2(const double *a, const double *b, int length, double *sum)
+{
+    int i = 0;
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= length; i += 8)
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    *sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    return i;
+}
+#endif
+
+double simdDotF64(const double *a, const double *b, int length)
+{
+    int i = 0;
+    double sum = 0;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        i = dotF64Avx2(a, b, length, &sum);
+#endif
+#if defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    for (; i + 4 <= length; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum += lanes[0] + lanes[1];
+#endif
+    for (; i < length; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/**
+ * 同时求最小值与最大值，NaN 元素被忽略
+ * 空数组（或全为 NaN）得到 min = Infinity, max = -Infinity
+ */
+#if defined(SIMD_AVX2)
+/** @return 处理过的元素个数，lo 与 hi 按其中的元素更新 */
+AVX2_TARGET static int rangeF64Avx2(const double *data, int length, double *lo, double *hi)
+{
+    int i = 0;
+    __m256d vlo = _mm256_set1_pd(INFINITY), vhi = _mm256_set1_pd(-INFINITY);
+    for (; i + 4 <= length; i += 4)
+    {
+        __m256d x = _mm256_loadu_pd(data + i);
+        vlo = _mm256_min_pd(x, vlo); // 任一操作数为 NaN 时返回第二个操作数，即忽略 NaN
+        vhi = _mm256_max_pd(x, vhi);
+    }
+    double lows[4], highs[4];
+    _mm256_storeu_pd(lows, vlo);
+    _mm256_storeu_pd(highs, vhi);
+    for (int k = 0; k < 4; k++)
+    {
+        if (lows[k] < *lo)
+            *lo = lows[k];
+        if (highs[k] > *hi)
+            *hi = highs[k];
+    }
+    return i;
+}
+#endif
+
+void simdRangeF64(const double *data, int length, double *min, double *max)
+{
+    int i = 0;
+    double lo = INFINITY, hi = -INFINITY;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        i = rangeF64Avx2(data, length, &lo, &hi);
+#endif
+#if defined(__SSE2__)
+    __m128d vlo = _mm_set1_pd(INFINITY), vhi = _mm_set1_pd(-INFINITY);
+    for (; i + 2 <= length; i += 2)
+    {
+        __m128d x = _mm_loadu_pd(data + i);
+        vlo = _mm_min_pd(x, vlo);
+        vhi = _mm_max_pd(x, vhi);
+    }
+    double lows[2], highs[2];
+    _mm_storeu_pd(lows, vlo);
+    _mm_storeu_pd(highs, vhi);
+    for (int k = 0; k < 2; k++)
+    {
+        if (lows[k] < lo)
+            lo = lows[k];
+        if (highs[k] > hi)
+            hi = highs[k];
+    }
+#endif
+    for (; i < length; i++)
+    {
+        if (data[i] < lo)
+            lo = data[i];
+        if (data[i] > hi)
+            hi = data[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+#if defined(SIMD_AVX2)
+AVX2_TARGET static int scaleF64Avx2(double *data, int length, double factor)
+{
+    int i = 0;
+    __m256d k = _mm256_set1_pd(factor);
+    for (; i + 4 <= length; i += 4)
+        _mm256_storeu_pd(data + i, _mm256_mul_pd(_mm256_loadu_pd(data + i), k));
+    return i;
+}
+#endif
+
+void simdScaleF64(double *data, int length, double factor)
+{
+    int i = 0;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        i = scaleF64Avx2(data, length, factor);
+#endif
+#if defined(__SSE2__)
+    __m128d k = _mm_set1_pd(factor);
+    for (; i + 2 <= length; i += 2)
+        _mm_storeu_pd(data + i, _mm_mul_pd(_mm_loadu_pd(data + i), k));
+#endif
+    for (; i < length; i++)
+        data[i] *= factor;
+}
+
+#if defined(SIMD_AVX2)
+AVX2_TARGET static int addF64Avx2(double *data, const double *other, int length)
+{
+    int i = 0;
+    for (; i + 4 <= length; i += 4)
+        _mm256_storeu_pd(data + i, _mm256_add_pd(_mm256_loadu_pd(data + i), _mm256_loadu_pd(other + i)));
+    return i;
+}
+#endif
+
+void simdAddF64(double *data, const double *other, int length)
+{
+    int i = 0;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        i = addF64Avx2(data, other, length);
+#endif
+#if defined(__SSE2__)
+    for (; i + 2 <= length; i += 2)
+        _mm_storeu_pd(data + i, _mm_add_pd(_mm_loadu_pd(data + i), _mm_loadu_pd(other + i)));
+#endif
+    for (; i < length; i++)
+        data[i] += other[i];
+}
+
+#if defined(SIMD_AVX2)
+/**
+ * @param next 输出处理过的元素个数
+ * @return 找到的位置，没有返回 -1
+ */
+AVX2_TARGET static int indexOfF64Avx2(const double *data, int length, double value, int *next)
+{
+    int i = 0;
+    __m256d target = _mm256_set1_pd(value);
+    for (; i + 4 <= length; i += 4)
+    {
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), target, _CMP_EQ_OQ));
+        if (mask != 0)
+            return i + firstSetBit(mask);
+    }
+    *next = i;
+    return -1;
+}
+#endif
+
+/** @return 第一个等于 value 的位置，没有（包括 value 为 NaN）返回 -1 */
+int simdIndexOfF64(const double *data, int length, double value)
+{
+    int i = 0;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+    {
+        int found = indexOfF64Avx2(data, length, value, &i);
+        if (found != -1)
+            return found;
+    }
+#endif
+#if defined(__SSE2__)
+    __m128d target = _mm_set1_pd(value);
+    for (; i + 2 <= length; i += 2)
+    {
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), target));
+        if (mask != 0)
+            return i + firstSetBit(mask);
+    }
+#endif
+    for (; i < length; i++)
+    {
+        if (data[i] == value)
+            return i;
+    }
+    return -1;
+}
+
+//
+// Int32
+//
+
+int64_t simdSumI32(const int32_t *data, int length)
+{
+    int i = 0;
+    int64_t sum = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128(); // 两路 int64 累加，避免溢出
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i sign = _mm_srai_epi32(x, 31); // 符号扩展到 64 位
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < length; i++)
+        sum += data[i];
+    return sum;
+}
+
+void simdRangeI32(const int32_t *data, int length, int32_t *min, int32_t *max)
+{
+    int i = 0;
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+#if defined(__SSE2__)
+    // SSE2 没有 32 位整数 min/max，以比较结果作掩码选择
+    __m128i vlo = _mm_set1_epi32(INT32_MAX), vhi = _mm_set1_epi32(INT32_MIN);
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i less = _mm_cmplt_epi32(x, vlo);
+        vlo = _mm_or_si128(_mm_and_si128(less, x), _mm_andnot_si128(less, vlo));
+        __m128i greater = _mm_cmpgt_epi32(x, vhi);
+        vhi = _mm_or_si128(_mm_and_si128(greater, x), _mm_andnot_si128(greater, vhi));
+    }
+    int32_t lows[4], highs[4];
+    _mm_storeu_si128((__m128i *)lows, vlo);
+    _mm_storeu_si128((__m128i *)highs, vhi);
+    for (int k = 0; k < 4; k++)
+    {
+        if (lows[k] < lo)
+            lo = lows[k];
+        if (highs[k] > hi)
+            hi = highs[k];
+    }
+#endif
+    for (; i < length; i++)
+    {
+        if (data[i] < lo)
+            lo = data[i];
+        if (data[i] > hi)
+            hi = data[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+/** 按 32 位回绕相加 */
+void simdAddI32(int32_t *data, const int32_t *other, int length)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(other + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_add_epi32(x, y));
+    }
+#endif
+    for (; i < length; i++)
+        data[i] = (int32_t)((uint32_t)data[i] + (uint32_t)other[i]);
+}
+
+int simdIndexOfI32(const int32_t *data, int length, int32_t value)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i target = _mm_set1_epi32(value);
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(x, target));
+        if (mask != 0)
+            return i + firstSetBit(mask) / 4;
+    }
+#endif
+    for (; i < length; i++)
+    {
+        if (data[i] == value)
+            return i;
+    }
+    return -1;
+}
+
+//
+// Uint8
+//
+
+uint64_t simdSumU8(const uint8_t *data, int length)
+{
+    int i = 0;
+    uint64_t sum = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= length; i += 16)
+    { // psadbw 将 16 个字节横向求和为两个 64 位整数
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(x, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < length; i++)
+        sum += data[i];
+    return sum;
+}
+
+void simdRangeU8(const uint8_t *data, int length, uint8_t *min, uint8_t *max)
+{
+    int i = 0;
+    uint8_t lo = UINT8_MAX, hi = 0;
+#if defined(__SSE2__)
+    __m128i vlo = _mm_set1_epi8((char)UINT8_MAX), vhi = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        vlo = _mm_min_epu8(vlo, x);
+        vhi = _mm_max_epu8(vhi, x);
+    }
+    uint8_t lows[16], highs[16];
+    _mm_storeu_si128((__m128i *)lows, vlo);
+    _mm_storeu_si128((__m128i *)highs, vhi);
+    for (int k = 0; k < 16; k++)
+    {
+        if (lows[k] < lo)
+            lo = lows[k];
+        if (highs[k] > hi)
+            hi = highs[k];
+    }
+#endif
+    for (; i < length; i++)
+    {
+        if (data[i] < lo)
+            lo = data[i];
+        if (data[i] > hi)
+            hi = data[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+/** 按 8 位回绕相加 */
+void simdAddU8(uint8_t *data, const uint8_t *other, int length)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(other + i));
+        _mm_storeu_si128((__m128i *)(data + i), _mm_add_epi8(x, y));
+    }
+#endif
+    for (; i < length; i++)
+        data[i] = (uint8_t)(data[i] + other[i]);
+}
+
+int simdIndexOfU8(const uint8_t *data, int length, uint8_t value)
+{
+    if (length == 0)
+        return -1;
+    // C 库的 memchr 本身已向量化
+    const uint8_t *hit = memchr(data, value, length);
+    return hit == NULL ? -1 : (int)(hit - data);
+}
+
+//
+// 字符串搜索
+//
+
+#if defined(SIMD_AVX2)
+/**
+ * simdFind 的 AVX2 部分，needleLength >= 2
+ * @param next 输入为起点，输出为尚未检查的第一个起点
+ * @return 找到的位置，没有返回 -1
+ */
+AVX2_TARGET static int findAvx2(const char *haystack, int last, const char *needle, int needleLength, int *next)
+{
+    int i = *next;
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i final = _mm256_set1_epi8(needle[needleLength - 1]);
+    for (; i + 32 <= last + 1; i += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i blockFinal = _mm256_loadu_si256((const __m256i *)(haystack + i + needleLength - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockFinal, final)));
+        while (mask != 0)
+        {
+            int offset = firstSetBit((int)mask);
+            if (memcmp(haystack + i + offset + 1, needle + 1, needleLength - 2) == 0)
+                return i + offset;
+            mask &= mask - 1;
+        }
+    }
+    *next = i;
+    return -1;
+}
+#endif
+
+/**
+ * 从 from 开始查找 needle（needleLength > 0）首次出现的位置，没有返回 -1
+ * 向量路径一次比较一整块候选起点的首字节与末字节，两者都匹配的位置才用 memcmp 验证中间部分
+ */
+int simdFind(const char *haystack, int length, int from, const char *needle, int needleLength)
+{
+    int last = length - needleLength; // 最后一个可能的起点
+    if (from > last)
+        return -1;
+    if (needleLength == 1)
+    {
+        const char *hit = memchr(haystack + from, needle[0], length - from);
+        return hit == NULL ? -1 : (int)(hit - haystack);
+    }
+
+    int i = from;
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+    {
+        int found = findAvx2(haystack, last, needle, needleLength, &i);
+        if (found != -1)
+            return found;
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i final = _mm_set1_epi8(needle[needleLength - 1]);
+    for (; i + 16 <= last + 1; i += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i blockFinal = _mm_loadu_si128((const __m128i *)(haystack + i + needleLength - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockFinal, final)));
+        while (mask != 0)
+        {
+            int offset = firstSetBit((int)mask);
+            if (memcmp(haystack + i + offset + 1, needle + 1, needleLength - 2) == 0)
+                return i + offset;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i <= last)
+    {
+        const char *hit = memchr(haystack + i, needle[0], last - i + 1);
+        if (hit == NULL)
+            return -1;
+        i = (int)(hit - haystack);
+        if (memcmp(hit, needle, needleLength) == 0)
+            return i;
+        i++;
+    }
+    return -1;
+}
+
+//
+// JSON
+//
+
+#if defined(__SSE2__)
+/** 16 字节的分类位图，依次为引号、反斜杠、结构字符 {}[]:, 与空白 */
+static inline void classifyJson16(const char *chars, uint64_t masks[4], int shift)
+{
+    __m128i block = _mm_loadu_si128((const __m128i *)chars);
+    __m128i folded = _mm_or_si128(block, _mm_set1_epi8(0x20)); // '[' ']' 折叠为 '{' '}'
+
+    __m128i quote = _mm_cmpeq_epi8(block, _mm_set1_epi8('"'));
+    __m128i backslash = _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'));
+    __m128i operators = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(':')), _mm_cmpeq_epi8(block, _mm_set1_epi8(','))));
+    __m128i whitespace = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+
+    masks[0] |= (uint64_t)(uint16_t)_mm_movemask_epi8(quote) << shift;
+    masks[1] |= (uint64_t)(uint16_t)_mm_movemask_epi8(backslash) << shift;
+    masks[2] |= (uint64_t)(uint16_t)_mm_movemask_epi8(operators) << shift;
+    masks[3] |= (uint64_t)(uint16_t)_mm_movemask_epi8(whitespace) << shift;
+}
+#endif
+
+/**
+ * 对 64 字节分类，第 i 位对应 chars[i]
+ * @param masks 输出：引号、反斜杠、结构字符 {}[]:, 与空白
+ */
+void simdClassifyJson(const char *chars, uint64_t masks[4])
+{
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+#if defined(__SSE2__)
+    for (int i = 0; i < 64; i += 16)
+        classifyJson16(chars + i, masks, i);
+#else
+    for (int i = 0; i < 64; i++)
+    {
+        uint64_t bit = 1ULL << i;
+        switch (chars[i])
+        {
+        case '"':
+            masks[0] |= bit;
+            break;
+        case '\\':
+            masks[1] |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            masks[2] |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            masks[3] |= bit;
+            break;
+        }
+    }
+#endif
+}
+
+#if defined(SIMD_AVX2)
+AVX2_TARGET static uint64_t matchMaskAvx2(const char *chars, char c)
+{
+    __m256i target = _mm256_set1_epi8(c);
+    uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)chars), target));
+    uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(chars + 32)), target));
+    return low | (high << 32);
+}
+#endif
+
+/** 64 字节中等于 c 的位置，第 i 位对应 chars[i] */
+uint64_t simdMatchMask(const char *chars, char c)
+{
+#if defined(SIMD_AVX2)
+    if (hasAvx2())
+        return matchMaskAvx2(chars, c);
+#endif
+#if defined(__SSE2__)
+    __m128i target = _mm_set1_epi8(c);
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(chars + i));
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, target)) << i;
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (chars[i] == c)
+            mask |= 1ULL << i;
+    }
+    return mask;
+#endif
+}
@@ -0,0 +1,32 @@
+#ifndef loxj_simd_h
+#define loxj_simd_h
+
+#include "common.h"
+
+// 类型化数组的批量运算内核
+// x86 上 AVX2 内核在运行时按 CPU 是否支持选用，其余部分使用 SSE2（编译目标支持时），否则退化为标量循环，结果语义一致
+// 浮点求和、点积的累加顺序因向量宽度而异，舍入误差可能与标量循环略有不同
+
+double simdSumF64(const double *data, int length);
+double simdDotF64(const double *a, const double *b, int length);
+void simdRangeF64(const double *data, int length, double *min, double *max);
+void simdScaleF64(double *data, int length, double factor);
+void simdAddF64(double *data, const double *other, int length);
+int simdIndexOfF64(const double *data, int length, double value);
+
+int64_t simdSumI32(const int32_t *data, int length);
+void simdRangeI32(const int32_t *data, int length, int32_t *min, int32_t *max);
+void simdAddI32(int32_t *data, const int32_t *other, int length);
+int simdIndexOfI32(const int32_t *data, int length, int32_t value);
+
+uint64_t simdSumU8(const uint8_t *data, int length);
+void simdRangeU8(const uint8_t *data, int length, uint8_t *min, uint8_t *max);
+void simdAddU8(uint8_t *data, const uint8_t *other, int length);
+int simdIndexOfU8(const uint8_t *data, int length, uint8_t value);
+
+int simdFind(const char *haystack, int length, int from, const char *needle, int needleLength);
+
+void simdClassifyJson(const char *chars, uint64_t masks[4]);
+uint64_t simdMatchMask(const char *chars, char c);
+
+#endif
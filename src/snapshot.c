@@ -0,0 +1,955 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "array.h"
+#include "builder.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "file.h"
+#include "memory.h"
+#include "object.h"
+#include "serialize.h"
+#include "vm.h"
+
+// 堆快照：运行前导脚本之后，从全局变量出发可达的全部对象（类、闭包、函数、驻留字符串、容器等）
+// 文件布局，整数均为小端：
+//   文件头    "LXSN" | u32 快照版本 | u32 字节码版本 | u32 操作码个数 | u32 对象个数
+//   对象记录  u32 记录长度 | u8 记录类型 | 内容，按对象序号排列
+//   全局变量  u32 个数 | (u32 名称的序号, 值)...
+//   值        u8 标记 | 数值为 u64 位模式，对象为 u32 序号，短字符串与视图按内容内联
+// 记录按类型排序，使构造对象时引用的对象（类名、闭包的函数、实例的类）序号更小：
+// 恢复时第一遍按序分配全部对象，第二遍填入相互引用，序号经重定位表（序号到新地址）换成指针
+// native 按全局名称保存；视图恢复为字符串，类型化数组恢复为自有缓冲区，字符串构建器不保留 toString 缓存
+
+#define SNAPSHOT_MAGIC "LXSN"
+/** 对象引用的特殊值：没有名称的函数 */
+#define NO_OBJECT UINT32_MAX
+
+/** 对象记录的类型，排列顺序即构造时的依赖顺序 */
+typedef enum
+{
+    RECORD_STRING,
+    RECORD_NATIVE,
+    RECORD_FUNCTION,
+    RECORD_UPVALUE,
+    RECORD_ARRAY,
+    RECORD_MAP,
+    RECORD_SET,
+    RECORD_TYPED_ARRAY,
+    RECORD_STRING_BUILDER,
+    RECORD_BOUND_METHOD,
+    /** 依赖类名 */
+    RECORD_CLASS,
+    /** 依赖函数 */
+    RECORD_CLOSURE,
+    /** 依赖类 */
+    RECORD_INSTANCE,
+    RECORD_KIND_COUNT
+} RecordKind;
+
+typedef enum
+{
+    VALUE_NIL,
+    VALUE_FALSE,
+    VALUE_TRUE,
+    VALUE_NUMBER,
+    /** 短字符串或视图，按内容保存 */
+    VALUE_STRING,
+    VALUE_OBJECT,
+} ValueTag;
+
+//
+// 写出
+//
+
+typedef struct
+{
+    Writer writer;
+    /** 按发现顺序排列的对象，同时用作遍历的队列 */
+    Obj **objects;
+    int count;
+    int capacity;
+    /** 对象地址到发现顺序的开放寻址表，容量为 2 的幂 */
+    Obj **keys;
+    int *positions;
+    int tableCapacity;
+    /** 发现顺序到对象序号 */
+    uint32_t *indices;
+    /** 遇到无法保存的对象时置为原因 */
+    const char *error;
+} SnapshotWriter;
+
+static inline uint32_t hashPointer(Obj *object)
+{
+    uint64_t bits = (uint64_t)(uintptr_t)object;
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+/** @return 对象的发现顺序，尚未发现时返回 -1 */
+static int findObject(SnapshotWriter *snapshot, Obj *object)
+{
+    if (snapshot->tableCapacity == 0)
+        return -1;
+    uint32_t mask = (uint32_t)snapshot->tableCapacity - 1;
+    for (uint32_t slot = hashPointer(object) & mask;; slot = (slot + 1) & mask)
+    {
+        if (snapshot->keys[slot] == NULL)
+            return -1;
+        if (snapshot->keys[slot] == object)
+            return snapshot->positions[slot];
+    }
+}
+
+static void insertObject(SnapshotWriter *snapshot, Obj *object, int position)
+{
+    uint32_t mask = (uint32_t)snapshot->tableCapacity - 1;
+    uint32_t slot = hashPointer(object) & mask;
+    while (snapshot->keys[slot] != NULL)
+        slot = (slot + 1) & mask;
+    snapshot->keys[slot] = object;
+    snapshot->positions[slot] = position;
+}
+
+static void discoverObject(SnapshotWriter *snapshot, Obj *object)
+{
+    if (object == NULL || snapshot->error != NULL || findObject(snapshot, object) >= 0)
+        return;
+
+    if (snapshot->count + 1 > snapshot->capacity)
+    {
+        int capacity = GROW_CAPACITY(snapshot->capacity);
+        Obj **objects = (Obj **)realloc(snapshot->objects, sizeof(Obj *) * capacity);
+        if (objects == NULL)
+        {
+            snapshot->error = "out of memory";
+            return;
+        }
+        snapshot->objects = objects;
+        snapshot->capacity = capacity;
+    }
+    if ((snapshot->count + 1) * 2 > snapshot->tableCapacity)
+    { // 负载因子不超过 0.5，扩容后重新插入
+        int tableCapacity = snapshot->tableCapacity < 64 ? 64 : snapshot->tableCapacity * 2;
+        Obj **keys = (Obj **)calloc((size_t)tableCapacity, sizeof(Obj *));
+        int *positions = (int *)malloc(sizeof(int) * tableCapacity);
+        if (keys == NULL || positions == NULL)
+        {
+            free(keys);
+            free(positions);
+            snapshot->error = "out of memory";
+            return;
+        }
+        free(snapshot->keys);
+        free(snapshot->positions);
+        snapshot->keys = keys;
+        snapshot->positions = positions;
+        snapshot->tableCapacity = tableCapacity;
+        for (int i = 0; i < snapshot->count; i++)
+            insertObject(snapshot, snapshot->objects[i], i);
+    }
+
+    snapshot->objects[snapshot->count] = object;
+    insertObject(snapshot, object, snapshot->count);
+    snapshot->count++;
+}
+
+/** 视图与短字符串按内容内联，不作为对象记录 */
+static void discoverValue(SnapshotWriter *snapshot, Value value)
+{
+    if (IS_OBJ(value) && !IS_STRING_VIEW(value))
+        discoverObject(snapshot, AS_OBJ(value));
+}
+
+static void discoverTable(SnapshotWriter *snapshot, Table *table)
+{
+    for (int i = 0; i < table->capacity; i++)
+    {
+        Entry *entry = &table->entries[i];
+        if (entry->key == NULL)
+            continue;
+        discoverObject(snapshot, (Obj *)entry->key);
+        discoverValue(snapshot, entry->value);
+    }
+}
+
+static void discoverValueTable(SnapshotWriter *snapshot, ValueTable *table)
+{
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (!entry->live)
+            continue;
+        discoverValue(snapshot, entry->key);
+        discoverValue(snapshot, entry->value);
+    }
+}
+
+/** 发现 object 引用的对象 */
+static void discoverReferences(SnapshotWriter *snapshot, Obj *object)
+{
+    switch (object->type)
+    {
+    case OBJ_FUNCTION:
+    {
+        ObjFunction *function = (ObjFunction *)object;
+        if (function->lazy != NULL && !compileLazyFunction(function))
+        { // 延迟编译的函数体先编译，所有对象均可由全局变量到达，编译时的回收不影响已发现的对象
+            snapshot->error = "function body does not compile";
+            break;
+        }
+        discoverObject(snapshot, (Obj *)function->name);
+        for (int i = 0; i < function->chunk.constants.count; i++)
+            discoverValue(snapshot, function->chunk.constants.values[i]);
+        break;
+    }
+    case OBJ_CLOSURE:
+    {
+        ObjClosure *closure = (ObjClosure *)object;
+        discoverObject(snapshot, (Obj *)closure->function);
+        for (int i = 0; i < closure->upvalueCount; i++)
+            discoverObject(snapshot, (Obj *)closure->upvalues[i]);
+        break;
+    }
+    case OBJ_UPVALUE:
+    {
+        ObjUpvalue *upvalue = (ObjUpvalue *)object;
+        if (upvalue->location != &upvalue->closed)
+            snapshot->error = "open upvalue"; // 前导脚本运行结束后不应有开放上值
+        else
+            discoverValue(snapshot, upvalue->closed);
+        break;
+    }
+    case OBJ_CLASS:
+        discoverObject(snapshot, (Obj *)((ObjClass *)object)->name);
+        discoverTable(snapshot, &((ObjClass *)object)->methods);
+        break;
+    case OBJ_INSTANCE:
+        discoverObject(snapshot, (Obj *)((ObjInstance *)object)->klass);
+        discoverTable(snapshot, &((ObjInstance *)object)->fields);
+        break;
+    case OBJ_BOUND_METHOD:
+        discoverValue(snapshot, ((ObjBoundMethod *)object)->receiver);
+        discoverObject(snapshot, (Obj *)((ObjBoundMethod *)object)->method);
+        break;
+    case OBJ_ARRAY:
+    {
+        ValueArray *values = &((ObjArray *)object)->values;
+        for (int i = 0; i < values->count; i++)
+            discoverValue(snapshot, values->values[i]);
+        break;
+    }
+    case OBJ_MAP:
+        discoverValueTable(snapshot, &((ObjMap *)object)->table);
+        break;
+    case OBJ_SET:
+        discoverValueTable(snapshot, &((ObjSet *)object)->table);
+        break;
+    case OBJ_NATIVE:
+        if (nativeName(((ObjNative *)object)->function) == NULL)
+            snapshot->error = "native without a global name";
+        break;
+    case OBJ_FILE_DATA:
+    case OBJ_STRING_VIEW:
+        snapshot->error = "unsupported object"; // 不会作为值出现
+        break;
+    default:
+        break;
+    }
+}
+
+static RecordKind recordKind(Obj *object)
+{
+    switch (object->type)
+    {
+    case OBJ_STRING:
+        return RECORD_STRING;
+    case OBJ_NATIVE:
+        return RECORD_NATIVE;
+    case OBJ_FUNCTION:
+        return RECORD_FUNCTION;
+    case OBJ_UPVALUE:
+        return RECORD_UPVALUE;
+    case OBJ_ARRAY:
+        return RECORD_ARRAY;
+    case OBJ_MAP:
+        return RECORD_MAP;
+    case OBJ_SET:
+        return RECORD_SET;
+    case OBJ_TYPED_ARRAY:
+        return RECORD_TYPED_ARRAY;
+    case OBJ_STRING_BUILDER:
+        return RECORD_STRING_BUILDER;
+    case OBJ_BOUND_METHOD:
+        return RECORD_BOUND_METHOD;
+    case OBJ_CLASS:
+        return RECORD_CLASS;
+    case OBJ_CLOSURE:
+        return RECORD_CLOSURE;
+    default:
+        return RECORD_INSTANCE;
+    }
+}
+
+static void writeReference(SnapshotWriter *snapshot, Obj *object)
+{
+    writeU32(&snapshot->writer, object == NULL ? NO_OBJECT : snapshot->indices[findObject(snapshot, object)]);
+}
+
+static void writeValue(SnapshotWriter *snapshot, Value value)
+{
+    Writer *writer = &snapshot->writer;
+    if (IS_NIL(value))
+        writeByte(writer, VALUE_NIL);
+    else if (IS_BOOL(value))
+        writeByte(writer, AS_BOOL(value) ? VALUE_TRUE : VALUE_FALSE);
+    else if (IS_NUMBER(value))
+    {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        writeByte(writer, VALUE_NUMBER);
+        writeU64(writer, bits);
+    }
+    else if (IS_OBJ(value) && !IS_STRING_VIEW(value))
+    {
+        writeByte(writer, VALUE_OBJECT);
+        writeReference(snapshot, AS_OBJ(value));
+    }
+    else
+    {
+        writeByte(writer, VALUE_STRING);
+        writeString(writer, value);
+    }
+}
+
+static void writeTable(SnapshotWriter *snapshot, Table *table)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < table->capacity; i++)
+        count += table->entries[i].key != NULL;
+    writeU32(&snapshot->writer, count);
+    for (int i = 0; i < table->capacity; i++)
+    {
+        Entry *entry = &table->entries[i];
+        if (entry->key == NULL)
+            continue;
+        writeReference(snapshot, (Obj *)entry->key);
+        writeValue(snapshot, entry->value);
+    }
+}
+
+static void writeValueTable(SnapshotWriter *snapshot, ValueTable *table)
+{
+    writeU32(&snapshot->writer, (uint32_t)table->count);
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (!entry->live)
+            continue;
+        writeValue(snapshot, entry->key);
+        writeValue(snapshot, entry->value);
+    }
+}
+
+static void writeTypedArray(Writer *writer, ObjTypedArray *array)
+{
+    writeByte(writer, (uint8_t)array->kind);
+    writeU32(writer, (uint32_t)array->length);
+    for (int i = 0; i < array->length; i++)
+    {
+        switch (array->kind)
+        {
+        case TYPED_FLOAT64:
+        {
+            uint64_t bits;
+            memcpy(&bits, (double *)array->data + i, sizeof(bits));
+            writeU64(writer, bits);
+            break;
+        }
+        case TYPED_INT32:
+            writeU32(writer, (uint32_t)((int32_t *)array->data)[i]);
+            break;
+        case TYPED_UINT8:
+            writeByte(writer, ((uint8_t *)array->data)[i]);
+            break;
+        }
+    }
+}
+
+/** 写出一条对象记录，引用的对象均已编号 */
+static void writeRecord(SnapshotWriter *snapshot, Obj *object)
+{
+    Writer *writer = &snapshot->writer;
+    size_t start = writer->count;
+    writeU32(writer, 0); // 记录长度，写完后回填
+    writeByte(writer, (uint8_t)recordKind(object));
+
+    switch (object->type)
+    {
+    case OBJ_STRING:
+        writeString(writer, OBJ_VAL(object));
+        break;
+    case OBJ_NATIVE:
+    {
+        const char *name = nativeName(((ObjNative *)object)->function);
+        writeU32(writer, (uint32_t)strlen(name));
+        writeBytes(writer, name, strlen(name));
+        break;
+    }
+    case OBJ_FUNCTION:
+    {
+        ObjFunction *function = (ObjFunction *)object;
+        writeU32(writer, (uint32_t)function->arity);
+        writeU32(writer, (uint32_t)function->upvalueCount);
+        writeU32(writer, (uint32_t)function->slotCount);
+        writeReference(snapshot, (Obj *)function->name);
+        writeU32(writer, (uint32_t)function->chunk.constants.count);
+        for (int i = 0; i < function->chunk.constants.count; i++)
+            writeValue(snapshot, function->chunk.constants.values[i]);
+        writeChunkCode(writer, &function->chunk);
+        break;
+    }
+    case OBJ_UPVALUE:
+        writeValue(snapshot, ((ObjUpvalue *)object)->closed);
+        break;
+    case OBJ_ARRAY:
+    {
+        ValueArray *values = &((ObjArray *)object)->values;
+        writeU32(writer, (uint32_t)values->count);
+        for (int i = 0; i < values->count; i++)
+            writeValue(snapshot, values->values[i]);
+        break;
+    }
+    case OBJ_MAP:
+        writeValueTable(snapshot, &((ObjMap *)object)->table);
+        break;
+    case OBJ_SET:
+        writeValueTable(snapshot, &((ObjSet *)object)->table);
+        break;
+    case OBJ_TYPED_ARRAY:
+        writeTypedArray(writer, (ObjTypedArray *)object);
+        break;
+    case OBJ_STRING_BUILDER:
+    {
+        ObjStringBuilder *builder = (ObjStringBuilder *)object;
+        writeU32(writer, (uint32_t)builder->length);
+        writeBytes(writer, builder->chars, (size_t)builder->length);
+        break;
+    }
+    case OBJ_BOUND_METHOD:
+        writeValue(snapshot, ((ObjBoundMethod *)object)->receiver);
+        writeReference(snapshot, (Obj *)((ObjBoundMethod *)object)->method);
+        break;
+    case OBJ_CLASS:
+        writeReference(snapshot, (Obj *)((ObjClass *)object)->name);
+        writeTable(snapshot, &((ObjClass *)object)->methods);
+        break;
+    case OBJ_CLOSURE:
+    {
+        ObjClosure *closure = (ObjClosure *)object;
+        writeReference(snapshot, (Obj *)closure->function);
+        for (int i = 0; i < closure->upvalueCount; i++)
+            writeReference(snapshot, (Obj *)closure->upvalues[i]);
+        break;
+    }
+    case OBJ_INSTANCE:
+        writeReference(snapshot, (Obj *)((ObjInstance *)object)->klass);
+        writeTable(snapshot, &((ObjInstance *)object)->fields);
+        break;
+    default:
+        break;
+    }
+
+    patchU32(writer, start, (uint32_t)(writer->count - start - 4));
+}
+
+/** 按记录类型排序（计数排序，同类保持发现顺序）并编号 */
+static int *numberObjects(SnapshotWriter *snapshot)
+{
+    int *order = (int *)malloc(sizeof(int) * (snapshot->count + 1));
+    snapshot->indices = (uint32_t *)malloc(sizeof(uint32_t) * (snapshot->count + 1));
+    if (order == NULL || snapshot->indices == NULL)
+    {
+        free(order);
+        return NULL;
+    }
+
+    int starts[RECORD_KIND_COUNT + 1] = {0};
+    for (int i = 0; i < snapshot->count; i++)
+        starts[recordKind(snapshot->objects[i]) + 1]++;
+    for (int kind = 0; kind < RECORD_KIND_COUNT; kind++)
+        starts[kind + 1] += starts[kind];
+    for (int i = 0; i < snapshot->count; i++)
+    {
+        int index = starts[recordKind(snapshot->objects[i])]++;
+        snapshot->indices[i] = (uint32_t)index;
+        order[index] = i;
+    }
+    return order;
+}
+
+/**
+ * 将全局变量及其可达的对象写为堆快照，须在前导脚本运行结束（没有活动的调用帧）后调用
+ * 写出过程不分配 Lox 对象，不会触发 GC
+ * @param error 失败时置为原因
+ */
+bool writeSnapshot(const char *path, const char **error)
+{
+    SnapshotWriter snapshot = {{NULL, 0, 0, false}, NULL, 0, 0, NULL, NULL, 0, NULL, NULL};
+    discoverTable(&snapshot, &vm.globals);
+    for (int i = 0; i < snapshot.count && snapshot.error == NULL; i++)
+        discoverReferences(&snapshot, snapshot.objects[i]);
+
+    int *order = snapshot.error == NULL ? numberObjects(&snapshot) : NULL;
+    if (order != NULL)
+    {
+        Writer *writer = &snapshot.writer;
+        writeBytes(writer, SNAPSHOT_MAGIC, 4);
+        writeU32(writer, SNAPSHOT_VERSION);
+        writeU32(writer, BYTECODE_VERSION);
+        writeU32(writer, OP_WIDE + 1);
+        writeU32(writer, (uint32_t)snapshot.count);
+        for (int i = 0; i < snapshot.count; i++)
+            writeRecord(&snapshot, snapshot.objects[order[i]]);
+        writeTable(&snapshot, &vm.globals);
+        free(order);
+    }
+    else if (snapshot.error == NULL)
+        snapshot.error = "out of memory";
+
+    bool written = false;
+    if (snapshot.error == NULL)
+    {
+        written = saveWriter(&snapshot.writer, path);
+        if (!written)
+            snapshot.error = "cannot write file";
+    }
+    else
+        free(snapshot.writer.bytes);
+
+    free(snapshot.objects);
+    free(snapshot.keys);
+    free(snapshot.positions);
+    free(snapshot.indices);
+    *error = snapshot.error;
+    return written;
+}
+
+//
+// 恢复
+//
+
+typedef struct
+{
+    /** 重定位表：序号到恢复出的对象，恢复期间位于 vm 栈上，使已恢复的对象不被回收 */
+    ObjArray *objects;
+    /** 文件中的对象个数 */
+    uint32_t count;
+} SnapshotReader;
+
+static inline Obj *objectAt(SnapshotReader *snapshot, uint32_t index)
+{
+    return AS_OBJ(snapshot->objects->values.values[index]);
+}
+
+/**
+ * 读取对象引用，须指向 type 类型的对象且序号小于 limit
+ * @param nullable 是否接受 NO_OBJECT
+ */
+static bool readReference(SnapshotReader *snapshot, Reader *reader, ObjType type, uint32_t limit, bool nullable,
+                          Obj **object)
+{
+    uint32_t index;
+    if (!readU32(reader, &index))
+        return false;
+    if (index == NO_OBJECT && nullable)
+    {
+        *object = NULL;
+        return true;
+    }
+    if (index >= limit || objectAt(snapshot, index)->type != type)
+        return false;
+    *object = objectAt(snapshot, index);
+    return true;
+}
+
+/** 读取值，其中新建的字符串未被任何根引用，须在下一次分配之前保存或压栈 */
+static bool readValue(SnapshotReader *snapshot, Reader *reader, Value *value)
+{
+    const uint8_t *tag = readSpan(reader, 1);
+    if (tag == NULL)
+        return false;
+
+    switch (*tag)
+    {
+    case VALUE_NIL:
+        *value = NIL_VAL;
+        return true;
+    case VALUE_FALSE:
+        *value = BOOL_VAL(false);
+        return true;
+    case VALUE_TRUE:
+        *value = BOOL_VAL(true);
+        return true;
+    case VALUE_NUMBER:
+    {
+        uint64_t bits;
+        if (!readU64(reader, &bits))
+            return false;
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        *value = NUMBER_VAL(isnan(number) ? NAN : number); // 任意的 NaN 位模式在 NaN-boxing 下可能被当作对象
+        return true;
+    }
+    case VALUE_STRING:
+    {
+        const char *chars;
+        int length;
+        if (!readString(reader, &chars, &length))
+            return false;
+        *value = copyStringValue(chars, length);
+        return true;
+    }
+    case VALUE_OBJECT:
+    {
+        uint32_t index;
+        if (!readU32(reader, &index) || index >= snapshot->count || objectAt(snapshot, index)->type == OBJ_UPVALUE)
+            return false;
+        *value = OBJ_VAL(objectAt(snapshot, index));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/** 读取 (名称, 值) 对存入 table，methods 为真时值须是闭包 */
+static bool readTable(SnapshotReader *snapshot, Reader *reader, Table *table, bool methods)
+{
+    uint32_t count;
+    if (!readU32(reader, &count))
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Obj *key;
+        Value value;
+        if (!readReference(snapshot, reader, OBJ_STRING, snapshot->count, false, &key) ||
+            !readValue(snapshot, reader, &value) || (methods && !IS_CLOSURE(value)))
+            return false;
+        push(value);
+        tableSet(table, (ObjString *)key, value);
+        pop();
+    }
+    return true;
+}
+
+static bool readValueTable(SnapshotReader *snapshot, Reader *reader, ValueTable *table)
+{
+    uint32_t count;
+    if (!readU32(reader, &count))
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Value key, value;
+        if (!readValue(snapshot, reader, &key))
+            return false;
+        push(key);
+        bool valid = readValue(snapshot, reader, &value);
+        if (valid)
+        {
+            push(value);
+            valueTableSet(table, key, value);
+            pop();
+        }
+        pop();
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+static bool readValues(SnapshotReader *snapshot, Reader *reader, ValueArray *values)
+{
+    uint32_t count;
+    if (!readU32(reader, &count) || count > INT32_MAX)
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Value value;
+        if (!readValue(snapshot, reader, &value))
+            return false;
+        push(value);
+        writeValueArray(values, value);
+        pop();
+    }
+    return true;
+}
+
+static ObjTypedArray *readTypedArray(Reader *reader)
+{
+    const uint8_t *kind = readSpan(reader, 1);
+    uint32_t length;
+    if (kind == NULL || *kind > TYPED_UINT8 || !readU32(reader, &length) || length > INT32_MAX)
+        return NULL;
+    size_t size = typedArrayElementSize((TypedArrayKind)*kind);
+    const uint8_t *data = readSpan(reader, (size_t)length * size); // 元素均按小端保存，与 u32/u64 相同
+    if (data == NULL)
+        return NULL;
+
+    ObjTypedArray *array = newTypedArray((TypedArrayKind)*kind, (int)length);
+    Reader elements = {data, (size_t)length * size, 0, NULL};
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint32_t low;
+        uint64_t bits;
+        switch (array->kind)
+        {
+        case TYPED_FLOAT64:
+            readU64(&elements, &bits);
+            memcpy((double *)array->data + i, &bits, sizeof(bits));
+            break;
+        case TYPED_INT32:
+            readU32(&elements, &low);
+            ((int32_t *)array->data)[i] = (int32_t)low;
+            break;
+        case TYPED_UINT8:
+            ((uint8_t *)array->data)[i] = data[i];
+            break;
+        }
+    }
+    return array;
+}
+
+/**
+ * 第一遍：按记录分配对象并加入重定位表，只读取构造所需的内容
+ * 记录 index 构造时引用的对象序号须小于 index
+ */
+static Obj *allocateRecord(SnapshotReader *snapshot, Reader *record, uint32_t index)
+{
+    const uint8_t *kind = readSpan(record, 1);
+    if (kind == NULL)
+        return NULL;
+
+    const char *chars;
+    int length;
+    Obj *reference = NULL;
+    switch (*kind)
+    {
+    case RECORD_STRING:
+        return readString(record, &chars, &length) ? (Obj *)copyString(chars, length) : NULL;
+    case RECORD_NATIVE:
+    {
+        NativeFn function = readString(record, &chars, &length) ? findNative(chars, length) : NULL;
+        return function != NULL ? (Obj *)newNative(function) : NULL;
+    }
+    case RECORD_FUNCTION:
+    {
+        uint32_t arity, upvalueCount, slotCount;
+        if (!readU32(record, &arity) || !readU32(record, &upvalueCount) || !readU32(record, &slotCount) ||
+            !isValidFunctionShape(arity, upvalueCount, slotCount))
+            return NULL;
+        ObjFunction *function = newFunction();
+        function->arity = (int)arity;
+        function->upvalueCount = (int)upvalueCount;
+        function->slotCount = (int)slotCount;
+        return (Obj *)function;
+    }
+    case RECORD_UPVALUE:
+    {
+        ObjUpvalue *upvalue = newUpvalue(NULL);
+        upvalue->location = &upvalue->closed; // 已关闭
+        return (Obj *)upvalue;
+    }
+    case RECORD_ARRAY:
+        return (Obj *)newArray();
+    case RECORD_MAP:
+        return (Obj *)newMap();
+    case RECORD_SET:
+        return (Obj *)newSet();
+    case RECORD_TYPED_ARRAY:
+        return (Obj *)readTypedArray(record);
+    case RECORD_STRING_BUILDER:
+        return (Obj *)newStringBuilder(); // 内容在第二遍追加，届时构建器已在重定位表中
+    case RECORD_BOUND_METHOD:
+        return (Obj *)newBoundMethod(NIL_VAL, NULL);
+    case RECORD_CLASS:
+        if (!readReference(snapshot, record, OBJ_STRING, index, false, &reference))
+            return NULL;
+        return (Obj *)newClass((ObjString *)reference);
+    case RECORD_CLOSURE:
+        if (!readReference(snapshot, record, OBJ_FUNCTION, index, false, &reference))
+            return NULL;
+        return (Obj *)newClosure((ObjFunction *)reference);
+    case RECORD_INSTANCE:
+        if (!readReference(snapshot, record, OBJ_CLASS, index, false, &reference))
+            return NULL;
+        return (Obj *)newInstance((ObjClass *)reference);
+    default:
+        return NULL;
+    }
+}
+
+/** 第二遍：填入对象之间的引用，记录须恰好读完 */
+static bool fillRecord(SnapshotReader *snapshot, Reader *record, Obj *object)
+{
+    record->position = 1; // 记录类型
+    bool valid = true;
+    const char *chars;
+    int length;
+    Obj *reference = NULL;
+    switch (object->type)
+    {
+    case OBJ_STRING:
+        valid = readString(record, &chars, &length);
+        break;
+    case OBJ_NATIVE:
+        valid = readString(record, &chars, &length);
+        break;
+    case OBJ_FUNCTION:
+    {
+        ObjFunction *function = (ObjFunction *)object;
+        record->position += 12; // arity、upvalueCount、slotCount
+        valid = readReference(snapshot, record, OBJ_STRING, snapshot->count, true, &reference);
+        if (valid) // 失败时不写入，损坏的快照不能令存活的对象引用无效指针
+            function->name = (ObjString *)reference;
+        valid = valid && readValues(snapshot, record, &function->chunk.constants) &&
+                function->chunk.constants.count <= WIDE_OPERAND_MAX + 1 &&
+                readChunkCode(record, &function->chunk);
+        break;
+    }
+    case OBJ_UPVALUE:
+        valid = readValue(snapshot, record, &((ObjUpvalue *)object)->closed);
+        break;
+    case OBJ_ARRAY:
+        valid = readValues(snapshot, record, &((ObjArray *)object)->values);
+        break;
+    case OBJ_MAP:
+        valid = readValueTable(snapshot, record, &((ObjMap *)object)->table);
+        break;
+    case OBJ_SET:
+        valid = readValueTable(snapshot, record, &((ObjSet *)object)->table);
+        break;
+    case OBJ_TYPED_ARRAY:
+        record->position = record->size; // 第一遍已读完
+        break;
+    case OBJ_STRING_BUILDER:
+        valid = readString(record, &chars, &length);
+        if (valid)
+            builderAppend((ObjStringBuilder *)object, chars, length);
+        break;
+    case OBJ_BOUND_METHOD:
+    {
+        ObjBoundMethod *bound = (ObjBoundMethod *)object;
+        valid = readValue(snapshot, record, &bound->receiver) &&
+                readReference(snapshot, record, OBJ_CLOSURE, snapshot->count, false, &reference);
+        bound->method = valid ? (ObjClosure *)reference : NULL;
+        break;
+    }
+    case OBJ_CLASS:
+        record->position += 4; // 类名
+        valid = readTable(snapshot, record, &((ObjClass *)object)->methods, true);
+        break;
+    case OBJ_CLOSURE:
+    {
+        ObjClosure *closure = (ObjClosure *)object;
+        record->position += 4; // 函数
+        for (int i = 0; valid && i < closure->upvalueCount; i++)
+        {
+            valid = readReference(snapshot, record, OBJ_UPVALUE, snapshot->count, false, &reference);
+            if (valid)
+                closure->upvalues[i] = (ObjUpvalue *)reference;
+        }
+        break;
+    }
+    case OBJ_INSTANCE:
+        record->position += 4; // 类
+        valid = readTable(snapshot, record, &((ObjInstance *)object)->fields, false);
+        break;
+    default:
+        valid = false;
+        break;
+    }
+    return valid && record->position == record->size;
+}
+
+/** 取出下一条对象记录作为独立的 Reader */
+static bool nextRecord(Reader *reader, Reader *record)
+{
+    uint32_t length;
+    const uint8_t *bytes;
+    if (!readU32(reader, &length) || (bytes = readSpan(reader, length)) == NULL)
+        return false;
+    *record = (Reader){bytes, length, 0, NULL};
+    return true;
+}
+
+/**
+ * 映射堆快照并恢复其中的对象与全局变量，同名的全局变量（包括 native）被快照中的覆盖
+ * 须在 initVM 之后、运行脚本之前调用；失败时全局变量可能已部分恢复，调用方应放弃运行
+ * @param error 失败时置为原因
+ */
+bool restoreSnapshot(const char *path, const char **error)
+{
+    ObjFileData *file = loadPathData(path, false, true);
+    if (file == NULL)
+    {
+        *error = "cannot read file";
+        return false;
+    }
+
+    Reader reader = {(const uint8_t *)file->data, file->length, 0, file};
+    const uint8_t *magic = readSpan(&reader, 4);
+    uint32_t version, bytecodeVersion, opcodeCount, count;
+    if (magic == NULL || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 || !readU32(&reader, &version) ||
+        !readU32(&reader, &bytecodeVersion) || !readU32(&reader, &opcodeCount) || !readU32(&reader, &count))
+    {
+        pop();
+        *error = "not a snapshot file";
+        return false;
+    }
+    if (version != SNAPSHOT_VERSION || bytecodeVersion != BYTECODE_VERSION || opcodeCount != OP_WIDE + 1)
+    {
+        pop();
+        *error = "snapshot version mismatch";
+        return false;
+    }
+
+    SnapshotReader snapshot = {newArray(), 0};
+    push(OBJ_VAL(snapshot.objects));
+    size_t recordsStart = reader.position;
+    bool valid = count < INT32_MAX;
+    Reader record;
+    for (uint32_t i = 0; valid && i < count; i++)
+    {
+        Obj *object = nextRecord(&reader, &record) ? allocateRecord(&snapshot, &record, i) : NULL;
+        valid = object != NULL;
+        if (valid)
+        {
+            arrayPush(snapshot.objects, OBJ_VAL(object));
+            snapshot.count++;
+        }
+    }
+
+    reader.position = recordsStart;
+    for (uint32_t i = 0; valid && i < count; i++)
+        valid = nextRecord(&reader, &record) && fillRecord(&snapshot, &record, objectAt(&snapshot, i));
+
+    for (uint32_t i = 0; valid && i < count; i++)
+    { // 常量全部就位后才能校验字节码
+        Obj *object = objectAt(&snapshot, i);
+        valid = object->type != OBJ_FUNCTION || verifyFunction((ObjFunction *)object);
+    }
+
+    valid = valid && readTable(&snapshot, &reader, &vm.globals, false) && reader.position == reader.size;
+    pop(); // objects
+    pop(); // file
+    if (!valid)
+        *error = "corrupt snapshot";
+    return valid;
+}
@@ -0,0 +1,12 @@
+#ifndef loxj_snapshot_h
+#define loxj_snapshot_h
+
+#include "common.h"
+
+/** 堆快照的格式版本，对象记录的布局变化时递增 */
+#define SNAPSHOT_VERSION 1
+
+bool writeSnapshot(const char *path, const char **error);
+bool restoreSnapshot(const char *path, const char **error);
+
+#endif
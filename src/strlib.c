@@ -0,0 +1,412 @@
+#include <math.h>
+#include <string.h>
+
+#include "strlib.h"
+#include "object.h"
+#include "array.h"
+#include "simd.h"
+#include "vm.h"
+
+//
+// 字符串方法，args[0] 为接收者（短字符串、ObjString 或视图）
+// 位置均以字节计，子串通过 substringValue 构造，不复制字符
+//
+
+/**
+ * 读取位置参数：缺省或 nil 时取 fallback，NaN 取 0，小数向零截断
+ * @return 参数不是数字时返回 false
+ */
+static bool readPosition(int argCount, Value *args, int index, double fallback, double *position)
+{
+    if (index >= argCount || IS_NIL(args[index]))
+    {
+        *position = fallback;
+        return true;
+    }
+    if (!IS_NUMBER(args[index]))
+        return false;
+
+    double number = AS_NUMBER(args[index]);
+    *position = isnan(number) ? 0 : trunc(number);
+    return true;
+}
+
+static int clampPosition(double position, int length)
+{
+    if (position < 0)
+        return 0;
+    if (position > length)
+        return length;
+    return (int)position;
+}
+
+static int stringLength(Value string)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    stringChars(string, buffer, &length);
+    return length;
+}
+
+/** substring(start, end)：越界截断到 [0, length]，start 大于 end 时交换 */
+static Value substringNative(int argCount, Value *args)
+{
+    int length = stringLength(args[0]);
+    double start, end;
+    if (!readPosition(argCount, args, 1, 0, &start) || !readPosition(argCount, args, 2, length, &end))
+        return NIL_VAL;
+
+    int from = clampPosition(start, length);
+    int to = clampPosition(end, length);
+    if (from > to)
+    {
+        int swap = from;
+        from = to;
+        to = swap;
+    }
+    return substringValue(args[0], from, to - from);
+}
+
+/** slice(start, end)：负数位置从末尾倒数，end 不大于 start 时为空串 */
+static Value sliceNative(int argCount, Value *args)
+{
+    int length = stringLength(args[0]);
+    double start, end;
+    if (!readPosition(argCount, args, 1, 0, &start) || !readPosition(argCount, args, 2, length, &end))
+        return NIL_VAL;
+
+    int from = clampPosition(start < 0 ? start + length : start, length);
+    int to = clampPosition(end < 0 ? end + length : end, length);
+    return substringValue(args[0], from, to > from ? to - from : 0);
+}
+
+static inline bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/** trim()：去除首尾空白 */
+static Value trimNative(int argCount, Value *args)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(args[0], buffer, &length);
+
+    int from = 0;
+    int to = length;
+    while (from < to && isWhitespace(chars[from]))
+        from++;
+    while (to > from && isWhitespace(chars[to - 1]))
+        to--;
+    return substringValue(args[0], from, to - from);
+}
+
+/**
+ * 在 chars 中查找 pattern 首次出现的位置
+ * @return 未找到返回 -1
+ */
+static int findChars(const char *chars, int length, int from, const char *pattern, int patternLength)
+{
+    if (patternLength == 0)
+        return from <= length ? from : -1;
+    return simdFind(chars, length, from, pattern, patternLength);
+}
+
+/** 从 from 向前查找 pattern 最后一次出现的位置 */
+static int findLastChars(const char *chars, int length, int from, const char *pattern, int patternLength)
+{
+    int i = length - patternLength < from ? length - patternLength : from;
+    for (; i >= 0; i--)
+    {
+        if (memcmp(chars + i, pattern, patternLength) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/** indexOf(search, from)：没有返回 -1 */
+static Value indexOfNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_STRING(args[1]))
+        return NUMBER_VAL(-1);
+
+    char buffer[SMALL_STRING_BUFFER], searchBuffer[SMALL_STRING_BUFFER];
+    int length, searchLength;
+    const char *chars = stringChars(args[0], buffer, &length);
+    const char *search = stringChars(args[1], searchBuffer, &searchLength);
+    double from;
+    if (!readPosition(argCount, args, 2, 0, &from))
+        return NUMBER_VAL(-1);
+
+    return NUMBER_VAL(findChars(chars, length, clampPosition(from, length), search, searchLength));
+}
+
+/** lastIndexOf(search, from)：从 from（默认末尾）向前查找，没有返回 -1 */
+static Value lastIndexOfNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_STRING(args[1]))
+        return NUMBER_VAL(-1);
+
+    char buffer[SMALL_STRING_BUFFER], searchBuffer[SMALL_STRING_BUFFER];
+    int length, searchLength;
+    const char *chars = stringChars(args[0], buffer, &length);
+    const char *search = stringChars(args[1], searchBuffer, &searchLength);
+    double from;
+    if (!readPosition(argCount, args, 2, length, &from))
+        return NUMBER_VAL(-1);
+
+    return NUMBER_VAL(findLastChars(chars, length, clampPosition(from, length), search, searchLength));
+}
+
+static Value includesNative(int argCount, Value *args)
+{
+    return BOOL_VAL(AS_NUMBER(indexOfNative(argCount, args)) != -1);
+}
+
+/** startsWith(prefix) */
+static Value startsWithNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_STRING(args[1]))
+        return BOOL_VAL(false);
+
+    char buffer[SMALL_STRING_BUFFER], prefixBuffer[SMALL_STRING_BUFFER];
+    int length, prefixLength;
+    const char *chars = stringChars(args[0], buffer, &length);
+    const char *prefix = stringChars(args[1], prefixBuffer, &prefixLength);
+    return BOOL_VAL(prefixLength <= length && memcmp(chars, prefix, prefixLength) == 0);
+}
+
+/** endsWith(suffix) */
+static Value endsWithNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_STRING(args[1]))
+        return BOOL_VAL(false);
+
+    char buffer[SMALL_STRING_BUFFER], suffixBuffer[SMALL_STRING_BUFFER];
+    int length, suffixLength;
+    const char *chars = stringChars(args[0], buffer, &length);
+    const char *suffix = stringChars(args[1], suffixBuffer, &suffixLength);
+    return BOOL_VAL(suffixLength <= length && memcmp(chars + length - suffixLength, suffix, suffixLength) == 0);
+}
+
+/** charAt(index)：越界返回空串 */
+static Value charAtNative(int argCount, Value *args)
+{
+    int length = stringLength(args[0]);
+    double index;
+    if (!readPosition(argCount, args, 1, 0, &index) || index < 0 || index >= length)
+        return copyStringValue("", 0);
+    return substringValue(args[0], (int)index, 1);
+}
+
+/** charCodeAt(index)：字节值，越界返回 nil */
+static Value charCodeAtNative(int argCount, Value *args)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(args[0], buffer, &length);
+    double index;
+    if (!readPosition(argCount, args, 1, 0, &index) || index < 0 || index >= length)
+        return NIL_VAL;
+    return NUMBER_VAL((uint8_t)chars[(int)index]);
+}
+
+/**
+ * 结果字符串的写入缓冲区：不超过 SMALL_STRING_MAX 时写入 small，否则分配未驻留的字符串
+ * 写完后调用 finishString，期间不得再分配内存
+ */
+static char *startString(int length, char *small, ObjString **string)
+{
+    if (length <= SMALL_STRING_MAX)
+    {
+        *string = NULL;
+        return small;
+    }
+    *string = makeString(length);
+    return (*string)->chars;
+}
+
+static Value finishString(char *small, int length, ObjString *string)
+{
+    if (string == NULL)
+        return copyStringValue(small, length);
+    return OBJ_VAL(internString(string));
+}
+
+/**
+ * 替换 search 的出现，all 为 false 时只替换第一处
+ * 先数出匹配次数以确定结果长度，再一次分配写入
+ */
+static Value replace(int argCount, Value *args, bool all)
+{
+    if (argCount < 3 || !IS_STRING(args[1]) || !IS_STRING(args[2]))
+        return NIL_VAL;
+
+    char buffer[SMALL_STRING_BUFFER], searchBuffer[SMALL_STRING_BUFFER], replacementBuffer[SMALL_STRING_BUFFER];
+    int length, searchLength, replacementLength;
+    const char *chars = stringChars(args[0], buffer, &length); // 参数均位于栈上，分配不会使其失效
+    const char *search = stringChars(args[1], searchBuffer, &searchLength);
+    const char *replacement = stringChars(args[2], replacementBuffer, &replacementLength);
+
+    // 空串在每个位置（含末尾）都匹配一次
+    int step = searchLength > 0 ? searchLength : 1;
+    int matches = 0;
+    for (int found = findChars(chars, length, 0, search, searchLength); found != -1;
+         found = findChars(chars, length, found + step, search, searchLength))
+    {
+        matches++;
+        if (!all || found + step > length)
+            break;
+    }
+    if (matches == 0)
+        return args[0];
+
+    int resultLength = length + matches * (replacementLength - searchLength);
+    char small[SMALL_STRING_BUFFER];
+    ObjString *string;
+    char *out = startString(resultLength, small, &string);
+
+    int copied = 0;
+    for (int found = findChars(chars, length, 0, search, searchLength), i = 0; i < matches; i++)
+    {
+        memcpy(out, chars + copied, found - copied);
+        out += found - copied;
+        memcpy(out, replacement, replacementLength);
+        out += replacementLength;
+        copied = found + searchLength;
+        if (i + 1 < matches)
+            found = findChars(chars, length, found + step, search, searchLength);
+    }
+    memcpy(out, chars + copied, length - copied);
+
+    return finishString(small, resultLength, string);
+}
+
+/** replace(search, replacement)：替换第一处 */
+static Value replaceNative(int argCount, Value *args)
+{
+    return replace(argCount, args, false);
+}
+
+/** replaceAll(search, replacement)：替换所有不重叠的出现 */
+static Value replaceAllNative(int argCount, Value *args)
+{
+    return replace(argCount, args, true);
+}
+
+/** 按 ASCII 转换大小写，内容不变时返回原字符串 */
+static Value convertCase(Value receiver, bool upper)
+{
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(receiver, buffer, &length);
+
+    int first = 0;
+    char low = upper ? 'a' : 'A';
+    char high = upper ? 'z' : 'Z';
+    while (first < length && !(chars[first] >= low && chars[first] <= high))
+        first++;
+    if (first == length)
+        return receiver;
+
+    char small[SMALL_STRING_BUFFER];
+    ObjString *string;
+    char *out = startString(length, small, &string); // 接收者位于栈上，分配不会使其失效
+    memcpy(out, chars, first);
+    for (int i = first; i < length; i++)
+    {
+        char c = chars[i];
+        out[i] = (c >= low && c <= high) ? (char)(c ^ 0x20) : c;
+    }
+    return finishString(small, length, string);
+}
+
+static Value toUpperCaseNative(int argCount, Value *args)
+{
+    return convertCase(args[0], true);
+}
+
+static Value toLowerCaseNative(int argCount, Value *args)
+{
+    return convertCase(args[0], false);
+}
+
+/**
+ * split(separator)：返回子串数组，各段为视图或短字符串，不复制原字符串
+ * 分隔符为空串时拆为单个字符，省略分隔符时返回只含原字符串的数组
+ */
+static Value splitNative(int argCount, Value *args)
+{
+    if (argCount > 1 && !IS_STRING(args[1]))
+        return NIL_VAL;
+
+    ObjArray *array = newArray();
+    push(OBJ_VAL(array));
+
+    char buffer[SMALL_STRING_BUFFER], separatorBuffer[SMALL_STRING_BUFFER];
+    int length, separatorLength;
+    const char *chars = stringChars(args[0], buffer, &length); // 接收者位于栈上，分配不会使其失效
+    if (argCount < 2)
+    {
+        arrayPush(array, args[0]);
+    }
+    else
+    {
+        const char *separator = stringChars(args[1], separatorBuffer, &separatorLength);
+        if (separatorLength == 0)
+        {
+            for (int i = 0; i < length; i++)
+                arrayPush(array, substringValue(args[0], i, 1));
+        }
+        else
+        {
+            int start = 0;
+            int found;
+            while ((found = findChars(chars, length, start, separator, separatorLength)) != -1)
+            {
+                arrayPush(array, substringValue(args[0], start, found - start));
+                start = found + separatorLength;
+            }
+            arrayPush(array, substringValue(args[0], start, length - start));
+        }
+    }
+
+    pop();
+    return OBJ_VAL(array);
+}
+
+/** String(value)：转换为字符串，数字使用最短回读表示，与拼接、插值一致 */
+static Value stringNative(int argCount, Value *args)
+{
+    if (argCount == 0)
+        return copyStringValue("", 0);
+    if (IS_STRING(args[0]))
+        return args[0];
+
+    char buffer[FORMAT_BUFFER];
+    int length;
+    const char *text = formatValue(args[0], buffer, &length);
+    return copyStringValue(text, length);
+}
+
+void loadStringNatives()
+{
+    defineNative("String", stringNative);
+
+    vm.stringClass = newBuiltinClass("String");
+    defineNativeMethod(vm.stringClass, "substring", substringNative);
+    defineNativeMethod(vm.stringClass, "slice", sliceNative);
+    defineNativeMethod(vm.stringClass, "trim", trimNative);
+    defineNativeMethod(vm.stringClass, "split", splitNative);
+    defineNativeMethod(vm.stringClass, "indexOf", indexOfNative);
+    defineNativeMethod(vm.stringClass, "lastIndexOf", lastIndexOfNative);
+    defineNativeMethod(vm.stringClass, "includes", includesNative);
+    defineNativeMethod(vm.stringClass, "startsWith", startsWithNative);
+    defineNativeMethod(vm.stringClass, "endsWith", endsWithNative);
+    defineNativeMethod(vm.stringClass, "charAt", charAtNative);
+    defineNativeMethod(vm.stringClass, "charCodeAt", charCodeAtNative);
+    defineNativeMethod(vm.stringClass, "replace", replaceNative);
+    defineNativeMethod(vm.stringClass, "replaceAll", replaceAllNative);
+    defineNativeMethod(vm.stringClass, "toUpperCase", toUpperCaseNative);
+    defineNativeMethod(vm.stringClass, "toLowerCase", toLowerCaseNative);
+}
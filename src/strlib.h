@@ -0,0 +1,8 @@
+#ifndef loxj_strlib_h
+#define loxj_strlib_h
+
+#include "common.h"
+
+void loadStringNatives();
+
+#endif
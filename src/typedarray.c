@@ -0,0 +1,346 @@
+#include <string.h>
+
+#include "typedarray.h"
+#include "simd.h"
+#include "vm.h"
+
+//
+// 构造函数：Float64Array(length) 创建全 0 数组，Float64Array(array) 从数组或类型化数组复制并转换
+//
+
+static Value construct(TypedArrayKind kind, int argCount, Value *args)
+{
+    if (argCount == 0)
+        return OBJ_VAL(newTypedArray(kind, 0));
+
+    if (IS_NUMBER(args[0]))
+    {
+        double length = AS_NUMBER(args[0]);
+        if (!(length >= 0 && length <= INT32_MAX / sizeof(double)) || length != trunc(length))
+            return NIL_VAL;
+        return OBJ_VAL(newTypedArray(kind, (int)length));
+    }
+
+    // 以下来源均位于 vm 栈上，分配触发 GC 也不会被回收
+    if (IS_ARRAY(args[0]))
+    {
+        ValueArray *values = &AS_ARRAY(args[0])->values;
+        ObjTypedArray *array = newTypedArray(kind, values->count);
+        for (int i = 0; i < values->count; i++)
+        {
+            Value value = values->values[i];
+            typedArraySet(array, i, IS_NUMBER(value) ? AS_NUMBER(value) : NAN);
+        }
+        return OBJ_VAL(array);
+    }
+
+    if (IS_TYPED_ARRAY(args[0]))
+    {
+        ObjTypedArray *source = AS_TYPED_ARRAY(args[0]);
+        ObjTypedArray *array = newTypedArray(kind, source->length);
+        if (source->kind == kind)
+        {
+            if (source->length > 0)
+                memcpy(array->data, source->data, typedArrayElementSize(kind) * source->length);
+        }
+        else
+        {
+            for (int i = 0; i < source->length; i++)
+                typedArraySet(array, i, typedArrayGet(source, i));
+        }
+        return OBJ_VAL(array);
+    }
+
+    return NIL_VAL;
+}
+
+static Value float64ArrayNative(int argCount, Value *args) { return construct(TYPED_FLOAT64, argCount, args); }
+static Value int32ArrayNative(int argCount, Value *args) { return construct(TYPED_INT32, argCount, args); }
+static Value uint8ArrayNative(int argCount, Value *args) { return construct(TYPED_UINT8, argCount, args); }
+
+//
+// 批量运算方法，args[0] 为接收者。同类型操作数走 simd.c 的向量内核，混合类型逐元素转换
+//
+
+static Value sumNative(int argCount, Value *args)
+{
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        return NUMBER_VAL(simdSumF64(array->data, array->length));
+    case TYPED_INT32:
+        return NUMBER_VAL((double)simdSumI32(array->data, array->length));
+    case TYPED_UINT8:
+        return NUMBER_VAL((double)simdSumU8(array->data, array->length));
+    }
+    return NIL_VAL; // unreachable
+}
+
+/**
+ * 一次遍历求最小值与最大值
+ * @return 空数组返回 false
+ */
+static bool range(ObjTypedArray *array, double *min, double *max)
+{
+    if (array->length == 0)
+        return false;
+
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        simdRangeF64(array->data, array->length, min, max);
+        break;
+    case TYPED_INT32:
+    {
+        int32_t lo, hi;
+        simdRangeI32(array->data, array->length, &lo, &hi);
+        *min = lo;
+        *max = hi;
+        break;
+    }
+    case TYPED_UINT8:
+    {
+        uint8_t lo, hi;
+        simdRangeU8(array->data, array->length, &lo, &hi);
+        *min = lo;
+        *max = hi;
+        break;
+    }
+    }
+    return true;
+}
+
+/** min()：空数组返回 nil，Float64Array 忽略 NaN */
+static Value minNative(int argCount, Value *args)
+{
+    double min, max;
+    if (!range(AS_TYPED_ARRAY(args[0]), &min, &max))
+        return NIL_VAL;
+    return NUMBER_VAL(min);
+}
+
+/** max()：空数组返回 nil，Float64Array 忽略 NaN */
+static Value maxNative(int argCount, Value *args)
+{
+    double min, max;
+    if (!range(AS_TYPED_ARRAY(args[0]), &min, &max))
+        return NIL_VAL;
+    return NUMBER_VAL(max);
+}
+
+/** 取得与接收者等长的类型化数组参数，否则返回 NULL */
+static ObjTypedArray *operand(ObjTypedArray *array, int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_TYPED_ARRAY(args[1]))
+        return NULL;
+    ObjTypedArray *other = AS_TYPED_ARRAY(args[1]);
+    return other->length == array->length ? other : NULL;
+}
+
+/** dot(other)：与等长类型化数组的点积 */
+static Value dotNative(int argCount, Value *args)
+{
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    ObjTypedArray *other = operand(array, argCount, args);
+    if (other == NULL)
+        return NIL_VAL;
+
+    if (array->kind == TYPED_FLOAT64 && other->kind == TYPED_FLOAT64)
+        return NUMBER_VAL(simdDotF64(array->data, other->data, array->length));
+
+    double sum = 0;
+    for (int i = 0; i < array->length; i++)
+        sum += typedArrayGet(array, i) * typedArrayGet(other, i);
+    return NUMBER_VAL(sum);
+}
+
+/** scale(factor)：原地乘以 factor，返回接收者 */
+static Value scaleNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_NUMBER(args[1]))
+        return NIL_VAL;
+
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    double factor = AS_NUMBER(args[1]);
+    if (array->kind == TYPED_FLOAT64)
+    {
+        simdScaleF64(array->data, array->length, factor);
+    }
+    else
+    {
+        for (int i = 0; i < array->length; i++)
+            typedArraySet(array, i, typedArrayGet(array, i) * factor);
+    }
+    return args[0];
+}
+
+/** add(other)：原地逐元素加上等长类型化数组或一个数字，整数类型回绕，返回接收者 */
+static Value addNative(int argCount, Value *args)
+{
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+
+    if (argCount >= 2 && IS_NUMBER(args[1]))
+    {
+        double addend = AS_NUMBER(args[1]);
+        for (int i = 0; i < array->length; i++)
+            typedArraySet(array, i, typedArrayGet(array, i) + addend);
+        return args[0];
+    }
+
+    ObjTypedArray *other = operand(array, argCount, args);
+    if (other == NULL)
+        return NIL_VAL;
+
+    if (array->kind != other->kind)
+    {
+        for (int i = 0; i < array->length; i++)
+            typedArraySet(array, i, typedArrayGet(array, i) + typedArrayGet(other, i));
+        return args[0];
+    }
+
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        simdAddF64(array->data, other->data, array->length);
+        break;
+    case TYPED_INT32:
+        simdAddI32(array->data, other->data, array->length);
+        break;
+    case TYPED_UINT8:
+        simdAddU8(array->data, other->data, array->length);
+        break;
+    }
+    return args[0];
+}
+
+/** fill(value)：所有元素设为 value，返回接收者 */
+static Value fillNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_NUMBER(args[1]))
+        return NIL_VAL;
+
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    double value = AS_NUMBER(args[1]);
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+    {
+        double *data = array->data;
+        for (int i = 0; i < array->length; i++)
+            data[i] = value;
+        break;
+    }
+    case TYPED_INT32:
+    {
+        int32_t *data = array->data;
+        int32_t element = toInt32(value);
+        for (int i = 0; i < array->length; i++)
+            data[i] = element;
+        break;
+    }
+    case TYPED_UINT8:
+        if (array->length > 0)
+            memset(array->data, (uint8_t)toInt32(value), array->length);
+        break;
+    }
+    return args[0];
+}
+
+/** copy(source, offset)：把数组或类型化数组 source 写入从 offset（默认 0）开始的位置，返回接收者 */
+static Value copyNative(int argCount, Value *args)
+{
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    if (argCount < 2)
+        return NIL_VAL;
+
+    int offset = 0;
+    if (argCount >= 3)
+    {
+        if (!IS_NUMBER(args[2]))
+            return NIL_VAL;
+        double number = AS_NUMBER(args[2]);
+        if (!(number >= 0 && number <= array->length) || number != trunc(number))
+            return NIL_VAL;
+        offset = (int)number;
+    }
+
+    if (IS_TYPED_ARRAY(args[1]))
+    {
+        ObjTypedArray *source = AS_TYPED_ARRAY(args[1]);
+        if (source->length > array->length - offset)
+            return NIL_VAL;
+
+        if (source->kind == array->kind)
+        {
+            size_t size = typedArrayElementSize(array->kind);
+            if (source->length > 0) // 可能是同一数组，需用 memmove
+                memmove((uint8_t *)array->data + size * offset, source->data, size * source->length);
+        }
+        else
+        {
+            for (int i = 0; i < source->length; i++)
+                typedArraySet(array, offset + i, typedArrayGet(source, i));
+        }
+        return args[0];
+    }
+
+    if (IS_ARRAY(args[1]))
+    {
+        ValueArray *values = &AS_ARRAY(args[1])->values;
+        if (values->count > array->length - offset)
+            return NIL_VAL;
+
+        for (int i = 0; i < values->count; i++)
+        {
+            Value value = values->values[i];
+            typedArraySet(array, offset + i, IS_NUMBER(value) ? AS_NUMBER(value) : NAN);
+        }
+        return args[0];
+    }
+
+    return NIL_VAL;
+}
+
+/** indexOf(value)：第一个等于 value 的位置，没有返回 -1 */
+static Value indexOfNative(int argCount, Value *args)
+{
+    if (argCount < 2 || !IS_NUMBER(args[1]))
+        return NUMBER_VAL(-1);
+
+    ObjTypedArray *array = AS_TYPED_ARRAY(args[0]);
+    double value = AS_NUMBER(args[1]);
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        return NUMBER_VAL(simdIndexOfF64(array->data, array->length, value));
+    case TYPED_INT32:
+        if (value != toInt32(value))
+            return NUMBER_VAL(-1); // 元素类型无法表示的值不可能出现
+        return NUMBER_VAL(simdIndexOfI32(array->data, array->length, toInt32(value)));
+    case TYPED_UINT8:
+        if (!(value >= 0 && value <= UINT8_MAX) || value != trunc(value))
+            return NUMBER_VAL(-1);
+        return NUMBER_VAL(simdIndexOfU8(array->data, array->length, (uint8_t)value));
+    }
+    return NUMBER_VAL(-1); // unreachable
+}
+
+void loadTypedArrayNatives()
+{
+    defineNative("Float64Array", float64ArrayNative);
+    defineNative("Int32Array", int32ArrayNative);
+    defineNative("Uint8Array", uint8ArrayNative);
+
+    // 三种元素类型共用一张方法表，方法内按 kind 分派
+    vm.typedArrayClass = newBuiltinClass("TypedArray");
+    defineNativeMethod(vm.typedArrayClass, "sum", sumNative);
+    defineNativeMethod(vm.typedArrayClass, "min", minNative);
+    defineNativeMethod(vm.typedArrayClass, "max", maxNative);
+    defineNativeMethod(vm.typedArrayClass, "dot", dotNative);
+    defineNativeMethod(vm.typedArrayClass, "scale", scaleNative);
+    defineNativeMethod(vm.typedArrayClass, "add", addNative);
+    defineNativeMethod(vm.typedArrayClass, "fill", fillNative);
+    defineNativeMethod(vm.typedArrayClass, "copy", copyNative);
+    defineNativeMethod(vm.typedArrayClass, "indexOf", indexOfNative);
+}
@@ -0,0 +1,58 @@
+#ifndef loxj_typedarray_h
+#define loxj_typedarray_h
+
+#include <math.h>
+
+#include "common.h"
+#include "object.h"
+
+/**
+ * 按 JavaScript ToInt32 语义转换：截断小数，按 2^32 回绕，NaN 与无穷为 0
+ */
+static inline int32_t toInt32(double number)
+{
+    if (number > -2147483649.0 && number < 2147483648.0)
+        return (int32_t)number; // 常见情形：范围内直接截断
+    if (!isfinite(number))
+        return 0; // 包括 NaN
+
+    double wrapped = fmod(trunc(number), 4294967296.0);
+    if (wrapped < 0)
+        wrapped += 4294967296.0;
+    return (int32_t)(uint32_t)wrapped;
+}
+
+static inline double typedArrayGet(ObjTypedArray *array, int index)
+{
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        return ((double *)array->data)[index];
+    case TYPED_INT32:
+        return ((int32_t *)array->data)[index];
+    case TYPED_UINT8:
+        return ((uint8_t *)array->data)[index];
+    }
+    return 0; // unreachable
+}
+
+/** 写入时按元素类型转换，整数类型截断并回绕 */
+static inline void typedArraySet(ObjTypedArray *array, int index, double number)
+{
+    switch (array->kind)
+    {
+    case TYPED_FLOAT64:
+        ((double *)array->data)[index] = number;
+        break;
+    case TYPED_INT32:
+        ((int32_t *)array->data)[index] = toInt32(number);
+        break;
+    case TYPED_UINT8:
+        ((uint8_t *)array->data)[index] = (uint8_t)toInt32(number);
+        break;
+    }
+}
+
+void loadTypedArrayNatives();
+
+#endif
@@ -5,6 +5,9 @@
 #include "value.h"
 #include "object.h"
 #include "memory.h"
+#include "typedarray.h"
+#include "dtoa.h"
+#include "output.h"
 
 /**
  * 必须使用此函数初始化值数组
@@ -40,6 +43,41 @@ void freeValueArray(ValueArray *array)
     initValueArray(array);
 }
 
+/**
+ * 将至多 SMALL_STRING_MAX 个非 NUL 字符直接编码进值，调用方保证长度与内容合法
+ */
+Value makeSmallString(const char *chars, int length)
+{
+#ifdef NAN_BOXING
+    uint64_t bits = 0;
+    for (int i = 0; i < length; i++)
+        bits |= (uint64_t)(uint8_t)chars[i] << (8 * i);
+    return (Value)(QNAN | TAG_SMALL_STRING | bits);
+#else
+    return NIL_VAL; // unreachable
+#endif
+}
+
+/**
+ * 将短字符串解码到 buffer（至少 SMALL_STRING_BUFFER 字节），以 NUL 结尾
+ * @return 字符串长度
+ */
+int readSmallString(Value value, char *buffer)
+{
+    int length = 0;
+#ifdef NAN_BOXING
+    while (length < SMALL_STRING_MAX)
+    {
+        char c = (char)((value >> (8 * length)) & 0xff);
+        if (c == '\0')
+            break;
+        buffer[length++] = c;
+    }
+#endif
+    buffer[length] = '\0';
+    return length;
+}
+
 /**
  * 返回静态段内存字符串，无需分配和回收内存
  */
@@ -48,6 +86,8 @@ const char *typeofValue(Value value)
 #ifdef NAN_BOXING
     if (IS_BOOL(value))
         return "boolean";
+    else if (IS_SMALL_STRING(value))
+        return "string";
     else if (IS_NIL(value))
         return "nil";
     else if (IS_NUMBER(value))
@@ -56,6 +96,11 @@ const char *typeofValue(Value value)
     {
         switch (AS_OBJ(value)->type)
         {
+        case OBJ_ARRAY:
+        case OBJ_MAP:
+        case OBJ_SET:
+        case OBJ_TYPED_ARRAY:
+            return "object";
         case OBJ_CLASS:
             return "class";
         case OBJ_INSTANCE:
@@ -66,8 +111,12 @@ const char *typeofValue(Value value)
         case OBJ_NATIVE:
             return "function";
         case OBJ_STRING:
+        case OBJ_STRING_VIEW:
             return "string";
-        case OBJ_UPVALUE: // unreachable
+        case OBJ_STRING_BUILDER:
+            return "object";
+        case OBJ_FILE_DATA: // unreachable
+        case OBJ_UPVALUE:
             return "upvalue";
         }
     }
@@ -84,6 +133,11 @@ const char *typeofValue(Value value)
     {
         switch (AS_OBJ(value)->type)
         {
+        case OBJ_ARRAY:
+        case OBJ_MAP:
+        case OBJ_SET:
+        case OBJ_TYPED_ARRAY:
+            return "object";
         case OBJ_CLASS:
             return "class";
         case OBJ_INSTANCE:
@@ -94,8 +148,12 @@ const char *typeofValue(Value value)
         case OBJ_NATIVE:
             return "function";
         case OBJ_STRING:
+        case OBJ_STRING_VIEW:
             return "string";
-        case OBJ_UPVALUE: // unreachable
+        case OBJ_STRING_BUILDER:
+            return "object";
+        case OBJ_FILE_DATA: // unreachable
+        case OBJ_UPVALUE:
             return "upvalue";
         }
     }
@@ -109,7 +167,10 @@ bool isValuesEqual(Value a, Value b)
 #ifdef NAN_BOXING
     if (IS_NUMBER(a) && IS_NUMBER(b))
         return AS_NUMBER(a) == AS_NUMBER(b); // handle NaN
-    return a == b;
+    if (a == b)
+        return true; // 短字符串值总以短字符串编码，内容相同则位模式相同
+    // 视图不驻留，需按内容比较
+    return (IS_STRING_VIEW(a) || IS_STRING_VIEW(b)) && IS_STRING(a) && IS_STRING(b) && isStringsEqual(a, b);
 #else
 
     if (a.type != b.type)
@@ -125,7 +186,10 @@ bool isValuesEqual(Value a, Value b)
             return false; // NaN != NaN
         return AS_NUMBER(a) == AS_NUMBER(b);
     case VAL_OBJ:
-        return AS_OBJ(a) == AS_OBJ(b); // 对象为不变值，且字符串驻留，因此只需比较地址
+        if (AS_OBJ(a) == AS_OBJ(b))
+            return true; // 对象为不变值，且字符串驻留，因此只需比较地址
+        // 视图不驻留，需按内容比较
+        return (IS_STRING_VIEW(a) || IS_STRING_VIEW(b)) && IS_STRING(a) && IS_STRING(b) && isStringsEqual(a, b);
     default:
         return false; // Unreachable.
     }
@@ -137,25 +201,112 @@ inline bool isFalsey(Value value)
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value)) || (IS_NUMBER(value) && AS_NUMBER(value) == 0);
 }
 
+/**
+ * 格式化数字：能精确回读的最短表示，print、echo、拼接与插值共用
+ * @param buffer 至少 NUMBER_BUFFER 字节
+ * @return 写入的长度
+ */
+int formatNumber(double number, char *buffer)
+{
+    return formatDouble(number, buffer);
+}
+
+static void printNumber(double number)
+{
+    char buffer[NUMBER_BUFFER];
+    writeOutput(buffer, (size_t)formatNumber(number, buffer));
+}
+
 static void printFunction(ObjFunction *function)
 {
     if (function->name == NULL)
     {
-        printf("<script>");
+        printOutput("<script>");
+        return;
+    }
+    printOutput("<fn %s>", function->name->chars);
+}
+
+// 嵌套超过此深度的容器不再展开，同时避免自引用容器无限递归
+#define PRINT_CONTAINER_DEPTH 8
+static int printDepth = 0;
+
+static void printArray(ObjArray *array)
+{
+    if (printDepth >= PRINT_CONTAINER_DEPTH)
+    {
+        printOutput("[...]");
+        return;
+    }
+
+    printDepth++;
+    printOutput("[");
+    for (int i = 0; i < array->values.count; i++)
+    {
+        if (i > 0)
+            printOutput(", ");
+        printValue(array->values.values[i]);
+    }
+    printOutput("]");
+    printDepth--;
+}
+
+/** Map {key => value, ...} 或 Set {value, ...} */
+static void printValueTable(const char *name, ValueTable *table, bool withValues)
+{
+    if (printDepth >= PRINT_CONTAINER_DEPTH)
+    {
+        printOutput("%s {...}", name);
         return;
     }
-    printf("<fn %s>", function->name->chars);
+
+    printDepth++;
+    printOutput("%s {", name);
+    bool first = true;
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (!entry->live)
+            continue;
+        if (!first)
+            printOutput(", ");
+        first = false;
+
+        printValue(entry->key);
+        if (withValues)
+        {
+            printOutput(" => ");
+            printValue(entry->value);
+        }
+    }
+    printOutput("}");
+    printDepth--;
+}
+
+static void printTypedArray(ObjTypedArray *array)
+{
+    printOutput("%s [", typedArrayName(array->kind));
+    for (int i = 0; i < array->length; i++)
+    {
+        if (i > 0)
+            printOutput(", ");
+        printNumber(typedArrayGet(array, i));
+    }
+    printOutput("]");
 }
 
 static void printObject(Value value)
 {
     switch (OBJ_TYPE(value))
     {
+    case OBJ_ARRAY:
+        printArray(AS_ARRAY(value));
+        break;
     case OBJ_CLASS:
-        printf("<class %s>", AS_CLASS(value)->name->chars);
+        printOutput("<class %s>", AS_CLASS(value)->name->chars);
         break;
     case OBJ_INSTANCE:
-        printf("<instance %s>", AS_INSTANCE(value)->klass->name->chars);
+        printOutput("<instance %s>", AS_INSTANCE(value)->klass->name->chars);
         break;
     case OBJ_BOUND_METHOD:
         printFunction(AS_BOUND_METHOD(value)->method->function);
@@ -167,32 +318,129 @@ static void printObject(Value value)
         printFunction(AS_FUNCTION(value));
         break;
     case OBJ_NATIVE:
-        printf("<native fn>");
+        printOutput("<native fn>");
         break;
     case OBJ_STRING:
-        printf("%s", AS_CSTRING(value));
+        printOutput("%s", AS_CSTRING(value));
+        break;
+    case OBJ_TYPED_ARRAY:
+        printTypedArray(AS_TYPED_ARRAY(value));
+        break;
+    case OBJ_MAP:
+        printValueTable("Map", &AS_MAP(value)->table, true);
+        break;
+    case OBJ_SET:
+        printValueTable("Set", &AS_SET(value)->table, false);
+        break;
+    case OBJ_STRING_VIEW:
+        printOutput("%.*s", AS_STRING_VIEW(value)->length, AS_STRING_VIEW(value)->chars);
+        break;
+    case OBJ_STRING_BUILDER:
+        printOutput("<string builder>");
+        break;
+    case OBJ_FILE_DATA: // Unreachable.
+        printOutput("<file data>");
         break;
     case OBJ_UPVALUE: // Unreachable.
-        printf("<upvalue>");
+        printOutput("<upvalue>");
         break;
     }
 }
 
+static const char *functionName(ObjFunction *function)
+{
+    return function->name == NULL ? "<script>" : function->name->chars;
+}
+
+/**
+ * 取得值的文本形式，供字符串拼接使用。字符串直接返回其字符，其余写入 buffer
+ * @param buffer 至少 FORMAT_BUFFER 字节
+ * @param length 输出文本长度
+ */
+const char *formatValue(Value value, char *buffer, int *length)
+{
+    if (IS_STRING(value))
+        return stringChars(value, buffer, length);
+
+    if (IS_NUMBER(value))
+    {
+        *length = formatNumber(AS_NUMBER(value), buffer);
+        return buffer;
+    }
+
+    const char *text = buffer;
+    if (IS_BOOL(value))
+        text = AS_BOOL(value) ? "true" : "false";
+    else if (IS_NIL(value))
+        text = "nil";
+    else
+    {
+        switch (OBJ_TYPE(value))
+        {
+        case OBJ_ARRAY:
+            snprintf(buffer, FORMAT_BUFFER, "<array %d>", AS_ARRAY(value)->values.count);
+            break;
+        case OBJ_CLASS:
+            snprintf(buffer, FORMAT_BUFFER, "<class %s>", AS_CLASS(value)->name->chars);
+            break;
+        case OBJ_INSTANCE:
+            snprintf(buffer, FORMAT_BUFFER, "<instance %s>", AS_INSTANCE(value)->klass->name->chars);
+            break;
+        case OBJ_BOUND_METHOD:
+            snprintf(buffer, FORMAT_BUFFER, "<fn %s>", functionName(AS_BOUND_METHOD(value)->method->function));
+            break;
+        case OBJ_CLOSURE:
+            snprintf(buffer, FORMAT_BUFFER, "<fn %s>", functionName(AS_CLOSURE(value)->function));
+            break;
+        case OBJ_FUNCTION:
+            snprintf(buffer, FORMAT_BUFFER, "<fn %s>", functionName(AS_FUNCTION(value)));
+            break;
+        case OBJ_TYPED_ARRAY:
+            snprintf(buffer, FORMAT_BUFFER, "<%s %d>", typedArrayName(AS_TYPED_ARRAY(value)->kind), AS_TYPED_ARRAY(value)->length);
+            break;
+        case OBJ_MAP:
+            snprintf(buffer, FORMAT_BUFFER, "<Map %d>", AS_MAP(value)->table.count);
+            break;
+        case OBJ_SET:
+            snprintf(buffer, FORMAT_BUFFER, "<Set %d>", AS_SET(value)->table.count);
+            break;
+        case OBJ_NATIVE:
+            text = "<native fn>";
+            break;
+        case OBJ_STRING_BUILDER:
+            text = "<string builder>";
+            break;
+        default:
+            text = "<upvalue>"; // Unreachable.
+            break;
+        }
+    }
+
+    *length = (int)strlen(text);
+    return text;
+}
+
 // 仅供内部打印使用
 inline void printValue(Value value)
 {
 #ifdef NAN_BOXING
     if (IS_BOOL(value))
     {
-        printf(AS_BOOL(value) ? "true" : "false");
+        printOutput(AS_BOOL(value) ? "true" : "false");
     }
     else if (IS_NIL(value))
     {
-        printf("nil");
+        printOutput("nil");
+    }
+    else if (IS_SMALL_STRING(value))
+    {
+        char buffer[SMALL_STRING_BUFFER];
+        readSmallString(value, buffer);
+        printOutput("%s", buffer);
     }
     else if (IS_NUMBER(value))
     {
-        printf("%g", AS_NUMBER(value));
+        printNumber(AS_NUMBER(value));
     }
     else if (IS_OBJ(value))
     {
@@ -202,13 +450,13 @@ inline void printValue(Value value)
     switch (value.type)
     {
     case VAL_BOOL:
-        printf(AS_BOOL(value) ? "true" : "false");
+        printOutput(AS_BOOL(value) ? "true" : "false");
         break;
     case VAL_NIL:
-        printf("<nil>");
+        printOutput("<nil>");
         break;
     case VAL_NUMBER:
-        printf("%g", AS_NUMBER(value));
+        printNumber(AS_NUMBER(value));
         break;
     case VAL_OBJ:
         printObject(value);
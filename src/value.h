@@ -14,6 +14,9 @@ typedef struct ObjString ObjString;
 #define TAG_NIL 1   // 01
 #define TAG_FALSE 2 // 10
 #define TAG_TRUE 3  // 11
+// 短字符串：第 48 位为标签，低 48 位按字节存放至多 6 个非 NUL 字符，长度即非零字节数
+#define TAG_SMALL_STRING ((uint64_t)0x0001000000000000)
+#define SMALL_STRING_MAX 6
 
 typedef uint64_t Value;
 #define NUMBER_VAL(num) numToValue(num)
@@ -41,6 +44,7 @@ static inline double valueToNum(Value value)
 #define OBJ_VAL(obj) (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
 #define AS_OBJ(value) ((Obj *)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
 #define IS_OBJ(value) (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+#define IS_SMALL_STRING(value) (((value) & (SIGN_BIT | QNAN | TAG_SMALL_STRING)) == (QNAN | TAG_SMALL_STRING))
 
 #else
 
@@ -78,8 +82,15 @@ typedef struct
 #define AS_BOOL(value) ((value).as.boolean)
 #define AS_NUMBER(value) ((value).as.number)
 
+// 非 NaN 装箱时没有短字符串，所有字符串都是堆对象
+#define SMALL_STRING_MAX 0
+#define IS_SMALL_STRING(value) false
+
 #endif
 
+/** 可容纳任一短字符串（含 NUL 结尾）的缓冲区大小 */
+#define SMALL_STRING_BUFFER 8
+
 typedef struct
 {
     int capacity;
@@ -96,4 +107,15 @@ bool isFalsey(Value value);
 void printValue(Value value);
 const char *typeofValue(Value value);
 
+Value makeSmallString(const char *chars, int length);
+int readSmallString(Value value, char *buffer);
+
+/** formatNumber 所需缓冲区大小，不小于 DTOA_BUFFER */
+#define NUMBER_BUFFER 32
+/** formatValue 所需缓冲区大小，过长的类名/函数名会被截断 */
+#define FORMAT_BUFFER 128
+
+int formatNumber(double number, char *buffer);
+const char *formatValue(Value value, char *buffer, int *length);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include <math.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "valuetable.h"
+
+#define SLOT_EMPTY (-1)
+#define SLOT_DELETED (-2)
+
+void initValueTable(ValueTable *table)
+{
+    table->count = 0;
+    table->entryCount = 0;
+    table->entryCapacity = 0;
+    table->entries = NULL;
+    table->indexCapacity = 0;
+    table->indices = NULL;
+}
+
+void freeValueTable(ValueTable *table)
+{
+    FREE_ARRAY(ValueEntry, table->entries, table->entryCapacity);
+    FREE_ARRAY(int32_t, table->indices, table->indexCapacity);
+    initValueTable(table);
+}
+
+/** 64 位混合函数（MurmurHash3 fmix64），使相近的位模式分散到不同槽位 */
+static inline uint32_t mixBits(uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+/**
+ * 数字按位哈希（-0 与 0、所有 NaN 各自归一），字符串按内容（驻留字符串使用缓存的哈希），
+ * 其余对象按地址，短字符串、布尔与 nil 按值的位模式
+ */
+uint32_t hashValue(Value value)
+{
+    if (IS_NUMBER(value))
+    {
+        double number = AS_NUMBER(value);
+        if (number == 0)
+            number = 0; // -0
+        else if (isnan(number))
+            number = NAN;
+
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return mixBits(bits);
+    }
+
+    if (IS_OBJ(value))
+    {
+        Obj *object = AS_OBJ(value);
+        if (object->type == OBJ_STRING)
+            return ((ObjString *)object)->hash;
+        if (object->type == OBJ_STRING_VIEW) // 须与内容相同的驻留字符串一致
+            return hashString(((ObjStringView *)object)->chars, ((ObjStringView *)object)->length);
+        return mixBits((uint64_t)(uintptr_t)object);
+    }
+
+#ifdef NAN_BOXING
+    return mixBits(value);
+#else
+    return IS_BOOL(value) ? (AS_BOOL(value) ? 1u : 2u) : 0u;
+#endif
+}
+
+/** SameValueZero：与 == 相同，但 NaN 等于 NaN */
+static inline bool keysEqual(Value a, Value b)
+{
+    if (IS_NUMBER(a) && IS_NUMBER(b))
+    {
+        double x = AS_NUMBER(a), y = AS_NUMBER(b);
+        return x == y || (isnan(x) && isnan(y));
+    }
+    return isValuesEqual(a, b);
+}
+
+/**
+ * @return 键所在的槽位，不存在返回 -1
+ */
+static int findSlot(ValueTable *table, Value key, uint32_t hash)
+{
+    if (table->count == 0)
+        return -1;
+
+    uint32_t mask = (uint32_t)table->indexCapacity - 1;
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        int32_t index = table->indices[slot];
+        if (index == SLOT_EMPTY)
+            return -1;
+        if (index == SLOT_DELETED)
+            continue;
+
+        ValueEntry *entry = &table->entries[index];
+        if (entry->hash == hash && keysEqual(entry->key, key))
+            return (int)slot;
+    }
+}
+
+/** 为新条目占用一个空槽或已删除的槽，调用方保证键不存在 */
+static void insertIndex(int32_t *indices, int indexCapacity, uint32_t hash, int32_t index)
+{
+    uint32_t mask = (uint32_t)indexCapacity - 1;
+    uint32_t slot = hash & mask;
+    while (indices[slot] >= 0)
+        slot = (slot + 1) & mask;
+    indices[slot] = index;
+}
+
+/**
+ * 以新容量重建：压缩掉已删除的条目并重新分配槽位
+ * 新数组全部分配完成后才替换，期间触发 GC 看到的仍是完整的旧表
+ */
+static void rebuild(ValueTable *table, int entryCapacity)
+{
+    int indexCapacity = entryCapacity * 2;
+    ValueEntry *entries = ALLOCATE(ValueEntry, entryCapacity);
+    int32_t *indices = ALLOCATE(int32_t, indexCapacity);
+    memset(indices, 0xff, sizeof(int32_t) * indexCapacity); // SLOT_EMPTY
+
+    int count = 0;
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (!entry->live)
+            continue;
+        entries[count] = *entry;
+        insertIndex(indices, indexCapacity, entry->hash, count);
+        count++;
+    }
+
+    FREE_ARRAY(ValueEntry, table->entries, table->entryCapacity);
+    FREE_ARRAY(int32_t, table->indices, table->indexCapacity);
+    table->entries = entries;
+    table->entryCapacity = entryCapacity;
+    table->indices = indices;
+    table->indexCapacity = indexCapacity;
+    table->entryCount = count;
+}
+
+bool valueTableGet(ValueTable *table, Value key, Value *value)
+{
+    int slot = findSlot(table, key, hashValue(key));
+    if (slot == -1)
+        return false;
+
+    *value = table->entries[table->indices[slot]].value;
+    return true;
+}
+
+/**
+ * 调用方须保证表、键与值可被 GC 找到，因为扩容可能触发 GC
+ * @return 是否为新键
+ */
+bool valueTableSet(ValueTable *table, Value key, Value value)
+{
+    uint32_t hash = hashValue(key);
+    int slot = findSlot(table, key, hash);
+    if (slot != -1)
+    {
+        table->entries[table->indices[slot]].value = value;
+        return false;
+    }
+
+    if (table->entryCount == table->entryCapacity)
+    {
+        // 已删除的条目超过一半时原地压缩，否则扩容
+        int capacity = table->count + 1 > table->entryCapacity / 2
+                           ? GROW_CAPACITY(table->entryCapacity)
+                           : table->entryCapacity;
+        rebuild(table, capacity);
+    }
+
+    if (IS_NUMBER(key))
+    { // 与哈希一致地归一：-0 作为键存储为 0，NaN 存储为同一个 NaN
+        if (AS_NUMBER(key) == 0)
+            key = NUMBER_VAL(0);
+        else if (isnan(AS_NUMBER(key)))
+            key = NUMBER_VAL(NAN);
+    }
+
+    int32_t index = table->entryCount++;
+    ValueEntry *entry = &table->entries[index];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    entry->live = true;
+    insertIndex(table->indices, table->indexCapacity, hash, index);
+    table->count++;
+    return true;
+}
+
+bool valueTableDelete(ValueTable *table, Value key)
+{
+    int slot = findSlot(table, key, hashValue(key));
+    if (slot == -1)
+        return false;
+
+    ValueEntry *entry = &table->entries[table->indices[slot]];
+    entry->key = NIL_VAL; // 不再引用，以便回收
+    entry->value = NIL_VAL;
+    entry->live = false;
+    table->indices[slot] = SLOT_DELETED;
+    table->count--;
+    return true;
+}
+
+void markValueTable(ValueTable *table)
+{
+    for (int i = 0; i < table->entryCount; i++)
+    {
+        ValueEntry *entry = &table->entries[i];
+        if (!entry->live)
+            continue;
+        markValue(entry->key);
+        markValue(entry->value);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef loxj_valuetable_h
+#define loxj_valuetable_h
+
+#include "common.h"
+#include "value.h"
+
+typedef struct
+{
+    Value key;
+    Value value;
+    uint32_t hash;
+    /** 删除后置为 false，位置保留以维持插入顺序，扩容时压缩 */
+    bool live;
+} ValueEntry;
+
+// 以任意 Value 为键的哈希表，按插入顺序迭代
+// 条目按插入顺序紧凑存放，另以开放寻址的槽位数组存放条目下标
+typedef struct
+{
+    /** 有效条目数 */
+    int count;
+    /** 已使用的条目位置数（含已删除） */
+    int entryCount;
+    int entryCapacity;
+    ValueEntry *entries;
+    /** 槽位数为条目容量的两倍，负载因子不超过 0.5 */
+    int indexCapacity;
+    int32_t *indices;
+} ValueTable;
+
+void initValueTable(ValueTable *table);
+void freeValueTable(ValueTable *table);
+
+uint32_t hashValue(Value value);
+bool valueTableGet(ValueTable *table, Value key, Value *value);
+bool valueTableSet(ValueTable *table, Value key, Value value);
+bool valueTableDelete(ValueTable *table, Value key);
+void markValueTable(ValueTable *table);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -7,6 +8,15 @@
 #include "compiler.h"
 #include "memory.h"
 #include "debug.h"
+#include "builder.h"
+#include "strlib.h"
+#include "array.h"
+#include "typedarray.h"
+#include "map.h"
+#include "json.h"
+#include "file.h"
+#include "csv.h"
+#include "output.h"
 
 #if defined(LOXJ_OPTIONS_NATIVE) && defined(_WIN32)
 __declspec(dllimport) void __stdcall Sleep(unsigned long dwMilliseconds);
@@ -39,7 +49,19 @@ static Value systemNative(int argCount, Value *args)
 {
     if (argCount == 0 || !IS_STRING(args[0]))
         return NIL_VAL;
-    return NUMBER_VAL(system(AS_CSTRING(args[0])));
+    char buffer[SMALL_STRING_BUFFER];
+    int length;
+    const char *chars = stringChars(args[0], buffer, &length);
+    // 视图的字符不以 NUL 结尾，需复制
+    char *command = (char *)malloc(length + 1);
+    if (command == NULL)
+        return NIL_VAL;
+    memcpy(command, chars, length);
+    command[length] = '\0';
+    flushOutput(); // 子进程共享标准输出
+    int status = system(command);
+    free(command);
+    return NUMBER_VAL(status);
 }
 #endif
 static Value isNaNNative(int argCount, Value *args)
@@ -51,17 +73,13 @@ static Value isNaNNative(int argCount, Value *args)
 static Value echoNative(int argCount, Value *args)
 {
     for (int i = 0; i < argCount; i++)
-    {
-        Value v = args[i];
-        if (IS_NUMBER(v))
-            printf("%.15g", AS_NUMBER(v));
-        else
-            printValue(v);
-    }
+        printValue(args[i]);
+    flushLine();
     return NIL_VAL;
 }
 static Value exitNative(int argCount, Value *args)
 {
+    flushOutput();
     exit((argCount == 0 || IS_NUMBER(args[0])) ? 0 : AS_NUMBER(args[0]));
     return NIL_VAL;
 }
@@ -92,8 +110,9 @@ static Value hasFieldNative(int argCount, Value *args)
         return BOOL_VAL(false);
 
     ObjInstance *instance = AS_INSTANCE(args[0]);
+    ObjString *name = findStringValue(args[1]);
     Value dummy;
-    return BOOL_VAL(tableGet(&instance->fields, AS_STRING(args[1]), &dummy));
+    return BOOL_VAL(name != NULL && tableGet(&instance->fields, name, &dummy));
 }
 static Value getFieldNative(int argCount, Value *args)
 {
@@ -105,8 +124,10 @@ static Value getFieldNative(int argCount, Value *args)
         return BOOL_VAL(false);
 
     ObjInstance *instance = AS_INSTANCE(args[0]);
-    Value value;
-    tableGet(&instance->fields, AS_STRING(args[1]), &value);
+    ObjString *name = findStringValue(args[1]);
+    Value value = NIL_VAL;
+    if (name != NULL)
+        tableGet(&instance->fields, name, &value);
     return value;
 }
 
@@ -120,7 +141,7 @@ static Value setFieldNative(int argCount, Value *args)
         return BOOL_VAL(false);
 
     ObjInstance *instance = AS_INSTANCE(args[0]);
-    tableSet(&instance->fields, AS_STRING(args[1]), args[2]);
+    tableSet(&instance->fields, internStringValue(args[1]), args[2]);
     return args[2];
 }
 static Value deleteFieldNative(int argCount, Value *args)
@@ -133,7 +154,9 @@ static Value deleteFieldNative(int argCount, Value *args)
         return NIL_VAL;
 
     ObjInstance *instance = AS_INSTANCE(args[0]);
-    tableDelete(&instance->fields, AS_STRING(args[1]));
+    ObjString *name = findStringValue(args[1]);
+    if (name != NULL)
+        tableDelete(&instance->fields, name);
     return NIL_VAL;
 }
 static void loadBuiltInNative()
@@ -156,6 +179,16 @@ static void loadBuiltInNative()
     defineNative("getField", getFieldNative);
     defineNative("hasField", hasFieldNative);
     defineNative("deleteField", deleteFieldNative);
+    // built-in types
+    loadStringBuilderNatives();
+    loadStringNatives();
+    loadArrayNatives();
+    loadTypedArrayNatives();
+    loadMapNatives();
+    loadJsonNatives();
+    loadFileNatives();
+    loadCsvNatives();
+    loadOutputNatives();
 }
 #endif
 
@@ -163,30 +196,52 @@ static void loadBuiltInNative()
 VM vm;
 // 因此，vm 结构体现在存储于 .bss 数据段，无需内存分配
 
+/** OP_BUILD_STRING 格式化非字符串片段的暂存区，跨调用复用，不计入 GC 堆 */
+static char *formatScratch = NULL;
+static size_t formatScratchCapacity = 0;
+
 static void resetStack()
 {
     vm.stackTop = vm.stack;
     vm.frameCount = 0;
+    vm.baseFrame = 0;
     vm.openUpvalues = NULL;
 }
 
 void initVM()
 {
+    initOutput();
     resetStack();
     vm.objects = NULL;
     initTable(&vm.strings);
     initTable(&vm.globals);
 
-    // 请注意 copyString 也是可以间接触发 GC 的函数
-    vm.initString = NULL;
-    vm.initString = copyString(LOXJ_OPTIONS_INIT, LOXJ_OPTIONS_INIT_LENGTH);
-
+    vm.nativeCount = 0;
+    vm.nativeCapacity = 0;
+    vm.natives = NULL;
     vm.grayCount = 0;
     vm.grayCapacity = 0;
     vm.grayStack = NULL;
+    vm.viewCount = 0;
+    vm.viewCapacity = 0;
+    vm.viewStack = NULL;
     vm.bytesAllocated = 0;
     vm.nextGC = 1024 * 1024;
 
+    // 请注意 copyString 也是可以间接触发 GC 的函数，因此 GC 状态须先初始化
+    vm.initString = NULL;
+    vm.initString = copyString(LOXJ_OPTIONS_INIT, LOXJ_OPTIONS_INIT_LENGTH);
+    vm.lengthString = NULL;
+    vm.lengthString = copyString("length", 6);
+    vm.sizeString = NULL;
+    vm.sizeString = copyString("size", 4);
+    vm.stringBuilderClass = NULL;
+    vm.stringClass = NULL;
+    vm.arrayClass = NULL;
+    vm.typedArrayClass = NULL;
+    vm.mapClass = NULL;
+    vm.setClass = NULL;
+
 #ifdef LOXJ_OPTIONS_NATIVE
     loadBuiltInNative();
 #endif
@@ -197,7 +252,24 @@ void freeVM()
     freeTable(&vm.strings);
     freeTable(&vm.globals);
     vm.initString = NULL;
+    vm.lengthString = NULL;
+    vm.sizeString = NULL;
+    vm.stringBuilderClass = NULL;
+    vm.stringClass = NULL;
+    vm.arrayClass = NULL;
+    vm.typedArrayClass = NULL;
+    vm.mapClass = NULL;
+    vm.setClass = NULL;
     freeObjects();
+    flushOutput();
+
+    free(vm.natives);
+    vm.natives = NULL;
+    vm.nativeCount = vm.nativeCapacity = 0;
+
+    free(formatScratch);
+    formatScratch = NULL;
+    formatScratchCapacity = 0;
 }
 
 void push(Value value)
@@ -221,30 +293,109 @@ static Value peek(int distance)
     return vm.stackTop[-1 - distance];
 }
 
+/** 拼接栈顶两个值，其中数字按 formatNumber 转换为文本 */
 static void concatenate()
 {
-    ObjString *b = AS_STRING(peek(0));
-    ObjString *a = AS_STRING(peek(1));
-
-    int length = a->length + b->length;
-    char *chars = ALLOCATE(char, length + 1);
-    memcpy(chars, a->chars, a->length);
-    memcpy(chars + a->length, b->chars, b->length);
-    chars[length] = '\0';
-
-    ObjString *result = takeString(chars, length);
+    char bufferA[FORMAT_BUFFER], bufferB[FORMAT_BUFFER];
+    int lengthA, lengthB;
+    const char *b = formatValue(peek(0), bufferB, &lengthB);
+    const char *a = formatValue(peek(1), bufferA, &lengthA);
+
+    int length = lengthA + lengthB;
+    Value result;
+    if (length <= SMALL_STRING_MAX)
+    { // 结果通常仍是短字符串，无需分配
+        char chars[SMALL_STRING_BUFFER];
+        memcpy(chars, a, lengthA);
+        memcpy(chars + lengthA, b, lengthB);
+        result = copyStringValue(chars, length);
+    }
+    else
+    {
+        // 直接写入新字符串对象，两个操作数仍在栈上，分配触发 GC 也不会被回收
+        ObjString *string = makeString(length);
+        memcpy(string->chars, a, lengthA);
+        memcpy(string->chars + lengthA, b, lengthB);
+        result = OBJ_VAL(internString(string));
+    }
     pop();
     pop();
 
-    push(OBJ_VAL(result));
+    push(result);
 }
 
-static void runtimeError(const char *format, ...)
+/**
+ * 将栈顶 count 个值按文本拼接为一个字符串
+ * 先测量全部片段（数字等在此格式化到暂存区），再一次分配、一次驻留
+ */
+static void buildString(int count)
 {
-    va_list args;
-    va_start(args, format);
+    Value *parts = vm.stackTop - count;
+    const char *texts[UINT8_MAX]; // NULL 表示文本位于暂存区 offsets[i] 处
+    size_t offsets[UINT8_MAX];
+    int lengths[UINT8_MAX];
+    size_t used = 0;
+    int length = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (IS_OBJ_STRING(parts[i]))
+        {
+            texts[i] = AS_STRING(parts[i])->chars;
+            lengths[i] = AS_STRING(parts[i])->length;
+        }
+        else
+        {
+            if (used + FORMAT_BUFFER > formatScratchCapacity)
+            {
+                formatScratchCapacity = GROW_CAPACITY(formatScratchCapacity) + FORMAT_BUFFER;
+                formatScratch = (char *)realloc(formatScratch, formatScratchCapacity);
+                if (formatScratch == NULL)
+                    exit(1);
+            }
+
+            char *buffer = formatScratch + used;
+            const char *text = formatValue(parts[i], buffer, &lengths[i]);
+            if (text == buffer)
+            {
+                texts[i] = NULL;
+                offsets[i] = used;
+                used += lengths[i];
+            }
+            else
+            {
+                texts[i] = text; // 静态文本
+            }
+        }
+        length += lengths[i];
+    }
+
+    char small[SMALL_STRING_BUFFER];
+    ObjString *string = NULL;
+    char *chars = small;
+    if (length > SMALL_STRING_MAX)
+    {
+        string = makeString(length); // 片段仍在栈上，触发 GC 也不会被回收
+        chars = string->chars;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(chars, texts[i] != NULL ? texts[i] : formatScratch + offsets[i], lengths[i]);
+        chars += lengths[i];
+    }
+
+    vm.stackTop = parts;
+    if (string != NULL)
+        push(OBJ_VAL(internString(string)));
+    else
+        push(copyStringValue(small, length));
+}
+
+static void reportRuntimeError(const char *format, va_list args)
+{
+    flushOutput(); // 先写出已缓冲的输出，使错误信息出现在其后
     vfprintf(stderr, format, args);
-    va_end(args);
     fputs("\n", stderr);
 
     for (int i = vm.frameCount - 1; i >= 0; i--)
@@ -252,7 +403,7 @@ static void runtimeError(const char *format, ...)
         CallFrame *frame = &vm.frames[i];
         ObjFunction *function = frame->closure->function;
         size_t instruction = frame->ip - function->chunk.code - 1;
-        fprintf(stderr, "[line %d] at ", function->chunk.lines[instruction]);
+        fprintf(stderr, "[line %d] at ", getLine(&function->chunk, (int)instruction));
         if (function->name == NULL)
             fprintf(stderr, "<script>\n");
         else
@@ -262,6 +413,49 @@ static void runtimeError(const char *format, ...)
     resetStack();
 }
 
+static void runtimeError(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    reportRuntimeError(format, args);
+    va_end(args);
+}
+
+/**
+ * native 报告运行时错误，栈随之重置，native 应立即返回（返回值被忽略）
+ */
+void nativeError(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    reportRuntimeError(format, args);
+    va_end(args);
+}
+
+/**
+ * 检查调用帧数与值栈余量
+ * 值栈按每帧 UINT8_MAX + 1 个槽（局部变量与临时值）设计，局部变量更多的函数另需为临时值预留同样多的槽
+ */
+static bool checkStack(ObjFunction *function, Value *slots)
+{
+    int window = function->slotCount <= UINT8_MAX + 1 ? UINT8_MAX + 1 : function->slotCount + UINT8_MAX + 1;
+    if (vm.frameCount >= FRAMES_MAX || (slots - vm.stack) + window > STACK_MAX)
+    {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+    return true;
+}
+
+/** 延迟编译的函数在首次调用时编译函数体，语法错误作为运行时错误报告 */
+static bool ensureCompiled(ObjFunction *function)
+{
+    if (function->lazy == NULL || compileLazyFunction(function))
+        return true;
+    runtimeError("Could not compile %s().", function->name->chars);
+    return false;
+}
+
 /** 创建调用帧，设置指令指针，准备开始运行 */
 static bool call(ObjClosure *closure, int argCount)
 {
@@ -270,11 +464,10 @@ static bool call(ObjClosure *closure, int argCount)
         runtimeError("Expected %d arguments but got %d.", closure->function->arity, argCount);
         return false;
     }
-    if (vm.frameCount >= FRAMES_MAX)
-    {
-        runtimeError("Stack overflow.");
+    if (!ensureCompiled(closure->function))
+        return false;
+    if (!checkStack(closure->function, vm.stackTop - argCount - 1))
         return false;
-    }
 
     CallFrame *frame = &vm.frames[vm.frameCount++];
     frame->closure = closure;
@@ -297,6 +490,8 @@ static bool callValue(Value callee, int argCount)
         {
             NativeFn native = AS_NATIVE(callee);
             Value result = native(argCount, vm.stackTop - argCount);
+            if (vm.frameCount == 0)
+                return false; // native 回调 Lox 时发生运行时错误，错误已报告，栈已重置
             vm.stackTop -= argCount + 1;
             push(result);
             return true;
@@ -342,11 +537,139 @@ static bool invokeFromClass(ObjClass *klass, ObjString *name, int argCount)
     return call(AS_CLOSURE(method), argCount);
 }
 
+/**
+ * 内置类型（字符串、字符串构建器等）的方法表
+ * @return 不支持方法调用的值返回 NULL
+ */
+static ObjClass *builtinClass(Value receiver)
+{
+    if (IS_SMALL_STRING(receiver))
+        return vm.stringClass;
+    if (!IS_OBJ(receiver))
+        return NULL;
+
+    switch (OBJ_TYPE(receiver))
+    {
+    case OBJ_STRING:
+    case OBJ_STRING_VIEW:
+        return vm.stringClass;
+    case OBJ_ARRAY:
+        return vm.arrayClass;
+    case OBJ_TYPED_ARRAY:
+        return vm.typedArrayClass;
+    case OBJ_MAP:
+        return vm.mapClass;
+    case OBJ_SET:
+        return vm.setClass;
+    case OBJ_STRING_BUILDER:
+        return vm.stringBuilderClass;
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * 内置类型的属性（目前只有字符串、数组、类型化数组与 StringBuilder 的 length，Map 与 Set 的 size），
+ * 方法仍通过 builtinClass 调用
+ * @return 没有该属性时返回 false
+ */
+static bool builtinProperty(Value receiver, ObjString *name, Value *value)
+{
+    if (name == vm.sizeString)
+    {
+        if (IS_MAP(receiver))
+            *value = NUMBER_VAL(AS_MAP(receiver)->table.count);
+        else if (IS_SET(receiver))
+            *value = NUMBER_VAL(AS_SET(receiver)->table.count);
+        else
+            return false;
+        return true;
+    }
+    if (name != vm.lengthString)
+        return false;
+
+    if (IS_ARRAY(receiver))
+    {
+        *value = NUMBER_VAL(AS_ARRAY(receiver)->values.count);
+        return true;
+    }
+    if (IS_TYPED_ARRAY(receiver))
+    {
+        *value = NUMBER_VAL(AS_TYPED_ARRAY(receiver)->length);
+        return true;
+    }
+    if (IS_STRING_BUILDER(receiver))
+    {
+        *value = NUMBER_VAL(AS_STRING_BUILDER(receiver)->length);
+        return true;
+    }
+    if (IS_STRING(receiver))
+    { // 堆字符串与视图记录了长度，短字符串至多 SMALL_STRING_MAX 字节
+        char buffer[SMALL_STRING_BUFFER];
+        int length;
+        stringChars(receiver, buffer, &length);
+        *value = NUMBER_VAL(length);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * 将数组（含类型化数组）下标转为元素位置
+ * @return 下标不是整数或越界时报告运行时错误并返回 false
+ */
+static inline bool arrayIndex(Value index, int length, int *position)
+{
+    if (!IS_NUMBER(index))
+    {
+        runtimeError("Array index must be a number.");
+        return false;
+    }
+
+    double number = AS_NUMBER(index);
+    if (!(number >= 0 && number < length))
+    {
+        runtimeError("Array index %g out of bounds [0, %d).", number, length);
+        return false;
+    }
+
+    *position = (int)number;
+    if (*position != number)
+    {
+        runtimeError("Array index must be an integer.");
+        return false;
+    }
+    return true;
+}
+
+/** 调用内置类型的 native 方法，接收者连同参数一起传入 */
+static bool invokeBuiltin(ObjClass *klass, ObjString *name, int argCount)
+{
+    Value method;
+    if (!tableGet(&klass->methods, name, &method))
+    {
+        runtimeError("Undefined property '%s'.", name->chars);
+        return false;
+    }
+
+    Value *args = vm.stackTop - argCount - 1;
+    Value result = AS_NATIVE(method)(argCount + 1, args);
+    if (vm.frameCount == 0)
+        return false; // 同 callValue：回调 Lox 时发生运行时错误
+    vm.stackTop = args;
+    push(result);
+    return true;
+}
+
 static bool invoke(ObjString *name, int argCount)
 {
     Value receiver = peek(argCount);
     if (!IS_INSTANCE(receiver))
     {
+        ObjClass *klass = builtinClass(receiver);
+        if (klass != NULL)
+            return invokeBuiltin(klass, name, argCount);
+
         runtimeError("Only instances have methods.");
         return false;
     }
@@ -445,6 +768,57 @@ void defineNative(const char *name, NativeFn function)
     tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
     pop();
     pop();
+
+    if (vm.nativeCapacity < vm.nativeCount + 1)
+    {
+        vm.nativeCapacity = GROW_CAPACITY(vm.nativeCapacity);
+        vm.natives = (NativeEntry *)realloc(vm.natives, sizeof(NativeEntry) * vm.nativeCapacity);
+        if (vm.natives == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    vm.natives[vm.nativeCount++] = (NativeEntry){name, function};
+}
+
+/** @return 不是全局 native 时返回 NULL */
+const char *nativeName(NativeFn function)
+{
+    for (int i = 0; i < vm.nativeCount; i++)
+        if (vm.natives[i].function == function)
+            return vm.natives[i].name;
+    return NULL;
+}
+
+/** @return 没有该名称的全局 native 时返回 NULL */
+NativeFn findNative(const char *name, int length)
+{
+    for (int i = 0; i < vm.nativeCount; i++)
+        if (strncmp(vm.natives[i].name, name, length) == 0 && vm.natives[i].name[length] == '\0')
+            return vm.natives[i].function;
+    return NULL;
+}
+
+/**
+ * 创建内置类型的方法表，它不会成为全局变量
+ * 调用方须立即将其保存到 vm 中作为 GC 根
+ */
+ObjClass *newBuiltinClass(const char *name)
+{
+    push(OBJ_VAL(copyString(name, (int)strlen(name))));
+    ObjClass *klass = newClass(AS_STRING(peek(0)));
+    pop();
+    return klass;
+}
+
+void defineNativeMethod(ObjClass *klass, const char *name, NativeFn function)
+{
+    push(OBJ_VAL(copyString(name, (int)strlen(name))));
+    push(OBJ_VAL(newNative(function)));
+    tableSet(&klass->methods, AS_STRING(peek(1)), peek(0));
+    pop();
+    pop();
 }
 
 static InterpretResult run()
@@ -453,8 +827,9 @@ static InterpretResult run()
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1])) // short is two bytes, big endian
-#define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_WIDE() (frame->ip += 3, (uint32_t)((frame->ip[-3] << 16) | (frame->ip[-2] << 8) | frame->ip[-1]))
+#define CONSTANT_AT(index) (frame->closure->function->chunk.constants.values[index])
+#define STRING_AT(index) AS_STRING(CONSTANT_AT(index))
 #define BINARY_OP(VALUE_TYPE, OP)                       \
     do                                                  \
     {                                                   \
@@ -483,6 +858,11 @@ static InterpretResult run()
         push(NUMBER_VAL((double)(a OP b)));              \
     } while (false)
 
+    // 索引或跳转偏移：各指令先读出单字节（跳转为双字节）操作数，再转到共用的执行部分；
+    // OP_WIDE 读出 3 字节操作数后直接转到执行部分
+    uint32_t operand;
+    bool wide;
+
     // 字节码分派
     for (;;)
     {
@@ -513,11 +893,10 @@ static InterpretResult run()
         switch (instruction = READ_BYTE())
         {
         case OP_CONSTANT:
-        {
-            Value constant = READ_CONSTANT();
-            push(constant);
+            operand = READ_BYTE();
+        opConstant:
+            push(CONSTANT_AT(operand));
             break;
-        }
         case OP_NIL:
             push(NIL_VAL);
             break;
@@ -530,21 +909,24 @@ static InterpretResult run()
         case OP_POP:
             pop();
             break;
+        case OP_POPN:
+            vm.stackTop -= READ_BYTE();
+            break;
         case OP_GET_LOCAL:
-        {
-            uint8_t slot = READ_BYTE();
-            push(frame->slots[slot]);
+            operand = READ_BYTE();
+        opGetLocal:
+            push(frame->slots[operand]);
             break;
-        }
         case OP_SET_LOCAL:
-        {
-            uint8_t slot = READ_BYTE();
-            frame->slots[slot] = peek(0);
+            operand = READ_BYTE();
+        opSetLocal:
+            frame->slots[operand] = peek(0);
             break;
-        }
         case OP_GET_GLOBAL:
+            operand = READ_BYTE();
+        opGetGlobal:
         {
-            ObjString *name = READ_STRING();
+            ObjString *name = STRING_AT(operand);
             Value value;
             if (!tableGet(&vm.globals, name, &value))
             {
@@ -555,15 +937,19 @@ static InterpretResult run()
             break;
         }
         case OP_DEFINE_GLOBAL:
+            operand = READ_BYTE();
+        opDefineGlobal:
         {
-            ObjString *name = READ_STRING();
+            ObjString *name = STRING_AT(operand);
             tableSet(&vm.globals, name, peek(0));
             pop();
             break;
         }
         case OP_SET_GLOBAL:
+            operand = READ_BYTE();
+        opSetGlobal:
         {
-            ObjString *name = READ_STRING();
+            ObjString *name = STRING_AT(operand);
             if (tableSet(&vm.globals, name, peek(0)))
             { // 全局变量，必须已有才能设置
                 tableDelete(&vm.globals, name);
@@ -573,17 +959,15 @@ static InterpretResult run()
             break;
         }
         case OP_GET_UPVALUE:
-        {
-            uint8_t slot = READ_BYTE();
-            push(*frame->closure->upvalues[slot]->location);
+            operand = READ_BYTE();
+        opGetUpvalue:
+            push(*frame->closure->upvalues[operand]->location);
             break;
-        }
         case OP_SET_UPVALUE:
-        {
-            uint8_t slot = READ_BYTE();
-            *frame->closure->upvalues[slot]->location = peek(0);
+            operand = READ_BYTE();
+        opSetUpvalue:
+            *frame->closure->upvalues[operand]->location = peek(0);
             break;
-        }
         case OP_CLOSE_UPVALUE:
         {
             closeUpvalues(vm.stackTop - 1);
@@ -605,7 +989,8 @@ static InterpretResult run()
             break;
         case OP_ADD:
         {
-            if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
+            if ((IS_STRING(peek(0)) && (IS_STRING(peek(1)) || IS_NUMBER(peek(1)))) ||
+                (IS_NUMBER(peek(0)) && IS_STRING(peek(1))))
             {
                 concatenate();
             }
@@ -617,7 +1002,7 @@ static InterpretResult run()
             }
             else
             {
-                runtimeError("Operands must be two numbers or two strings.");
+                runtimeError("Operands must be numbers or strings.");
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
@@ -674,39 +1059,48 @@ static InterpretResult run()
         case OP_UNSIGNED_RIGHT_SHIFT:
             BINARY_BITWISE_OP(uint32_t, >>);
             break;
+        case OP_BUILD_STRING:
+            buildString(READ_BYTE());
+            break;
         case OP_PRINT:
             printValue(pop());
-            putchar('\n');
-            fflush(stdout);
+            writeOutput("\n", 1);
+            flushLine();
             break;
         case OP_JUMP:
-        {
-            uint16_t offset = READ_SHORT();
-            frame->ip += offset;
+            operand = READ_SHORT();
+        opJump:
+            frame->ip += operand;
             break;
-        }
         case OP_JUMP_IF_FALSE:
-        {
-            uint16_t offset = READ_SHORT();
+            operand = READ_SHORT();
+        opJumpIfFalse:
             if (isFalsey(peek(0)))
-                frame->ip += offset;
+                frame->ip += operand;
+            break;
+        case OP_POP_JUMP_IF_FALSE:
+            operand = READ_SHORT();
+        opPopJumpIfFalse:
+            if (isFalsey(pop()))
+                frame->ip += operand;
             break;
-        }
         case OP_LOOP:
-        {
-            uint16_t offset = READ_SHORT();
-            frame->ip += offset;
+            operand = READ_SHORT();
+        opLoop:
+            frame->ip -= operand;
             break;
-        }
         case OP_CLOSURE:
+            operand = READ_BYTE();
+            wide = false;
+        opClosure:
         {
-            ObjFunction *function = AS_FUNCTION(READ_CONSTANT());
+            ObjFunction *function = AS_FUNCTION(CONSTANT_AT(operand));
             ObjClosure *closure = newClosure(function);
             push(OBJ_VAL(closure));
             for (int i = 0; i < closure->upvalueCount; i++)
             {
                 uint8_t isLocal = READ_BYTE();
-                uint8_t index = READ_BYTE();
+                uint32_t index = wide ? READ_WIDE() : READ_BYTE();
                 if (isLocal)
                     closure->upvalues[i] = captureUpvalue(frame->slots + index);
                 else
@@ -734,18 +1128,26 @@ static InterpretResult run()
             }
             vm.stackTop = frame->slots;
             push(returnValue);
+            if (vm.frameCount == vm.baseFrame)
+                return INTERPRET_OK; // 嵌套的 run() 结束，返回值留在栈顶
             frame = &vm.frames[vm.frameCount - 1];
             break;
         }
         case OP_CLASS:
-            push(OBJ_VAL(newClass(READ_STRING())));
+            operand = READ_BYTE();
+        opClass:
+            push(OBJ_VAL(newClass(STRING_AT(operand))));
             break;
         case OP_METHOD:
-            defineMethod(READ_STRING());
+            operand = READ_BYTE();
+        opMethod:
+            defineMethod(STRING_AT(operand));
             break;
         case OP_INVOKE:
+            operand = READ_BYTE();
+        opInvoke:
         {
-            ObjString *method = READ_STRING();
+            ObjString *method = STRING_AT(operand);
             int argCount = READ_BYTE();
 
             if (!invoke(method, argCount))
@@ -770,8 +1172,10 @@ static InterpretResult run()
             break;
         }
         case OP_GET_SUPER:
+            operand = READ_BYTE();
+        opGetSuper:
         {
-            ObjString *name = READ_STRING();
+            ObjString *name = STRING_AT(operand);
             ObjClass *superclass = AS_CLASS(pop());
 
             if (!bindMethod(superclass, name))
@@ -780,8 +1184,10 @@ static InterpretResult run()
             break;
         }
         case OP_SUPER_INVOKE:
+            operand = READ_BYTE();
+        opSuperInvoke:
         {
-            ObjString *method = READ_STRING();
+            ObjString *method = STRING_AT(operand);
             int argCount = READ_BYTE();
             ObjClass *superclass = AS_CLASS(pop());
 
@@ -792,15 +1198,23 @@ static InterpretResult run()
             break;
         }
         case OP_GET_PROPERTY:
+            operand = READ_BYTE();
+        opGetProperty:
         {
             if (!IS_INSTANCE(peek(0)))
             {
+                Value value;
+                if (builtinProperty(peek(0), STRING_AT(operand), &value))
+                {
+                    vm.stackTop[-1] = value;
+                    break;
+                }
                 runtimeError("Only instances have properties.");
                 return INTERPRET_RUNTIME_ERROR;
             }
 
             ObjInstance *instance = AS_INSTANCE(peek(0));
-            ObjString *name = READ_STRING();
+            ObjString *name = STRING_AT(operand);
 
             Value value;
             if (tableGet(&instance->fields, name, &value))
@@ -815,6 +1229,8 @@ static InterpretResult run()
             break;
         }
         case OP_SET_PROPERTY:
+            operand = READ_BYTE();
+        opSetProperty:
         {
             if (!IS_INSTANCE(peek(1)))
             {
@@ -823,43 +1239,291 @@ static InterpretResult run()
             }
 
             ObjInstance *instance = AS_INSTANCE(peek(1));
-            tableSet(&instance->fields, READ_STRING(), peek(0));
+            tableSet(&instance->fields, STRING_AT(operand), peek(0));
             Value value = pop();
             pop();
             push(value);
             break;
         }
+        case OP_ARRAY:
+        {
+            int count = READ_BYTE();
+            ObjArray *array = newArray(); // 元素仍在栈上，分配触发 GC 也不会被回收
+            push(OBJ_VAL(array));
+            if (count > 0)
+            {
+                array->values.values = GROW_ARRAY(Value, NULL, 0, count);
+                array->values.capacity = count;
+                memcpy(array->values.values, vm.stackTop - 1 - count, sizeof(Value) * count);
+                array->values.count = count;
+            }
+            vm.stackTop -= count + 1;
+            push(OBJ_VAL(array));
+            break;
+        }
+        case OP_GET_INDEX:
+        {
+            Value target = peek(1);
+            int position;
+            if (IS_ARRAY(target))
+            {
+                ObjArray *array = AS_ARRAY(target);
+                if (!arrayIndex(peek(0), array->values.count, &position))
+                    return INTERPRET_RUNTIME_ERROR;
+
+                vm.stackTop--;
+                vm.stackTop[-1] = array->values.values[position];
+                break;
+            }
+            if (IS_TYPED_ARRAY(target))
+            {
+                ObjTypedArray *array = AS_TYPED_ARRAY(target);
+                if (!arrayIndex(peek(0), array->length, &position))
+                    return INTERPRET_RUNTIME_ERROR;
+
+                vm.stackTop--;
+                vm.stackTop[-1] = NUMBER_VAL(typedArrayGet(array, position));
+                break;
+            }
+
+            runtimeError("Only arrays can be indexed.");
+            return INTERPRET_RUNTIME_ERROR;
+        }
+        case OP_SET_INDEX:
+        {
+            Value target = peek(2);
+            Value value = peek(0);
+            int position;
+            if (IS_ARRAY(target))
+            {
+                ObjArray *array = AS_ARRAY(target);
+                if (!arrayIndex(peek(1), array->values.count, &position))
+                    return INTERPRET_RUNTIME_ERROR;
+
+                array->values.values[position] = value;
+                vm.stackTop -= 2;
+                vm.stackTop[-1] = value;
+                break;
+            }
+            if (IS_TYPED_ARRAY(target))
+            {
+                ObjTypedArray *array = AS_TYPED_ARRAY(target);
+                if (!arrayIndex(peek(1), array->length, &position))
+                    return INTERPRET_RUNTIME_ERROR;
+                if (!IS_NUMBER(value))
+                {
+                    runtimeError("Typed array elements must be numbers.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+
+                typedArraySet(array, position, AS_NUMBER(value));
+                vm.stackTop -= 2;
+                vm.stackTop[-1] = value;
+                break;
+            }
+
+            runtimeError("Only arrays can be indexed.");
+            return INTERPRET_RUNTIME_ERROR;
+        }
         case OP_TYPEOF:
         {
             Value value = pop();
             const char *t = typeofValue(value); // 常量字符串，无需管理 GC
-            ObjString *s = copyString(t, strlen(t));
-            push(OBJ_VAL(s));
+            push(copyStringValue(t, (int)strlen(t)));
             break;
         }
+        case OP_WIDE:
+            instruction = READ_BYTE();
+            operand = READ_WIDE();
+            switch (instruction)
+            {
+            case OP_CONSTANT:
+                goto opConstant;
+            case OP_GET_LOCAL:
+                goto opGetLocal;
+            case OP_SET_LOCAL:
+                goto opSetLocal;
+            case OP_GET_GLOBAL:
+                goto opGetGlobal;
+            case OP_DEFINE_GLOBAL:
+                goto opDefineGlobal;
+            case OP_SET_GLOBAL:
+                goto opSetGlobal;
+            case OP_GET_UPVALUE:
+                goto opGetUpvalue;
+            case OP_SET_UPVALUE:
+                goto opSetUpvalue;
+            case OP_JUMP:
+                goto opJump;
+            case OP_JUMP_IF_FALSE:
+                goto opJumpIfFalse;
+            case OP_POP_JUMP_IF_FALSE:
+                goto opPopJumpIfFalse;
+            case OP_LOOP:
+                goto opLoop;
+            case OP_CLOSURE:
+                wide = true;
+                goto opClosure;
+            case OP_CLASS:
+                goto opClass;
+            case OP_METHOD:
+                goto opMethod;
+            case OP_INVOKE:
+                goto opInvoke;
+            case OP_GET_SUPER:
+                goto opGetSuper;
+            case OP_SUPER_INVOKE:
+                goto opSuperInvoke;
+            case OP_GET_PROPERTY:
+                goto opGetProperty;
+            case OP_SET_PROPERTY:
+                goto opSetProperty;
+            }
+            runtimeError("Unknown wide opcode %d.", instruction);
+            return INTERPRET_RUNTIME_ERROR;
         }
     }
 
 #undef RUNTIME_ERROR
 #undef READ_BYTE
-#undef READ_CONSTANT
-#undef READ_STRING
+#undef READ_WIDE
+#undef CONSTANT_AT
+#undef STRING_AT
 #undef READ_SHORT
 #undef BINARY_OP
 #undef BINARY_BITWISE_OP
 }
 
+/**
+ * 在嵌套的 run() 中执行 frameCount 之上新建的调用帧，直到它返回
+ * 出错时 resetStack 已将 baseFrame 归零，不再恢复外层的值
+ */
+static bool runNested(int frameCount)
+{
+    if (vm.frameCount == frameCount)
+        return true; // native 或无构造器的类，已经完成
+
+    int baseFrame = vm.baseFrame;
+    vm.baseFrame = frameCount;
+    if (run() != INTERPRET_OK)
+        return false;
+    vm.baseFrame = baseFrame;
+    return true;
+}
+
+/**
+ * 供 native 调用 Lox 的可调用值：调用方已依次压入被调用值与 argCount 个参数
+ * 闭包在嵌套的 run() 中执行至返回，共用 vm 栈与调用帧，返回值替换被调用值与参数留在栈顶
+ * @return 发生运行时错误时返回 false，此时错误已报告、栈已重置，native 应立即返回
+ */
+bool callFromNative(int argCount)
+{
+    int frameCount = vm.frameCount;
+    if (!callValue(vm.stackTop[-argCount - 1], argCount))
+        return false;
+    return runNested(frameCount);
+}
+
+/**
+ * 为反复调用 callee 预留栈槽：被调用值（保活用）、槽 0 与 argCount 个参数槽，参数槽初始为 nil
+ * 在 endCall 之前，native 压入的值须在 repeatCall 之前全部弹出
+ * @return 不可调用或参数个数不符时报告运行时错误并返回 false，native 应立即返回
+ */
+bool beginCall(NativeCall *call, Value callee, int argCount)
+{
+    call->callee = callee;
+    call->closure = NULL;
+    call->receiver = callee;
+    call->argCount = argCount;
+
+    if (IS_CLOSURE(callee))
+    {
+        call->closure = AS_CLOSURE(callee);
+    }
+    else if (IS_BOUND_METHOD(callee))
+    {
+        call->closure = AS_BOUND_METHOD(callee)->method;
+        call->receiver = AS_BOUND_METHOD(callee)->receiver;
+    }
+    else if (!IS_OBJ(callee) || (!IS_NATIVE(callee) && !IS_CLASS(callee)))
+    {
+        runtimeError("Can only call functions and classes.");
+        return false;
+    }
+
+    if (call->closure != NULL && call->closure->function->arity != argCount)
+    {
+        runtimeError("Expected %d arguments but got %d.", call->closure->function->arity, argCount);
+        return false;
+    }
+    if (call->closure != NULL && !ensureCompiled(call->closure->function))
+        return false; // 在 beginCall 中编译，repeatCall 只需建立调用帧
+
+    push(callee);
+    push(callee);
+    call->args = vm.stackTop;
+    for (int i = 0; i < argCount; i++)
+        push(NIL_VAL);
+    return true;
+}
+
+/**
+ * 以 call->args 中的参数调用一次，参数槽在调用后内容不定，下次调用前须全部重写
+ * @return 发生运行时错误时返回 false，此时错误已报告、栈已重置，native 应立即返回且不再调用 endCall
+ */
+bool repeatCall(NativeCall *call, Value *result)
+{
+    Value *slot = call->args - 1;
+    vm.stackTop = call->args + call->argCount;
+    int frameCount = vm.frameCount;
+
+    if (call->closure != NULL)
+    { // 参数个数已在 beginCall 检查，只需建立调用帧
+        if (!checkStack(call->closure->function, slot))
+            return false;
+        *slot = call->receiver;
+        CallFrame *frame = &vm.frames[vm.frameCount++];
+        frame->closure = call->closure;
+        frame->ip = call->closure->function->chunk.code;
+        frame->slots = slot;
+    }
+    else
+    {
+        *slot = call->callee;
+        if (!callValue(call->callee, call->argCount))
+            return false;
+    }
+
+    if (!runNested(frameCount))
+        return false;
+    *result = vm.stackTop[-1]; // 返回值位于槽 0，下次调用前保持可达
+    vm.stackTop = call->args + call->argCount;
+    return true;
+}
+
+/** 释放 beginCall 预留的栈槽 */
+void endCall(NativeCall *call)
+{
+    vm.stackTop = call->args - 2;
+}
+
 InterpretResult interpret(const char *sourceCode)
 {
     ObjFunction *function = compile(sourceCode);
     if (function == NULL)
         return INTERPRET_COMPILE_ERROR;
+    return interpretFunction(function);
+}
 
+/** 执行编译或从字节码文件载入的顶层函数 */
+InterpretResult interpretFunction(ObjFunction *function)
+{
     push(OBJ_VAL(function));
     ObjClosure *closure = newClosure(function);
     pop();
     push(OBJ_VAL(closure));
-    call(closure, 0);
+    if (!call(closure, 0))
+        return INTERPRET_RUNTIME_ERROR; // 顶层的局部变量过多，值栈放不下
 
     return run();
 }
@@ -21,6 +21,13 @@ typedef struct
 } CallFrame;
 // https://github.com/munificent/craftinginterpreters/blob/master/note/answers/chapter25_closures/1.md
 
+/** defineNative 定义的全局 native，堆快照按名称引用 native（函数地址每次运行都不同） */
+typedef struct
+{
+    const char *name;
+    NativeFn function;
+} NativeEntry;
+
 typedef struct
 {
     Chunk *chunk;
@@ -40,22 +47,61 @@ typedef struct
     /** 调用帧 */
     CallFrame frames[FRAMES_MAX];
     int frameCount;
+    /** 当前 run() 的起始帧数，native 嵌套调用 Lox 函数时大于 0 */
+    int baseFrame;
     /** 开放上值链表 */
     ObjUpvalue *openUpvalues;
 
     /** constructor */
     ObjString *initString;
+    /** 数组、字符串的 length 属性名 */
+    ObjString *lengthString;
+    /** Map、Set 的 size 属性名 */
+    ObjString *sizeString;
+
+    /** 内置类型的方法表，方法均为 native，接收者作为第一个参数传入 */
+    ObjClass *stringBuilderClass;
+    ObjClass *stringClass;
+    ObjClass *arrayClass;
+    ObjClass *typedArrayClass;
+    ObjClass *mapClass;
+    ObjClass *setClass;
+
+    // 按定义顺序登记的全局 native
+    int nativeCount;
+    int nativeCapacity;
+    NativeEntry *natives;
 
     // 灰色对象工作列表
     int grayCount;
     int grayCapacity;
     Obj **grayStack;
+    // 推迟处理的视图：标记结束后再决定保活其持有者还是物化视图
+    int viewCount;
+    int viewCapacity;
+    ObjStringView **viewStack;
 
     // 决定GC调度时机
     size_t bytesAllocated;
     size_t nextGC;
 } VM;
 
+/**
+ * native 反复调用同一个可调用值：beginCall 一次性预留栈槽并解析被调用值，
+ * 此后每次调用只需写入 args 并执行 repeatCall，不再压入被调用值或重新分派
+ */
+typedef struct
+{
+    Value callee;
+    /** 闭包或绑定方法解析出的闭包，其他可调用值为 NULL，按一般调用分派 */
+    ObjClosure *closure;
+    /** 闭包的槽 0：闭包自身或绑定方法的接收者 */
+    Value receiver;
+    int argCount;
+    /** 参数槽，位于 vm 栈上，repeatCall 之前由 native 写入 */
+    Value *args;
+} NativeCall;
+
 typedef enum
 {
     INTERPRET_OK,
@@ -68,8 +114,18 @@ void initVM();
 void freeVM();
 
 InterpretResult interpret(const char *sourceCode);
+InterpretResult interpretFunction(ObjFunction *function);
 void push(Value value);
 Value pop();
 void defineNative(const char *name, NativeFn function);
+const char *nativeName(NativeFn function);
+NativeFn findNative(const char *name, int length);
+void nativeError(const char *format, ...);
+bool callFromNative(int argCount);
+bool beginCall(NativeCall *call, Value callee, int argCount);
+bool repeatCall(NativeCall *call, Value *result);
+void endCall(NativeCall *call);
+ObjClass *newBuiltinClass(const char *name);
+void defineNativeMethod(ObjClass *klass, const char *name, NativeFn function);
 
 #endif
\ No newline at end of file
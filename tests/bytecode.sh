@@ -0,0 +1,110 @@
+#!/bin/sh
+# 字节码文件：编译后载入运行与直接运行源码的结果相同；截断的文件被拒绝，改动任意字节都不会使解释器崩溃
+# 用法：sh tests/bytecode.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+fail()
+{
+    echo "bytecode: $*"
+    status=1
+}
+
+# 运行 loxj，有 timeout 时防止改动后的跳转形成死循环
+run()
+{
+    if command -v timeout >/dev/null 2>&1; then
+        timeout 10 "$loxj" "$@"
+    else
+        "$loxj" "$@"
+    fi
+}
+
+# 将 $1 第 $2 个字节按位取反
+flip()
+{
+    byte=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\$(printf %o $((byte ^ 255)))" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+cat > "$dir/program.js" <<'LOX'
+class Counter
+{
+    constructor(start)
+    {
+        this.count = start;
+    }
+
+    next()
+    {
+        this.count = this.count + 1;
+        return this.count;
+    }
+}
+
+fun makeAdder(n)
+{
+    fun add(x)
+    {
+        return x + n;
+    }
+    return add;
+}
+
+var counter = Counter(10);
+counter.next();
+print counter.next();
+var add3 = makeAdder(3);
+print add3(4);
+print "text " + 1.5;
+LOX
+expected=$(printf '12\n7\ntext 1.5')
+
+# 往返
+"$loxj" --compile "$dir/program.js" -o "$dir/program.loxc" || fail "--compile failed"
+[ "$("$loxj" --no-cache "$dir/program.js")" = "$expected" ] || fail "source output differs"
+[ "$(run "$dir/program.loxc")" = "$expected" ] || fail "round trip output differs"
+
+# 截断：魔数之后任何位置截断都报告无法载入，载入失败时不会执行，无需 timeout
+size=$(wc -c < "$dir/program.loxc")
+length=4
+while [ "$length" -lt "$size" ]; do
+    head -c "$length" "$dir/program.loxc" > "$dir/truncated.loxc"
+    case $("$loxj" "$dir/truncated.loxc" 2>&1) in
+    *"Could not load"*) ;;
+    *) fail "truncated to $length bytes was not rejected" ;;
+    esac
+    length=$((length + 1))
+done
+
+# 指定位置的改动：版本号、顶层函数的参数个数、最后一项行号的高字节
+check()
+{
+    cp "$dir/program.loxc" "$dir/flipped.loxc"
+    flip "$dir/flipped.loxc" "$1"
+    case $(run "$dir/flipped.loxc" 2>&1) in
+    *"$2"*) ;;
+    *) fail "flipping byte $1 did not report '$2'" ;;
+    esac
+}
+check 4 "bytecode version mismatch"
+check 36 "corrupt bytecode"
+check $((size - 1)) "corrupt bytecode"
+
+# 逐字节改动：要么被拒绝（65），要么正常运行或报告运行时错误，不能崩溃
+offset=0
+while [ "$offset" -lt "$size" ]; do
+    cp "$dir/program.loxc" "$dir/flipped.loxc"
+    flip "$dir/flipped.loxc" "$offset"
+    run "$dir/flipped.loxc" >/dev/null 2>&1
+    code=$?
+    case $code in
+    0 | 65 | 70) ;;
+    *) fail "flipping byte $offset exited with status $code" ;;
+    esac
+    offset=$((offset + 1))
+done
+
+exit $status
@@ -0,0 +1,70 @@
+#!/bin/sh
+# 编译缓存：未命中时写入缓存项，命中时直接载入（不重写），源码改动后另建缓存项，
+# 损坏或键不符的缓存项被拒绝并重新编译覆盖，缓存项个数有上限
+# 用法：sh tests/cache.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cache=$dir/cache
+status=0
+
+fail()
+{
+    echo "cache: $*"
+    status=1
+}
+
+# 缓存项的 inode，命中时文件不变，重写时先写临时文件再改名，inode 随之改变
+inode()
+{
+    ls -i "$1" | awk '{ print $1 }'
+}
+
+entries()
+{
+    ls "$cache" | grep -c '\.loxc$'
+}
+
+echo 'var a = 20; print a + 1;' > "$dir/first.js"
+echo 'var a = 20; print a + 2;' > "$dir/second.js"
+
+# 未命中
+[ "$("$loxj" --cache-dir "$cache" "$dir/first.js")" = 21 ] || fail "first run output differs"
+[ "$(entries)" = 1 ] || fail "miss did not write one entry"
+first=$(ls "$cache"/*.loxc)
+before=$(inode "$first")
+
+# 命中
+[ "$("$loxj" --cache-dir "$cache" "$dir/first.js")" = 21 ] || fail "cached run output differs"
+[ "$(inode "$first")" = "$before" ] || fail "hit rewrote the entry"
+
+# 源码改动后未命中
+[ "$("$loxj" --cache-dir "$cache" "$dir/second.js")" = 22 ] || fail "edited source output differs"
+[ "$(entries)" = 2 ] || fail "edited source did not get its own entry"
+second=$(ls "$cache"/*.loxc | grep -v "$first")
+
+# 损坏的缓存项：改动最后一个字节（行号表），重新编译并覆盖
+cp "$first" "$dir/good.loxc"
+printf '\377' | dd of="$first" bs=1 seek=$(($(wc -c < "$first") - 1)) conv=notrunc 2>/dev/null
+[ "$("$loxj" --cache-dir "$cache" "$dir/first.js")" = 21 ] || fail "corrupt entry output differs"
+cmp -s "$first" "$dir/good.loxc" || fail "corrupt entry was not rewritten"
+
+# 键不符：另一份源码的缓存项放在这个名字下
+cp "$first" "$second"
+[ "$("$loxj" --cache-dir "$cache" "$dir/second.js")" = 22 ] || fail "mismatched entry was used"
+cmp -s "$first" "$second" && fail "mismatched entry was not rewritten"
+
+# 上限：写入新缓存项后只保留最近使用的 256 项
+i=0
+while [ $i -lt 300 ]; do
+    name=$(printf '%016x' $((i + 4096)))
+    cp "$dir/good.loxc" "$cache/$name.loxc"
+    touch -t 200001010000 "$cache/$name.loxc"
+    i=$((i + 1))
+done
+echo 'print 3;' > "$dir/third.js"
+[ "$("$loxj" --cache-dir "$cache" "$dir/third.js")" = 3 ] || fail "third run output differs"
+[ "$(entries)" = 256 ] || fail "cache holds $(entries) entries instead of 256"
+[ -e "$first" ] && [ -e "$second" ] || fail "recently used entries were evicted"
+
+exit $status
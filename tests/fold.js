@@ -0,0 +1,17 @@
+// 常量折叠：嵌套的子表达式折叠后，外层运算继续折叠
+var a = 1 + 2 * 3;
+var b = 60 * 60 * 24 + (1 << 10) - 2 * 3;
+var c = 2 * (3 + 4);
+var d = -(1 + 2) * ~0;
+var e = "a" + "b" + ("c" + "d");
+// 只有一个操作数是常量时保留运算，类型错误留到运行时；左操作数是算术结果（必为数值）时化简
+var f = a * 1;
+var g = a / 1 - 0;
+var i = (a - 2) * 1 / 1;
+var j = ~a - 0;
+// 不会化简：-0 + 0 为 0，-0 - -0 为 0，比较的结果不是数值
+var k = (a - 2) + 0;
+var l = (a * 2) - -0;
+var m = (a < 2) * 1;
+// 不会折叠：运行时错误
+var h = "abc" * 1;
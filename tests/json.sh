@@ -0,0 +1,56 @@
+#!/bin/sh
+# jsonParse：合法输入的解析结果；非法输入报告运行时错误，指出出错处的字节偏移
+# 用法：sh tests/json.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+fail()
+{
+    echo "json: $*"
+    status=1
+}
+
+# 按原样写出 JSON 文本，由 readFile 读入，不经过 Lox 字符串字面量的转义
+# check <json> <期望的输出或错误信息>
+check()
+{
+    printf '%s' "$1" > "$dir/input.json"
+    output=$("$loxj" --no-cache "$dir/parse.js" 2>&1 | head -n 1)
+    [ "$output" = "$2" ] || fail "'$1': got '$output', expected '$2'"
+}
+
+cat > "$dir/parse.js" <<LOX
+print jsonParse(readFile("$dir/input.json"));
+LOX
+
+check 'null' 'nil'
+check ' [] ' '[]'
+check '{"a": [1, -2.5e3, true, false, null], "b": {}}' 'Map {a => [1, -2500, true, false, nil], b => Map {}}'
+check '"tab\there é 😀 \"q\" \\"' 'tab	here é 😀 "q" \'
+
+check '' 'Invalid JSON at byte 0.'
+check '{bad' 'Invalid JSON at byte 1.'
+check '[1,]' 'Invalid JSON at byte 3.'
+check '[1 2]' 'Invalid JSON at byte 3.'
+check '[1,' 'Invalid JSON at byte 3.'
+check '{"a" 1}' 'Invalid JSON at byte 5.'
+check '1 2' 'Invalid JSON at byte 2.'
+check 'tru' 'Invalid JSON at byte 0.'
+check '01' 'Invalid JSON at byte 0.'
+check '"abc' 'Invalid JSON at byte 4.'
+check '["a", "x\qy"]' 'Invalid JSON at byte 8.'
+check '"\ud800"' 'Invalid JSON at byte 1.'
+check '"\ud800A"' 'Invalid JSON at byte 1.'
+check '"ok \udc00"' 'Invalid JSON at byte 4.'
+check "$(printf '%0300d' 0 | tr 0 '[')" 'JSON nested too deeply at byte 256.'
+
+# 出错时以运行时错误的状态退出，且不输出结果
+printf '[1,]' > "$dir/input.json"
+"$loxj" --no-cache "$dir/parse.js" > "$dir/stdout" 2> /dev/null
+code=$?
+[ $code = 70 ] || fail "exit status $code, expected 70"
+[ -s "$dir/stdout" ] && fail "printed a result for invalid input"
+
+exit $status
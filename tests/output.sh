@@ -0,0 +1,79 @@
+#!/bin/sh
+# outputMode：explicit 模式只在 flush() 或退出时写出，超过 64 KiB 的缓冲区也不写出；
+# block 模式在缓冲区满时写出，line 模式每条 print 后写出
+# 脚本读取自身标准输出所重定向到的文件，得到已写出的字节数
+# 用法：sh tests/output.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+fail()
+{
+    echo "output: $*"
+    status=1
+}
+
+# run <模式>：打印 200 行共 120000 字节后记下已写出的字节数，flush() 后再记一次
+run()
+{
+    cat > "$dir/mode.js" <<LOX
+fun written()
+{
+    var text = readFile("$dir/out.txt");
+    if (text == nil)
+        return 0;
+    return text.length;
+}
+
+outputMode("$1");
+var line = "";
+for (var i = 0; i < 599; i = i + 1)
+    line = line + "x";
+for (var i = 0; i < 200; i = i + 1)
+    print line;
+var before = written();
+flush();
+var after = written();
+print "$1 " + before + " " + after;
+LOX
+    "$loxj" --no-cache "$dir/mode.js" > "$dir/out.txt"
+    tail -n 1 "$dir/out.txt"
+    lines=$(wc -l < "$dir/out.txt")
+    [ "$lines" -eq 201 ] || fail "$1: wrote $lines lines, expected 201"
+}
+
+result=$(run explicit)
+[ "$result" = "explicit 0 120000" ] || fail "explicit: got '$result'"
+result=$(run line)
+[ "$result" = "line 120000 120000" ] || fail "line: got '$result'"
+result=$(run block)
+case $result in
+"block 0 120000" | "block 120000 120000") fail "block: got '$result', expected a partial write" ;;
+"block "*" 120000") ;;
+*) fail "block: got '$result'" ;;
+esac
+
+# outputMode 返回之前的模式；离开 explicit 模式、运行时错误与 exit() 都会写出尚未写出的输出
+cat > "$dir/switch.js" <<'LOX'
+print outputMode("explicit");
+print outputMode("block");
+outputMode("explicit");
+print "pending";
+outputMode("line");
+outputMode("explicit");
+print "before error";
+var x = nil + 1;
+LOX
+output=$("$loxj" --no-cache "$dir/switch.js" 2> /dev/null)
+expected="block
+explicit
+pending
+before error"
+[ "$output" = "$expected" ] || fail "switching modes: got '$output'"
+
+printf 'outputMode("explicit");\nprint "bye";\nexit();\nprint "unreachable";\n' > "$dir/exit.js"
+output=$("$loxj" --no-cache "$dir/exit.js")
+[ "$output" = bye ] || fail "exit(): got '$output'"
+
+exit $status
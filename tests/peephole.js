@@ -0,0 +1,51 @@
+// 窥孔优化：每个函数覆盖一种改写
+
+// 跳转到跳转：内层 else 结束处的 OP_JUMP 直接跳到外层 if 之后
+fun thread(a, b)
+{
+    if (a)
+    {
+        if (b)
+            print 1;
+        else
+            print 2;
+    }
+    else
+        print 3;
+}
+
+// return 之后的代码不可达，整段删除
+fun dead()
+{
+    return 1;
+    print 2;
+    print 3;
+}
+
+// 循环条件的 OP_JUMP_IF_FALSE 与两个分支上的 OP_POP 融合为 OP_POP_JUMP_IF_FALSE
+fun loop(n)
+{
+    var i = 0;
+    while (i < n)
+        i = i + 1;
+    return i;
+}
+
+// 赋值语句后紧接着读取同一变量：SET x; OP_POP; GET x 只保留 SET x
+fun reload()
+{
+    var x = 1;
+    x = x + 1;
+    print x;
+}
+
+// 作用域结束时连续的 OP_POP 合并为 OP_POPN
+fun scope()
+{
+    {
+        var a = 1;
+        var b = 2;
+        var c = 3;
+        print a + b + c;
+    }
+}
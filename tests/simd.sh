@@ -0,0 +1,132 @@
+#!/bin/sh
+# 向量内核：类型化数组的批量运算、字符串搜索与 CSV 分隔符定位，与标量循环的结果逐一比较
+# 长度覆盖各向量宽度的整块与余数；CPU 支持 AVX2 时运行的是 AVX2 内核，否则是 SSE2 或标量内核
+# 用法：sh tests/simd.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+fail()
+{
+    echo "simd: $*"
+    status=1
+}
+
+cat > "$dir/kernels.js" <<'LOX'
+var failures = 0;
+
+fun expect(name, n, got, want)
+{
+    if (got != want)
+    {
+        print name + " at length " + n + ": got " + got + ", expected " + want;
+        failures = failures + 1;
+    }
+}
+
+// 各位置的值互不相同，最小值与最大值落在不同的块中
+fun valueAt(i)
+{
+    return (i * 37) % 101 - 50;
+}
+
+fun checkKind(name, make, offset)
+{
+    for (var n = 0; n < 70; n = n + 1)
+    {
+        var a = make(n);
+        var b = make(n);
+        var sum = 0;
+        var lo = nil;
+        var hi = nil;
+        for (var i = 0; i < n; i = i + 1)
+        {
+            var v = valueAt(i) + offset;
+            a[i] = v;
+            b[i] = 1;
+            sum = sum + v;
+            if (lo == nil or v < lo)
+                lo = v;
+            if (hi == nil or hi < v)
+                hi = v;
+        }
+        expect(name + " sum", n, a.sum(), sum);
+        expect(name + " min", n, a.min(), lo);
+        expect(name + " max", n, a.max(), hi);
+        if (0 < n)
+            expect(name + " indexOf", n, a.indexOf(valueAt(n - 1) + offset), n - 1);
+        expect(name + " indexOf missing", n, a.indexOf(77 + offset), -1);
+
+        a.add(b);
+        for (var i = 0; i < n; i = i + 1)
+            expect(name + " add", n, a[i], valueAt(i) + offset + 1);
+    }
+}
+
+checkKind("Float64Array", Float64Array, 0.5);
+checkKind("Int32Array", Int32Array, 0);
+checkKind("Uint8Array", Uint8Array, 100);
+
+for (var n = 0; n < 70; n = n + 1)
+{
+    var a = Float64Array(n);
+    var b = Float64Array(n);
+    var dot = 0;
+    for (var i = 0; i < n; i = i + 1)
+    {
+        a[i] = valueAt(i);
+        b[i] = i;
+        dot = dot + valueAt(i) * i;
+    }
+    expect("Float64Array dot", n, a.dot(b), dot);
+    a.scale(2);
+    for (var i = 0; i < n; i = i + 1)
+        expect("Float64Array scale", n, a[i], valueAt(i) * 2);
+}
+
+// 首末字节相同而中间不同的候选 xaz 先于真正的 xyz 出现
+for (var length = 3; length < 80; length = length + 1)
+{
+    for (var at = 0; at + 3 <= length; at = at + 1)
+    {
+        var text = "";
+        for (var i = 0; i < at; i = i + 1)
+            text = text + "a";
+        var prefix = text;
+        text = text + "xyz";
+        for (var i = at + 3; i < length; i = i + 1)
+            text = text + "b";
+        expect("indexOf xyz", length, text.indexOf("xyz"), at);
+        expect("indexOf xaz", length, (prefix + "xaz" + text).indexOf("xyz"), at * 2 + 3);
+        expect("indexOf missing", length, text.indexOf("xyy"), -1);
+    }
+}
+
+print failures;
+LOX
+output=$("$loxj" --no-cache "$dir/kernels.js")
+[ "$output" = 0 ] || fail "kernel results differ:
+$output"
+
+# CSV：字段长度递增，带引号的字段含分隔符与转义的引号，跨越 64 字节的块边界
+i=1
+: > "$dir/rows.csv"
+: > "$dir/expected.txt"
+while [ $i -le 40 ]; do
+    field=$(printf "%${i}s" | tr ' ' x)
+    printf '%s,"a,b""c%d",%d\n' "$field" "$i" "$i" >> "$dir/rows.csv"
+    printf '%s|a,b"c%d|%d\n' "$field" "$i" "$i" >> "$dir/expected.txt"
+    i=$((i + 1))
+done
+cat > "$dir/csv.js" <<LOX
+fun show(row)
+{
+    print row[0] + "|" + row[1] + "|" + row[2];
+}
+readCsv("$dir/rows.csv", show);
+LOX
+"$loxj" --no-cache "$dir/csv.js" > "$dir/actual.txt"
+cmp -s "$dir/expected.txt" "$dir/actual.txt" || fail "readCsv rows differ"
+
+exit $status
@@ -0,0 +1,125 @@
+#!/bin/sh
+# 堆快照：恢复快照后运行与连同前导脚本一起运行的结果相同（类与继承、方法、闭包与共享的上值、容器）；
+# 截断的快照报告损坏，改动任意字节都不会使解释器崩溃
+# 用法：sh tests/snapshot.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+status=0
+
+fail()
+{
+    echo "snapshot: $*"
+    status=1
+}
+
+# 运行 loxj，有 timeout 时防止改动后的跳转形成死循环
+run()
+{
+    if command -v timeout >/dev/null 2>&1; then
+        timeout 10 "$loxj" "$@"
+    else
+        "$loxj" "$@"
+    fi
+}
+
+# 将 $1 第 $2 个字节按位取反
+flip()
+{
+    byte=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\$(printf %o $((byte ^ 255)))" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+cat > "$dir/prelude.js" <<'LOX'
+class Animal
+{
+    constructor(name)
+    {
+        this.name = name;
+    }
+
+    speak()
+    {
+        return this.name + " makes a sound";
+    }
+}
+
+class Dog < Animal
+{
+    speak()
+    {
+        return super.speak() + " (woof)";
+    }
+}
+
+// 两个闭包共享同一个上值，快照前已关闭
+fun makeCounter()
+{
+    var count = 0;
+    fun increment()
+    {
+        count = count + 1;
+        return count;
+    }
+    fun read()
+    {
+        return count;
+    }
+    return [increment, read];
+}
+
+var counter = makeCounter();
+counter[0]();
+var rex = Dog("Rex");
+var speak = rex.speak;
+var table = Map();
+table.set("rex", rex);
+table.set(1, [1, "two", nil, true]);
+LOX
+
+cat > "$dir/main.js" <<'LOX'
+print counter[0]();
+print counter[1]();
+print rex.speak();
+print speak();
+print Dog("Fido").speak();
+print table.get("rex").name;
+print table.get(1)[1];
+print table.size;
+LOX
+expected=$(printf '2\n2\nRex makes a sound (woof)\nRex makes a sound (woof)\nFido makes a sound (woof)\nRex\ntwo\n2')
+
+cat "$dir/prelude.js" "$dir/main.js" > "$dir/both.js"
+[ "$("$loxj" --no-cache "$dir/both.js")" = "$expected" ] || fail "combined script output differs"
+
+"$loxj" --snapshot "$dir/prelude.js" -o "$dir/prelude.snap" || { fail "--snapshot failed"; exit 1; }
+[ "$(run --no-cache --restore "$dir/prelude.snap" "$dir/main.js")" = "$expected" ] || fail "restored output differs"
+
+# 快照约 2 KiB（大部分是内置函数的全局变量名），以下两项每隔 3 字节取一个位置，控制运行次数
+# 截断：文件头之后的截断都报告损坏，恢复失败时不会执行，无需 timeout
+size=$(wc -c < "$dir/prelude.snap")
+length=20
+while [ "$length" -lt "$size" ]; do
+    head -c "$length" "$dir/prelude.snap" > "$dir/truncated.snap"
+    case $("$loxj" --no-cache --restore "$dir/truncated.snap" "$dir/main.js" 2>&1) in
+    *"corrupt snapshot"*) ;;
+    *) fail "truncated to $length bytes was not reported as corrupt" ;;
+    esac
+    length=$((length + 3))
+done
+
+# 改动字节：要么报告无法恢复（65），要么正常运行或报告运行时错误，不能崩溃
+offset=0
+while [ "$offset" -lt "$size" ]; do
+    cp "$dir/prelude.snap" "$dir/flipped.snap"
+    flip "$dir/flipped.snap" "$offset"
+    run --no-cache --restore "$dir/flipped.snap" "$dir/main.js" >/dev/null 2>&1
+    code=$?
+    case $code in
+    0 | 65 | 70) ;;
+    *) fail "flipping byte $offset exited with status $code" ;;
+    esac
+    offset=$((offset + 3))
+done
+
+exit $status
@@ -0,0 +1,36 @@
+#!/bin/sh
+# 跳转距离超过 64 KiB 时改为带 OP_WIDE 前缀的 3 字节偏移，向前的条件跳转与向后的 OP_LOOP 都覆盖
+# 用法：sh tests/widejump.sh <loxj>
+loxj=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# 每条 x = x + 1; 编译为 5 字节，14000 条约 70 KiB
+awk 'BEGIN {
+    body = ""
+    for (i = 0; i < 14000; i++)
+        body = body "        x = x + 1;\n"
+    printf "fun f(c)\n{\n    var x = 0;\n    if (c)\n    {\n%s    }\n    return x;\n}\n", body
+    printf "fun g(n)\n{\n    var x = 0;\n    while (x < n)\n    {\n%s    }\n    return x;\n}\n", body
+    print "print f(true);"
+    print "print f(false);"
+    print "print g(28000);"
+    print "print g(1);"
+}' > "$dir/wide.js"
+
+jumps=$("$loxj" --disassemble "$dir/wide.js" | grep -E 'OP_(POP_)?JUMP|OP_LOOP')
+expected='0004     | OP_WIDE OP_POP_JUMP_IF_FALSE    5 -> 70012
+0007     | OP_WIDE OP_POP_JUMP_IF_FALSE    8 -> 70020
+70015  28014 OP_WIDE OP_LOOP          70016 -> 2'
+if [ "$jumps" != "$expected" ]; then
+    echo "widejump: unexpected jumps:"
+    echo "$jumps"
+    exit 1
+fi
+
+output=$("$loxj" --no-cache "$dir/wide.js")
+if [ "$output" != "$(printf '14000\n0\n28000\n14000')" ]; then
+    echo "widejump: unexpected output:"
+    echo "$output"
+    exit 1
+fi